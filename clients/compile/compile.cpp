@@ -0,0 +1,597 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../common/consts.h"
+#include "../../common/msg/msg.h"
+#include "../../common/msg/NodesManager.h"
+#include "../../common/utils/utils.h"
+#include "../../common/utils/FormatableString.h"
+#include "../../compiler/compiler.h"
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Aseba
+{
+	using namespace std;
+
+	/**
+	\defgroup compile Batch compiler
+	*/
+	/*@{*/
+
+	//! Descriptions of nodes rebuilt from the messages recorded by asebarec while they announced themselves
+	class RecordedDescriptions: public NodesManager
+	{
+	public:
+		void load(const string& fileName);
+		const TargetDescription* getCompleteDescription(const wstring& name, unsigned preferedId, unsigned& nodeId) const;
+
+	protected:
+		// from NodesManager, descriptions are read from a file so there is no one to send requests to
+		void sendMessage(const Message& message) override {}
+	};
+
+	//! Read a file in the format of asebarec: time, source, type, size, then bytes in hexadecimal, one message per line
+	void RecordedDescriptions::load(const string& fileName)
+	{
+		ifstream file(fileName);
+		if (!file.good())
+			throw runtime_error(FormatableString("Cannot read target descriptions from %0").arg(fileName));
+
+		set<unsigned> describedNodes;
+		string line;
+		while (getline(file, line))
+		{
+			istringstream words(line);
+			string timeStamp, source, type;
+			unsigned size;
+			if (!(words >> timeStamp >> source >> type >> size))
+				continue;
+
+			Message::SerializationBuffer buffer;
+			buffer.rawData.reserve(size);
+			string byte;
+			while (words >> byte)
+				buffer.rawData.push_back(strtol(byte.c_str(), nullptr, 16));
+
+			// parts of a description are only meaningful after its header
+			const uint16_t sourceId(strtol(source.c_str(), nullptr, 16));
+			const uint16_t typeId(strtol(type.c_str(), nullptr, 16));
+			if (typeId == ASEBA_MESSAGE_DESCRIPTION)
+				describedNodes.insert(sourceId);
+			else if (describedNodes.find(sourceId) == describedNodes.end())
+				continue;
+
+			unique_ptr<Message> message(Message::create(sourceId, typeId, buffer));
+			processMessage(message.get());
+		}
+	}
+
+	//! Return the complete description of the node named name, preferably with id preferedId, or 0 if there is none
+	const TargetDescription* RecordedDescriptions::getCompleteDescription(const wstring& name, unsigned preferedId, unsigned& nodeId) const
+	{
+		bool ok;
+		nodeId = getNodeId(name, preferedId, &ok);
+		if (!ok)
+			return nullptr;
+		const auto nodeIt(nodes.find(nodeId));
+		if (nodeIt == nodes.end() || !nodeIt->second.isComplete())
+			return nullptr;
+		return &nodeIt->second;
+	}
+
+	//! The program of a node in an aesl file
+	struct NodeProgram
+	{
+		wstring name; //!< name of the node
+		unsigned storedId; //!< identifier of the node when the file was saved
+		wstring source; //!< source code
+	};
+
+	//! An aesl file, with the definitions shared by its nodes
+	struct AeslFile
+	{
+		string fileName;
+		CommonDefinitions commonDefinitions;
+		vector<NodeProgram> programs;
+		string error; //!< if not empty, the file could not be read
+	};
+
+	//! Return the UTF-8 content of an attribute of an XML element, or the empty string if there is none
+	static string xmlAttribute(xmlNodePtr element, const char* name)
+	{
+		xmlChar* value(xmlGetProp(element, BAD_CAST(name)));
+		const string result(value ? (const char*)value : "");
+		xmlFree(value);
+		return result;
+	}
+
+	//! Load events, constants and node programs from an aesl file
+	static void loadAeslFile(AeslFile& file)
+	{
+		xmlDocPtr doc(xmlReadFile(file.fileName.c_str(), nullptr, 0));
+		if (!doc)
+		{
+			file.error = "cannot read aesl file";
+			return;
+		}
+
+		const xmlNodePtr network(xmlDocGetRootElement(doc));
+		for (xmlNodePtr element = network ? network->children : nullptr; element; element = element->next)
+		{
+			if (element->type != XML_ELEMENT_NODE)
+				continue;
+			const string tag((const char*)element->name);
+			if (tag == "event")
+			{
+				const unsigned eventSize(atoi(xmlAttribute(element, "size").c_str()));
+				if (eventSize > ASEBA_MAX_EVENT_ARG_SIZE)
+				{
+					file.error = FormatableString("event %0 has a length %1 larger than maximum %2").arg(xmlAttribute(element, "name")).arg(eventSize).arg(ASEBA_MAX_EVENT_ARG_SIZE);
+					break;
+				}
+				file.commonDefinitions.events.push_back(NamedValue(UTF8ToWString(xmlAttribute(element, "name")), eventSize));
+			}
+			else if (tag == "constant")
+			{
+				file.commonDefinitions.constants.push_back(NamedValue(UTF8ToWString(xmlAttribute(element, "name")), atoi(xmlAttribute(element, "value").c_str())));
+			}
+			else if (tag == "node")
+			{
+				xmlChar* text(xmlNodeGetContent(element));
+				file.programs.push_back({
+					UTF8ToWString(xmlAttribute(element, "name")),
+					unsigned(atoi(xmlAttribute(element, "nodeId").c_str())),
+					UTF8ToWString(text ? (const char*)text : "")
+				});
+				xmlFree(text);
+			}
+		}
+
+		xmlFreeDoc(doc);
+	}
+
+	//! The compilation of one node program, and its result
+	struct CompilationJob
+	{
+		const AeslFile* file;
+		const NodeProgram* program; //!< 0 if the file could not be read
+		unique_ptr<Compiler> compiler;
+
+		bool success{false};
+		Error error;
+		unsigned nodeId{0};
+		const TargetDescription* description{nullptr};
+		BytecodeVector bytecode;
+		unsigned allocatedVariablesCount{0};
+		CompilationStatistics statistics;
+		string bytecodeFileName;
+		string symbolsFileName;
+	};
+
+	//! Return s quoted and escaped as a JSON string
+	static string jsonString(const string& s)
+	{
+		string result("\"");
+		for (const char c : s)
+		{
+			switch (c)
+			{
+				case '"': result += "\\\""; break;
+				case '\\': result += "\\\\"; break;
+				case '\n': result += "\\n"; break;
+				case '\t': result += "\\t"; break;
+				default:
+				if ((unsigned char)c < 0x20)
+					result += FormatableString("\\u%0").arg(unsigned((unsigned char)c), 4, 16, '0');
+				else
+					result += c;
+			}
+		}
+		return result + "\"";
+	}
+
+	//! Return s with every character that is not safe in file names replaced by an underscore
+	static string fileNameSafe(const string& s)
+	{
+		string result(s);
+		for (char& c : result)
+			if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.')
+				c = '_';
+		return result;
+	}
+
+	//! Return the name of an event of a compiled program
+	static wstring eventName(const CompilationJob& job, unsigned eventId)
+	{
+		if (eventId == ASEBA_EVENT_INIT)
+			return L"init";
+		if (eventId < job.file->commonDefinitions.events.size())
+			return job.file->commonDefinitions.events[eventId].name;
+		const int localId(ASEBA_EVENT_LOCAL_EVENTS_START - eventId);
+		if (localId >= 0 && localId < (int)job.description->localEvents.size())
+			return job.description->localEvents[localId].name;
+		return L"unknown";
+	}
+
+	//! Write the linked bytecode as an Aseba Binary Object.
+	//! The product identifier and firmware version are only known by running nodes, so they are left to 0.
+	static void writeBytecode(const CompilationJob& job)
+	{
+		ofstream file(job.bytecodeFileName, ios::binary | ios::trunc);
+		const vector<uint16_t> bytecode(job.bytecode.begin(), job.bytecode.end());
+		if (!writeBinaryObject(file, job.description->protocolVersion, 0, 0, job.nodeId, job.description->name, job.description->crc(), bytecode))
+			throw runtime_error(FormatableString("cannot write %0").arg(job.bytecodeFileName));
+	}
+
+	//! Write the addresses of variables, events and subroutines of the linked bytecode as JSON
+	static void writeSymbols(const CompilationJob& job)
+	{
+		ofstream file(job.symbolsFileName, ios::trunc);
+		file << "{\n\t\"node\": " << jsonString(WStringToUTF8(job.program->name)) << ",\n";
+
+		file << "\t\"variables\": [";
+		vector<pair<unsigned, wstring>> variables;
+		for (const auto& variable : *job.compiler->getVariablesMap())
+			variables.emplace_back(variable.second.first, variable.first);
+		sort(variables.begin(), variables.end());
+		for (size_t i = 0; i < variables.size(); ++i)
+		{
+			const auto& entry(job.compiler->getVariablesMap()->at(variables[i].second));
+			file << (i ? "," : "") << "\n\t\t{ \"name\": " << jsonString(WStringToUTF8(variables[i].second)) << ", \"address\": " << entry.first << ", \"size\": " << entry.second << " }";
+		}
+		file << "\n\t],\n";
+
+		// the event vector table starts the bytecode: its size, then pairs of event id and address
+		file << "\t\"events\": [";
+		const unsigned vectorTableSize(job.bytecode.size() ? job.bytecode[0].bytecode : 0);
+		for (unsigned i = 1; i + 1 < vectorTableSize && i + 1 < job.bytecode.size(); i += 2)
+		{
+			const unsigned eventId(job.bytecode[i].bytecode);
+			file << (i > 1 ? "," : "") << "\n\t\t{ \"name\": " << jsonString(WStringToUTF8(eventName(job, eventId))) << ", \"id\": " << eventId << ", \"address\": " << job.bytecode[i + 1].bytecode << " }";
+		}
+		file << "\n\t],\n";
+
+		// subroutines removed because never called have no address
+		file << "\t\"subroutines\": [";
+		bool first(true);
+		for (const auto& subroutine : *job.compiler->getSubroutineTable())
+		{
+			if (subroutine.address == 0)
+				continue;
+			file << (first ? "" : ",") << "\n\t\t{ \"name\": " << jsonString(WStringToUTF8(subroutine.name)) << ", \"address\": " << subroutine.address << ", \"line\": " << subroutine.line + 1 << " }";
+			first = false;
+		}
+		file << "\n\t]\n}\n";
+		if (!file.good())
+			throw runtime_error(FormatableString("cannot write %0").arg(job.symbolsFileName));
+	}
+
+	//! Compile a job and write its outputs; called from worker threads, each job touching only its own data
+	static void runJob(CompilationJob& job)
+	{
+		if (!job.program)
+			return;
+		if (!job.description)
+		{
+			job.error = Error(SourcePos(), L"no complete target description for this node");
+			return;
+		}
+
+		wistringstream source(job.program->source);
+		job.compiler->setTargetDescription(job.description);
+		job.compiler->setCommonDefinitions(&job.file->commonDefinitions);
+		job.success = job.compiler->compile(source, job.bytecode, job.allocatedVariablesCount, job.error, nullptr, &job.statistics);
+		if (!job.success)
+			return;
+
+		try
+		{
+			writeBytecode(job);
+			writeSymbols(job);
+		}
+		catch (const runtime_error& e)
+		{
+			job.success = false;
+			job.error = Error(SourcePos(), UTF8ToWString(e.what()));
+		}
+	}
+
+	//! Write the code statistics of events or subroutines as a JSON array, unbounded instructions counts being null
+	static void writeCodeStatistics(ostream& report, const CompilationStatistics::CodeStatisticsVector& codes)
+	{
+		report << "[";
+		for (size_t i = 0; i < codes.size(); ++i)
+		{
+			report << (i ? ", " : "") << "{ \"name\": " << jsonString(WStringToUTF8(codes[i].name)) << ", \"size\": " << codes[i].words << ", \"maxStackDepth\": " << codes[i].maxStackDepth << ", \"maxInstructions\": ";
+			if (codes[i].maxInstructions == UNBOUNDED_INSTRUCTIONS)
+				report << "null";
+			else
+				report << codes[i].maxInstructions;
+			report << " }";
+		}
+		report << "]";
+	}
+
+	//! Write the warnings of a compilation as a JSON array
+	static void writeWarnings(ostream& report, const vector<Error>& warnings)
+	{
+		report << "[";
+		for (size_t i = 0; i < warnings.size(); ++i)
+		{
+			report << (i ? ", " : "") << "{ ";
+			if (warnings[i].pos.valid)
+				report << "\"line\": " << warnings[i].pos.row + 1 << ", \"column\": " << warnings[i].pos.column + 1 << ", ";
+			report << "\"message\": " << jsonString(WStringToUTF8(warnings[i].message)) << " }";
+		}
+		report << "]";
+	}
+
+	//! Write the statistics of a compilation as members of a JSON object
+	static void writeStatistics(ostream& report, const CompilationStatistics& statistics)
+	{
+		report << "\t\t\t\"phasesMicroseconds\": { ";
+		for (unsigned phase = 0; phase < CompilationStatistics::PHASES_COUNT; ++phase)
+		{
+			const string name(WStringToUTF8(CompilationStatistics::phaseName(CompilationStatistics::Phase(phase))));
+			report << (phase ? ", " : "") << jsonString(name) << ": " << unsigned(statistics.phaseDurations[phase]);
+		}
+		report << " },\n";
+		report << "\t\t\t\"treeNodes\": " << statistics.nodesBeforeExpansion << ",\n";
+		report << "\t\t\t\"expandedTreeNodes\": " << statistics.nodesAfterExpansion << ",\n";
+		report << "\t\t\t\"events\": ";
+		writeCodeStatistics(report, statistics.events);
+		report << ",\n";
+		report << "\t\t\t\"subroutines\": ";
+		writeCodeStatistics(report, statistics.subroutines);
+		report << ",\n";
+		report << "\t\t\t\"lines\": [";
+		for (auto it = statistics.lines.begin(); it != statistics.lines.end(); ++it)
+			report << (it == statistics.lines.begin() ? "" : ", ") << "{ \"line\": " << it->first + 1 << ", \"words\": " << it->second.words << ", \"instructions\": " << it->second.instructions << " }";
+		report << "],\n";
+	}
+
+	//! Write the outcome of all jobs as JSON
+	static void writeReport(ostream& report, const vector<unique_ptr<CompilationJob>>& jobs)
+	{
+		const size_t succeeded(count_if(jobs.begin(), jobs.end(), [](const unique_ptr<CompilationJob>& job) { return job->success; }));
+		report << "{\n";
+		report << "\t\"succeeded\": " << succeeded << ",\n";
+		report << "\t\"failed\": " << jobs.size() - succeeded << ",\n";
+		report << "\t\"compilations\": [";
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			const CompilationJob& job(*jobs[i]);
+			report << (i ? "," : "") << "\n\t\t{\n";
+			report << "\t\t\t\"file\": " << jsonString(job.file->fileName) << ",\n";
+			if (job.program)
+			{
+				report << "\t\t\t\"node\": " << jsonString(WStringToUTF8(job.program->name)) << ",\n";
+				if (job.description)
+					report << "\t\t\t\"nodeId\": " << job.nodeId << ",\n";
+			}
+			report << "\t\t\t\"success\": " << (job.success ? "true" : "false");
+			if (job.success)
+			{
+				report << ",\n";
+				report << "\t\t\t\"bytecodeSize\": " << job.bytecode.size() << ",\n";
+				report << "\t\t\t\"bytecodeCapacity\": " << job.description->bytecodeSize << ",\n";
+				report << "\t\t\t\"variablesSize\": " << job.allocatedVariablesCount << ",\n";
+				report << "\t\t\t\"variablesCapacity\": " << job.description->variablesSize << ",\n";
+				report << "\t\t\t\"maxStackDepth\": " << job.compiler->getMaxStackDepth() << ",\n";
+				report << "\t\t\t\"stackSize\": " << job.description->stackSize << ",\n";
+				writeStatistics(report, job.statistics);
+				report << "\t\t\t\"warnings\": ";
+				writeWarnings(report, job.compiler->getWarnings());
+				report << ",\n";
+				report << "\t\t\t\"bytecode\": " << jsonString(job.bytecodeFileName) << ",\n";
+				report << "\t\t\t\"symbols\": " << jsonString(job.symbolsFileName) << "\n";
+			}
+			else
+			{
+				const string message(job.program ? WStringToUTF8(job.error.message) : job.file->error);
+				report << ",\n\t\t\t\"error\": { ";
+				if (job.error.pos.valid)
+					report << "\"line\": " << job.error.pos.row + 1 << ", \"column\": " << job.error.pos.column + 1 << ", ";
+				report << "\"message\": " << jsonString(message) << " }\n";
+			}
+			report << "\t\t}";
+		}
+		report << "\n\t]\n}\n";
+	}
+
+	/*@}*/
+}
+
+//! Show usage
+void dumpHelp(std::ostream &stream, const char *programName)
+{
+	stream << "Aseba compile, compile the programs of aesl files for recorded target descriptions, usage:\n";
+	stream << programName << " [options] -t descriptions [-t descriptions]* file.aesl [file.aesl]*\n";
+	stream << "Options:\n";
+	stream << "-h, --help            : shows this help\n";
+	stream << "-V, --version         : shows the version number\n";
+	stream << "-t, --targets FILE    : reads target descriptions from FILE, as recorded by asebarec\n";
+	stream << "-o, --output DIR      : writes bytecode (.abo) and symbols (.json) to DIR (default: .)\n";
+	stream << "-r, --report FILE     : writes the JSON report to FILE (default: standard output)\n";
+	stream << "-j, --jobs N          : compiles with N threads (default: number of cores)\n";
+	stream << "-s, --size            : optimizes the bytecode for size instead of speed\n";
+	stream << "-b, --budget N        : warns about events that might execute more than N instructions\n";
+	stream << "Every node of every file is compiled for the recorded node with the same name.\n";
+	stream << "Descriptions are recorded by running asebarec while connecting an IDE to the nodes.\n";
+	stream << "The exit status is non-zero if any compilation failed." << std::endl;
+	stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
+}
+
+//! Show version
+void dumpVersion(std::ostream &stream)
+{
+	stream << "Aseba compile " << ASEBA_VERSION << std::endl;
+	stream << "Aseba protocol " << ASEBA_PROTOCOL_VERSION << std::endl;
+	stream << "Licence LGPLv3: GNU LGPL version 3 <http://www.gnu.org/licenses/lgpl.html>\n";
+}
+
+int main(int argc, char *argv[])
+{
+	using namespace Aseba;
+
+	std::vector<std::string> descriptionFiles;
+	std::vector<std::string> aeslFiles;
+	std::string outputDirectory(".");
+	std::string reportFile;
+	unsigned jobsCount(std::max(1u, std::thread::hardware_concurrency()));
+	bool optimizeForSize(false);
+	InstructionsCount instructionsBudget(0);
+
+	int argCounter = 1;
+	while (argCounter < argc)
+	{
+		const char *arg = argv[argCounter];
+		const bool hasValue(argCounter + 1 < argc);
+		if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
+		{
+			dumpHelp(std::cout, argv[0]);
+			return 0;
+		}
+		else if ((strcmp(arg, "-V") == 0) || (strcmp(arg, "--version") == 0))
+		{
+			dumpVersion(std::cout);
+			return 0;
+		}
+		else if (((strcmp(arg, "-t") == 0) || (strcmp(arg, "--targets") == 0)) && hasValue)
+			descriptionFiles.push_back(argv[++argCounter]);
+		else if (((strcmp(arg, "-o") == 0) || (strcmp(arg, "--output") == 0)) && hasValue)
+			outputDirectory = argv[++argCounter];
+		else if (((strcmp(arg, "-r") == 0) || (strcmp(arg, "--report") == 0)) && hasValue)
+			reportFile = argv[++argCounter];
+		else if (((strcmp(arg, "-j") == 0) || (strcmp(arg, "--jobs") == 0)) && hasValue)
+			jobsCount = std::max(1, atoi(argv[++argCounter]));
+		else if ((strcmp(arg, "-s") == 0) || (strcmp(arg, "--size") == 0))
+			optimizeForSize = true;
+		else if (((strcmp(arg, "-b") == 0) || (strcmp(arg, "--budget") == 0)) && hasValue)
+			instructionsBudget = strtoull(argv[++argCounter], nullptr, 10);
+		else if (arg[0] == '-')
+		{
+			dumpHelp(std::cerr, argv[0]);
+			return 1;
+		}
+		else
+			aeslFiles.push_back(arg);
+		argCounter++;
+	}
+	if (descriptionFiles.empty() || aeslFiles.empty())
+	{
+		dumpHelp(std::cerr, argv[0]);
+		return 1;
+	}
+
+	// load target descriptions
+	RecordedDescriptions descriptions;
+	try
+	{
+		for (const auto& fileName : descriptionFiles)
+			descriptions.load(fileName);
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	// load aesl files and create one job per node program
+	std::vector<std::unique_ptr<AeslFile>> files;
+	std::vector<std::unique_ptr<CompilationJob>> jobs;
+	for (const auto& fileName : aeslFiles)
+	{
+		files.emplace_back(new AeslFile);
+		AeslFile& file(*files.back());
+		file.fileName = fileName;
+		loadAeslFile(file);
+
+		std::string baseName(fileName.substr(fileName.find_last_of("/\\") + 1));
+		if (baseName.size() > 5 && baseName.compare(baseName.size() - 5, 5, ".aesl") == 0)
+			baseName.resize(baseName.size() - 5);
+
+		if (!file.error.empty())
+		{
+			jobs.emplace_back(new CompilationJob);
+			jobs.back()->file = &file;
+			jobs.back()->program = nullptr;
+			continue;
+		}
+		for (const auto& program : file.programs)
+		{
+			jobs.emplace_back(new CompilationJob);
+			CompilationJob& job(*jobs.back());
+			job.file = &file;
+			job.program = &program;
+			job.compiler.reset(new Compiler);
+			if (optimizeForSize)
+				job.compiler->setOptimizationGoal(Compiler::OPTIMIZE_FOR_SIZE);
+			job.compiler->setInstructionsBudget(instructionsBudget);
+			job.description = descriptions.getCompleteDescription(program.name, program.storedId, job.nodeId);
+			const std::string outputBase(outputDirectory + "/" + fileNameSafe(baseName + "-" + WStringToUTF8(program.name) + "-" + std::to_string(program.storedId)));
+			job.bytecodeFileName = outputBase + ".abo";
+			job.symbolsFileName = outputBase + ".json";
+		}
+	}
+
+	// compile on a pool of threads, each taking the next job until there are none left
+	std::atomic<size_t> nextJob(0);
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < std::min<size_t>(jobsCount, jobs.size()); ++i)
+		workers.emplace_back([&]()
+		{
+			for (size_t job = nextJob++; job < jobs.size(); job = nextJob++)
+				runJob(*jobs[job]);
+		});
+	for (auto& worker : workers)
+		worker.join();
+
+	// report
+	if (reportFile.empty())
+		writeReport(std::cout, jobs);
+	else
+	{
+		std::ofstream report(reportFile, std::ios::trunc);
+		writeReport(report, jobs);
+		if (!report.good())
+		{
+			std::cerr << "Cannot write report to " << reportFile << std::endl;
+			return 1;
+		}
+	}
+
+	const bool allSucceeded(std::all_of(jobs.begin(), jobs.end(), [](const std::unique_ptr<CompilationJob>& job) { return job->success; }));
+	return allSucceeded ? 0 : 1;
+}
@@ -369,6 +369,65 @@ namespace Aseba
 		return space;
 	}
 
+	AeslBytecodeSizeSidebar::AeslBytecodeSizeSidebar(AeslEditor *editor) :
+		AeslEditorSidebar(editor)
+	{
+	}
+
+	void AeslBytecodeSizeSidebar::setLinesWords(const QMap<int, unsigned>& words)
+	{
+		linesWords = words;
+		update();
+	}
+
+	void AeslBytecodeSizeSidebar::showBytecodeSizes(bool state)
+	{
+		setVisible(state);
+	}
+
+	void AeslBytecodeSizeSidebar::paintEvent(QPaintEvent *event)
+	{
+		AeslEditorSidebar::paintEvent(event);
+
+		QPainter painter(this);
+		painter.fillRect(event->rect(), QColor(225, 225, 210));
+
+		// same clipping and alignment as the line numbers
+		QRect editorRect = editor->contentsRect();
+		painter.setClipRect(QRect(0, editorRect.top(), width(), editorRect.bottom()), Qt::ReplaceClip );
+		painter.setClipping(true);
+
+		painter.setPen(Qt::darkGray);
+		painter.setFont(editor->font());
+
+		QTextBlock block = editor->document()->firstBlock();
+		while(block.isValid())
+		{
+			const QMap<int, unsigned>::const_iterator it(linesWords.find(block.blockNumber()));
+			if (block.isVisible() && it != linesWords.end())
+			{
+				int y = block.layout()->position().y() + editorRect.top() - verticalScroll;
+				painter.drawText(0, y, width() - 3, editor->fontMetrics().height(), Qt::AlignRight, QString::number(it.value()));
+			}
+
+			block = block.next();
+		}
+	}
+
+	int AeslBytecodeSizeSidebar::idealWidth() const
+	{
+		unsigned maxWords = 0;
+		foreach (unsigned words, linesWords)
+			maxWords = qMax(maxWords, words);
+		int digits = 1;
+		while (maxWords >= 10) {
+			maxWords /= 10;
+			digits++;
+		}
+
+		return 6 + editor->fontMetrics().width(QLatin1Char('9')) * digits;
+	}
+
 	AeslBreakpointSidebar::AeslBreakpointSidebar(AeslEditor *editor) :
 		AeslEditorSidebar(editor),
 		borderSize(1)
@@ -25,6 +25,7 @@
 
 #include <QWidget>
 #include <QHash>
+#include <QMap>
 #include <QTextCharFormat>
 #include <QTextBlockUserData>
 #include <QTextEdit>
@@ -122,6 +123,26 @@ namespace Aseba
 		virtual int idealWidth() const;
 	};
 
+	//! Sidebar showing the number of bytecode words generated for each line
+	class AeslBytecodeSizeSidebar : public AeslEditorSidebar
+	{
+		Q_OBJECT
+
+	public:
+		AeslBytecodeSizeSidebar(AeslEditor* editor);
+		void setLinesWords(const QMap<int, unsigned>& words);
+
+	public slots:
+		void showBytecodeSizes(bool state);
+
+	protected:
+		virtual void paintEvent(QPaintEvent *event);
+		virtual int idealWidth() const;
+
+	protected:
+		QMap<int, unsigned> linesWords; //!< bytecode words of each line, starting from 0
+	};
+
 	class AeslBreakpointSidebar : public AeslEditorSidebar
 	{
 		Q_OBJECT
@@ -902,7 +902,7 @@ namespace Aseba
 		MessagesHandlersMap::const_iterator messageHandler = messagesHandlersMap.find(message->type);
 		if (messageHandler == messagesHandlersMap.end())
 		{
-			UserMessage *userMessage = dynamic_cast<UserMessage *>(message);
+			UserMessage *userMessage = messageCast<UserMessage>(message);
 			if (userMessage)
 			{
 				userEventsQueue.enqueue(userMessage);
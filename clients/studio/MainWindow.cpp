@@ -433,11 +433,13 @@ namespace Aseba
 		memoryUsageText->setWordWrap(true);
 
 		// editor area
+		bytecodeSizes = new AeslBytecodeSizeSidebar(editor);
 		QHBoxLayout *editorAreaLayout = new QHBoxLayout;
 		editorAreaLayout->setSpacing(0);
 		editorAreaLayout->addWidget(breakpoints);
 		editorAreaLayout->addWidget(linenumbers);
 		editorAreaLayout->addWidget(editor);
+		editorAreaLayout->addWidget(bytecodeSizes);
 
 		// keywords
 		keywordsToolbar = new QToolBar();
@@ -839,25 +841,15 @@ namespace Aseba
 		target->reboot(id);
 	}
 
-	static void write16(QIODevice& dev, const uint16_t v)
-	{
-		dev.write((const char*)&v, 2);
-	}
-
-	static void write16(QIODevice& dev, const VariablesDataVector& data, const char *varName)
+	//! Return the value of a variable required to save bytecode, 0 with a warning if the node does not have it
+	static uint16_t bytecodeHeaderValue(const VariablesDataVector& data, const char *varName)
 	{
 		if (data.empty())
 		{
 			std::cerr << "Warning, cannot find " << varName << " required to save bytecode, using 0" << std::endl;
-			write16(dev, 0);
+			return 0;
 		}
-		else
-			dev.write((const char *)&data[0], 2);
-	}
-
-	static uint16_t crcXModem(const uint16_t oldCrc, const QString& s)
-	{
-		return crcXModem(oldCrc, s.toStdWString());
+		return data[0];
 	}
 
 	void NodeTab::saveBytecode()
@@ -869,29 +861,18 @@ namespace Aseba
 		if (!file.open(QFile::WriteOnly | QFile::Truncate))
 			return;
 
-		// See AS001 at https://aseba.wikidot.com/asebaspecifications
-
-		// header
-		const char* magic = "ABO";
-		file.write(magic, 4);
-		write16(file, 0); // binary format version
-		write16(file, target->getDescription(id)->protocolVersion);
-		write16(file, vmMemoryModel->getVariableValue("_productId"), "product identifier (_productId)");
-		write16(file, vmMemoryModel->getVariableValue("_fwversion"), "firmware version (_fwversion)");
-		write16(file, id);
-		write16(file, crcXModem(0, nodeName));
-		write16(file, target->getDescription(id)->crc());
-
-		// bytecode
-		write16(file, bytecode.size());
-		uint16_t crc(0);
-		for (size_t i = 0; i < bytecode.size(); ++i)
-		{
-			const uint16_t bc(bytecode[i]);
-			write16(file, bc);
-			crc = crcXModem(crc, bc);
-		}
-		write16(file, crc);
+		std::ostringstream stream;
+		writeBinaryObject(stream,
+			target->getDescription(id)->protocolVersion,
+			bytecodeHeaderValue(vmMemoryModel->getVariableValue("_productId"), "product identifier (_productId)"),
+			bytecodeHeaderValue(vmMemoryModel->getVariableValue("_fwversion"), "firmware version (_fwversion)"),
+			id,
+			nodeName.toStdWString(),
+			target->getDescription(id)->crc(),
+			std::vector<uint16_t>(bytecode.begin(), bytecode.end())
+		);
+		const std::string data(stream.str());
+		file.write(data.data(), data.size());
 	}
 
 	void NodeTab::setVariableValues(unsigned index, const VariablesDataVector &values)
@@ -1056,12 +1037,13 @@ namespace Aseba
 		std::wistringstream is(source.toStdWString());
 
 		if (dump)
-			result->success = compiler.compile(is, result->bytecode, result->allocatedVariablesCount, result->error, &result->compilationMessages);
+			result->success = compiler.compile(is, result->bytecode, result->allocatedVariablesCount, result->error, &result->compilationMessages, &result->statistics);
 		else
-			result->success = compiler.compile(is, result->bytecode, result->allocatedVariablesCount, result->error);
+			result->success = compiler.compile(is, result->bytecode, result->allocatedVariablesCount, result->error, nullptr, &result->statistics);
 
 		if (result->success)
 		{
+			result->warnings = compiler.getWarnings();
 			result->variablesMap = *compiler.getVariablesMap();
 			result->subroutineTable = *compiler.getSubroutineTable();
 		}
@@ -1117,10 +1099,17 @@ namespace Aseba
 			);
 
 			if (result->success)
+			{
+				QString warnings;
+				for (const auto& warning : result->warnings)
+					warnings += QString::fromStdWString(warning.toWString(L"Warning")) + QString("\n");
 				mainWindow->compilationMessageBox->setText(
 					tr("Compilation success.") + QString("\n\n") + 
+					warnings +
+					QString::fromStdWString(result->statistics.toWString()) + QString("\n") +
 					QString::fromStdWString(result->compilationMessages.str())
 				);
+			}
 			else 	
 				mainWindow->compilationMessageBox->setText(
 					QString::fromStdWString(result->error.toWString()) + ".\n\n" +
@@ -1156,6 +1145,11 @@ namespace Aseba
 			//vmMemoryView->resizeColumnToContents(0);
 			vmSubroutinesModel->updateSubroutineTable(result->subroutineTable);
 
+			QMap<int, unsigned> linesWords;
+			for (const auto& line : result->statistics.lines)
+				linesWords[line.first] = line.second.words;
+			bytecodeSizes->setLinesWords(linesWords);
+
 			updateHidden();
 			compilationResultText->setText(tr("Compilation success."));
 			compilationResultImage->setPixmap(QPixmap(QString(":/images/ok.png")));
@@ -1167,6 +1161,7 @@ namespace Aseba
 		else
 		{
 			compilationResultText->setText(QString::fromStdWString(result->error.toWString()));
+			bytecodeSizes->setLinesWords(QMap<int, unsigned>());
 			compilationResultImage->setPixmap(QPixmap(QString(":/images/warning.png")));
 			loadButton->setEnabled(false);
 			emit uploadReadynessChanged(false);
@@ -2186,6 +2181,16 @@ namespace Aseba
 		ConfigDialog::setShowLineNumbers(state);
 	}
 
+	void MainWindow::showBytecodeSizesChanged(bool state)
+	{
+		for (int i = 0; i < nodes->count(); i++)
+		{
+			NodeTab* tab = polymorphic_downcast<NodeTab*>(nodes->widget(i));
+			Q_ASSERT(tab);
+			tab->bytecodeSizes->showBytecodeSizes(state);
+		}
+	}
+
 	void MainWindow::goToLine()
 	{
 		assert(currentScriptTab);
@@ -2742,6 +2747,7 @@ namespace Aseba
 		NodeTab* tab = new NodeTab(this, target, &commonDefinitions, node);
 		tab->showKeywords(showKeywordsAct->isChecked());
 		tab->linenumbers->showLineNumbers(showLineNumbers->isChecked());
+		tab->bytecodeSizes->showBytecodeSizes(showBytecodeSizes->isChecked());
 		tab->showMemoryUsage(showMemoryUsageAct->isChecked());
 
 		// check if there is an absent node tab with this id and name, and copy data
@@ -3532,6 +3538,10 @@ namespace Aseba
 		showLineNumbers->setCheckable(true);
 		connect(showLineNumbers, SIGNAL(toggled(bool)), SLOT(showLineNumbersChanged(bool)));
 
+		showBytecodeSizes = new QAction(tr("Show &Bytecode Size of Lines"), this);
+		showBytecodeSizes->setCheckable(true);
+		connect(showBytecodeSizes, SIGNAL(toggled(bool)), SLOT(showBytecodeSizesChanged(bool)));
+
 		zoomInAct = new QAction(tr("&Increase font size"), this);
 		zoomInAct->setShortcut(QKeySequence::ZoomIn);
 		zoomInAct->setEnabled(false);
@@ -3547,6 +3557,7 @@ namespace Aseba
 		viewMenu->addAction(showMemoryUsageAct);
 		viewMenu->addAction(showHiddenAct);
 		viewMenu->addAction(showLineNumbers);
+		viewMenu->addAction(showBytecodeSizes);
 		viewMenu->addSeparator();
 		viewMenu->addAction(zoomInAct);
 		viewMenu->addAction(zoomOutAct);
@@ -209,6 +209,8 @@ namespace Aseba
 			VariablesMap variablesMap;
 			Compiler::SubroutineTable subroutineTable;
 			Error error;
+			CompilationStatistics statistics;
+			std::vector<Error> warnings;
 			std::wostringstream compilationMessages;
 
 			CompilationResult(bool dump):dump(dump), success(false), allocatedVariablesCount(0) {}
@@ -309,6 +311,7 @@ namespace Aseba
 		QLabel *compilationResultImage;
 		QLabel *compilationResultText;
 		QLabel *memoryUsageText;
+		AeslBytecodeSizeSidebar* bytecodeSizes;
 
 		QLabel *executionModeLabel;
 		QPushButton *loadButton;
@@ -418,6 +421,7 @@ namespace Aseba
 		void commentTriggered();
 		void uncommentTriggered();
 		void showLineNumbersChanged(bool state);
+		void showBytecodeSizesChanged(bool state);
 		void goToLine();
 		void zoomIn();
 		void zoomOut();
@@ -586,6 +590,7 @@ namespace Aseba
 		QAction *commentAct;
 		QAction *uncommentAct;
 		QAction *showLineNumbers;
+		QAction *showBytecodeSizes;
 		QAction *goToLineAct;
 		QAction *zoomInAct;
 		QAction *zoomOutAct;
@@ -28,6 +28,22 @@ namespace Aseba
 				msg = tr("Script too big for target bytecode size");
 				break;
 
+			case ERROR_COMPILATION_CANCELLED:
+				msg = tr("Compilation cancelled");
+				break;
+
+			case ERROR_RECURSIVE_SUBROUTINE_CALL:
+				msg = tr("Recursive subroutine call %0, the execution stack would overflow");
+				break;
+
+			case WARNING_UNBOUNDED_LOOP:
+				msg = tr("Cannot bound the iterations of this loop, the execution time of %0 is unbounded");
+				break;
+
+			case WARNING_INSTRUCTIONS_BUDGET_EXCEEDED:
+				msg = tr("Event %0 might execute up to %1 instructions, over the budget of %2");
+				break;
+
 			case ERROR_VARIABLE_NOT_DEFINED:
 				msg = tr("%0 is not a defined variable");
 				break;
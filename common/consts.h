@@ -199,6 +199,9 @@ typedef enum
 	/* from IDE to all nodes, here because it was added later */
 	ASEBA_MESSAGE_LIST_NODES,
 
+	/* from a client to the switch it is connected to, not forwarded */
+	ASEBA_MESSAGE_SWITCH_SUBSCRIBE,
+
 	ASEBA_MESSAGE_INVALID = 0xFFFF
 } AsebaSystemMessagesTypes;
 
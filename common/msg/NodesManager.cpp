@@ -71,6 +71,92 @@ namespace Aseba
 		}
 	}
 
+	//! Handle the messages that describe or disconnect nodes, a single dispatch on their class
+	class NodesManager::MessageHandler: public MessageVisitor
+	{
+	public:
+		MessageHandler(NodesManager& manager): manager(manager) {}
+
+		using MessageVisitor::visit;
+
+		//! A node has disconnected
+		void visit(const Disconnected& disconnected) override
+		{
+			// FIXME: handle disconnected state
+			auto nodeIt = manager.nodes.find(disconnected.source);
+			assert (nodeIt != manager.nodes.end());
+			manager.nodes.erase(nodeIt);
+		}
+
+		//! An initial description
+		void visit(const Description& description) override
+		{
+			auto nodeIt = manager.nodes.find(description.source);
+
+			// We can receive a description twice, for instance if there is another IDE connected
+			if (nodeIt != manager.nodes.end() || (manager.mismatchingNodes.find(description.source) != manager.mismatchingNodes.end()))
+				return;
+
+			// Call a user function when a node protocol version mismatches
+			if ((description.protocolVersion < ASEBA_MIN_TARGET_PROTOCOL_VERSION) ||
+				(description.protocolVersion > ASEBA_PROTOCOL_VERSION))
+			{
+				manager.nodeProtocolVersionMismatch(description.source, description.name, description.protocolVersion);
+				manager.mismatchingNodes.insert(description.source);
+				return;
+			}
+
+			// create node and copy description into it
+			manager.nodes[description.source] = Node(description);
+			manager.checkIfNodeDescriptionComplete(description.source, manager.nodes[description.source]);
+		}
+
+		//! A named variable description
+		void visit(const NamedVariableDescription& description) override
+		{
+			auto nodeIt = manager.nodes.find(description.source);
+			assert (nodeIt != manager.nodes.end());
+
+			// copy description into array if array is empty
+			if (nodeIt->second.namedVariablesReceptionCounter < nodeIt->second.namedVariables.size())
+			{
+				nodeIt->second.namedVariables[nodeIt->second.namedVariablesReceptionCounter++] = description;
+				manager.checkIfNodeDescriptionComplete(nodeIt->first, nodeIt->second);
+			}
+		}
+
+		//! A local event description
+		void visit(const LocalEventDescription& description) override
+		{
+			auto nodeIt = manager.nodes.find(description.source);
+			assert (nodeIt != manager.nodes.end());
+
+			// copy description into array if array is empty
+			if (nodeIt->second.localEventsReceptionCounter < nodeIt->second.localEvents.size())
+			{
+				nodeIt->second.localEvents[nodeIt->second.localEventsReceptionCounter++] = description;
+				manager.checkIfNodeDescriptionComplete(nodeIt->first, nodeIt->second);
+			}
+		}
+
+		//! A native function description
+		void visit(const NativeFunctionDescription& description) override
+		{
+			auto nodeIt = manager.nodes.find(description.source);
+			assert (nodeIt != manager.nodes.end());
+
+			// copy description into array
+			if (nodeIt->second.nativeFunctionReceptionCounter < nodeIt->second.nativeFunctions.size())
+			{
+				nodeIt->second.nativeFunctions[nodeIt->second.nativeFunctionReceptionCounter++] = description;
+				manager.checkIfNodeDescriptionComplete(nodeIt->first, nodeIt->second);
+			}
+		}
+
+	protected:
+		NodesManager& manager;
+	};
+
 	void NodesManager::processMessage(const Message* message)
 	{
 		// check whether the node is known
@@ -107,94 +193,9 @@ namespace Aseba
 			nodeIt->second.lastSeen = UnifiedTime();
 		}
 
-		// if we have a disconnection message
-		{
-			// FIXME: handle disconnected state
-			const auto *disconnected = dynamic_cast<const Disconnected *>(message);
-			if (disconnected)
-			{
-				auto nodeIt = nodes.find(disconnected->source);
-				assert (nodeIt != nodes.end());
-				nodes.erase(nodeIt);
-			}
-		}
-
-		// if we have an initial description
-		{
-			const auto *description = dynamic_cast<const Description *>(message);
-			if (description)
-			{
-				auto nodeIt = nodes.find(description->source);
-
-				// We can receive a description twice, for instance if there is another IDE connected
-				if (nodeIt != nodes.end() || (mismatchingNodes.find(description->source) != mismatchingNodes.end()))
-					return;
-
-				// Call a user function when a node protocol version mismatches
-				if ((description->protocolVersion < ASEBA_MIN_TARGET_PROTOCOL_VERSION) ||
-					(description->protocolVersion > ASEBA_PROTOCOL_VERSION))
-				{
-					nodeProtocolVersionMismatch(description->source, description->name, description->protocolVersion);
-					mismatchingNodes.insert(description->source);
-					return;
-				}
-
-				// create node and copy description into it
-				nodes[description->source] = Node(*description);
-				checkIfNodeDescriptionComplete(description->source, nodes[description->source]);
-			}
-		}
-
-		// if we have a named variable description
-		{
-			const auto *description = dynamic_cast<const NamedVariableDescription *>(message);
-			if (description)
-			{
-				auto nodeIt = nodes.find(description->source);
-				assert (nodeIt != nodes.end());
-
-				// copy description into array if array is empty
-				if (nodeIt->second.namedVariablesReceptionCounter < nodeIt->second.namedVariables.size())
-				{
-					nodeIt->second.namedVariables[nodeIt->second.namedVariablesReceptionCounter++] = *description;
-					checkIfNodeDescriptionComplete(nodeIt->first, nodeIt->second);
-				}
-			}
-		}
-
-		// if we have a local event description
-		{
-			const auto *description = dynamic_cast<const LocalEventDescription *>(message);
-			if (description)
-			{
-				auto nodeIt = nodes.find(description->source);
-				assert (nodeIt != nodes.end());
-
-				// copy description into array if array is empty
-				if (nodeIt->second.localEventsReceptionCounter < nodeIt->second.localEvents.size())
-				{
-					nodeIt->second.localEvents[nodeIt->second.localEventsReceptionCounter++] = *description;
-					checkIfNodeDescriptionComplete(nodeIt->first, nodeIt->second);
-				}
-			}
-		}
-
-		// if we have a native function description
-		{
-			const auto *description = dynamic_cast<const NativeFunctionDescription *>(message);
-			if (description)
-			{
-				auto nodeIt = nodes.find(description->source);
-				assert (nodeIt != nodes.end());
-
-				// copy description into array
-				if (nodeIt->second.nativeFunctionReceptionCounter < nodeIt->second.nativeFunctions.size())
-				{
-					nodeIt->second.nativeFunctions[nodeIt->second.nativeFunctionReceptionCounter++] = *description;
-					checkIfNodeDescriptionComplete(nodeIt->first, nodeIt->second);
-				}
-			}
-		}
+		// handle messages that describe or disconnect nodes
+		MessageHandler handler(*this);
+		message->accept(handler);
 	}
 
 	void NodesManager::checkIfNodeDescriptionComplete(unsigned id, const Node& description)
@@ -79,6 +79,8 @@ namespace Aseba
 		void reset();
 
 	protected:
+		class MessageHandler;
+
 		//! Check if a node description has been fully received, and if so, call the nodeDescriptionReceived() virtual function
 		void checkIfNodeDescriptionComplete(unsigned id, const Node& description);
 
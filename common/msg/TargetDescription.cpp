@@ -51,6 +51,44 @@ namespace Aseba
 		return crc;
 	}
 
+	//! Compare all data members
+	bool operator ==(const TargetDescription::NamedVariable &lhs, const TargetDescription::NamedVariable &rhs)
+	{
+		return lhs.size == rhs.size && lhs.name == rhs.name;
+	}
+
+	//! Compare all data members
+	bool operator ==(const TargetDescription::LocalEvent &lhs, const TargetDescription::LocalEvent &rhs)
+	{
+		return lhs.name == rhs.name && lhs.description == rhs.description;
+	}
+
+	//! Compare all data members
+	bool operator ==(const TargetDescription::NativeFunctionParameter &lhs, const TargetDescription::NativeFunctionParameter &rhs)
+	{
+		return lhs.size == rhs.size && lhs.name == rhs.name;
+	}
+
+	//! Compare all data members
+	bool operator ==(const TargetDescription::NativeFunction &lhs, const TargetDescription::NativeFunction &rhs)
+	{
+		return lhs.name == rhs.name && lhs.description == rhs.description && lhs.parameters == rhs.parameters;
+	}
+
+	//! Return whether that describes exactly the same target
+	bool TargetDescription::operator==(const TargetDescription& that) const
+	{
+		return
+			name == that.name &&
+			protocolVersion == that.protocolVersion &&
+			bytecodeSize == that.bytecodeSize &&
+			variablesSize == that.variablesSize &&
+			stackSize == that.stackSize &&
+			namedVariables == that.namedVariables &&
+			localEvents == that.localEvents &&
+			nativeFunctions == that.nativeFunctions;
+	}
+
 	//! Get a VariablesMap out of namedVariables, overwrite freeVariableIndex
 	VariablesMap TargetDescription::getVariablesMap(unsigned& freeVariableIndex) const
 	{
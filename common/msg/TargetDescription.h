@@ -22,6 +22,7 @@
 #define ASEBA_TARGET_DESCRIPTION
 
 #include <map>
+#include <unordered_map>
 #include <string>
 #include <vector>
 
@@ -31,10 +32,10 @@ namespace Aseba
 	/*@{*/
 
 	//! Lookup table for variables name => (pos, size))
-	using VariablesMap = std::map<std::wstring, std::pair<unsigned, unsigned> >;
+	using VariablesMap = std::unordered_map<std::wstring, std::pair<unsigned, unsigned> >;
 
 	//! Lookup table for functions (name => id in target description)
-	using FunctionsMap = std::map<std::wstring, unsigned>;
+	using FunctionsMap = std::unordered_map<std::wstring, unsigned>;
 
 	//! Description of target VM
 	struct TargetDescription
@@ -87,10 +88,18 @@ namespace Aseba
 
 		TargetDescription()  = default;
 		uint16_t crc() const;
+		bool operator==(const TargetDescription& that) const;
+		bool operator!=(const TargetDescription& that) const { return !(*this == that); }
 		VariablesMap getVariablesMap(unsigned& freeVariableIndex) const;
 		FunctionsMap getFunctionsMap() const;
 	};
 
+	// comparison operators for inner classes of the target description
+	bool operator ==(const TargetDescription::NamedVariable &lhs, const TargetDescription::NamedVariable &rhs);
+	bool operator ==(const TargetDescription::LocalEvent &lhs, const TargetDescription::LocalEvent &rhs);
+	bool operator ==(const TargetDescription::NativeFunctionParameter &lhs, const TargetDescription::NativeFunctionParameter &rhs);
+	bool operator ==(const TargetDescription::NativeFunction &lhs, const TargetDescription::NativeFunction &rhs);
+
 	/*@}*/
 } // namespace Aseba
 
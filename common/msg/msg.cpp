@@ -24,9 +24,10 @@
 #include <typeinfo>
 #include <iostream>
 #include <iomanip>
-#include <map>
 #include <iterator>
 #include <utility>
+#include <type_traits>
+#include <cassert>
 #include <dashel/dashel.h>
 
 using namespace std;
@@ -35,18 +36,22 @@ namespace Aseba
 {
 	using namespace Dashel;
 
-	//! Static class that fills a table of known messages types in its constructor
+	//! Table of known messages types, built at compile time.
+	//! System messages types sit in a few dense blocks (0x8000, 0x9000 and 0xA000),
+	//! so the table has one slot per type of these blocks and a lookup is two array accesses.
 	class MessageTypesInitializer
 	{
 	public:
 		//! Constructor, register all known messages types
-		MessageTypesInitializer()
+		constexpr MessageTypesInitializer():
+			entries{}
 		{
 			registerMessageType<BootloaderDescription>(ASEBA_MESSAGE_BOOTLOADER_DESCRIPTION);
 			registerMessageType<BootloaderDataRead>(ASEBA_MESSAGE_BOOTLOADER_PAGE_DATA_READ);
 			registerMessageType<BootloaderAck>(ASEBA_MESSAGE_BOOTLOADER_ACK);
 
 			registerMessageType<ListNodes>(ASEBA_MESSAGE_LIST_NODES);
+			registerMessageType<SwitchSubscribe>(ASEBA_MESSAGE_SWITCH_SUBSCRIBE);
 
 			registerMessageType<NodePresent>(ASEBA_MESSAGE_NODE_PRESENT);
 
@@ -89,34 +94,70 @@ namespace Aseba
 		}
 
 		//! Register a message type by storing a pointer to its constructor
+		//! A type outside of the blocks does not compile, as the table would be indexed out of its bounds
 		template<typename Sub>
-		void registerMessageType(uint16_t type)
+		constexpr void registerMessageType(uint16_t type)
 		{
-			messagesTypes[type] = &Creator<Sub>;
+			Entry& entry(entries[(type >> 12) - firstBlock][type & 0xfff]);
+			entry.creator = &Creator<Sub>;
+			entry.isCommand = is_base_of<CmdMessage, Sub>::value;
 		}
 
 		//! Create an instance of a registered message type
-		Message *createMessage(uint16_t type)
+		Message *createMessage(uint16_t type) const
 		{
-			if (messagesTypes.find(type) == messagesTypes.end())
+			const Entry* entry(find(type));
+			if (!entry)
 				return new UserMessage;
 			else
-				return messagesTypes[type]();
+				return entry->creator();
+		}
+
+		//! Return whether a message type is a command, whose payload starts with the destination node
+		bool isCommand(uint16_t type) const
+		{
+			const Entry* entry(find(type));
+			return entry && entry->isCommand;
 		}
 
 		//! Print the list of registered messages types to stream
 		void dumpKnownMessagesTypes(wostream &stream) const
 		{
 			stream << hex << showbase;
-			for (const auto& messageTypeKV: messagesTypes)
-				stream << "\t" << setw(4) << messageTypeKV.first << "\n";
+			for (unsigned block = 0; block < blocksCount; ++block)
+				for (unsigned index = 0; index < blockSize; ++index)
+					if (entries[block][index].creator)
+						stream << "\t" << setw(4) << (((firstBlock + block) << 12) | index) << "\n";
 			stream << dec << noshowbase;
 		}
 
 	protected:
 		//! Pointer to constructor of class Message
 		using CreatorFunc = Message *(*)();
-		map<uint16_t, CreatorFunc> messagesTypes; //!< table of known messages types
+
+		//! Slot of a message type
+		struct Entry
+		{
+			CreatorFunc creator; //!< constructor of the class of this type, nullptr if the type is unknown
+			bool isCommand; //!< whether the class derives from CmdMessage
+		};
+
+		static constexpr unsigned firstBlock = ASEBA_MESSAGE_BOOTLOADER_RESET >> 12; //!< first block of system messages types
+		static constexpr unsigned blocksCount = 3; //!< number of blocks of system messages types
+		static constexpr unsigned blockSize = 32; //!< number of types in each block
+
+		//! Return the slot of a registered type, nullptr if the type is unknown
+		const Entry* find(uint16_t type) const
+		{
+			// types below the first block wrap around to large block numbers
+			const unsigned block((unsigned(type) >> 12) - firstBlock);
+			const unsigned index(type & 0xfff);
+			if (block >= blocksCount || index >= blockSize || !entries[block][index].creator)
+				return nullptr;
+			return &entries[block][index];
+		}
+
+		Entry entries[blocksCount][blockSize]; //!< table of known messages types
 
 		//! Create a new message of type Sub
 		template<typename Sub>
@@ -124,79 +165,114 @@ namespace Aseba
 		{
 			return new Sub();
 		}
-	} messageTypesInitializer; //!< static instance, used only to have its constructor called on startup
+	};
 
-	//
+	//! Table of known messages types, built at compile time so that it is ready before any static constructor uses it
+	static constexpr MessageTypesInitializer messageTypesInitializer;
 
-	//! Compare all data members
-	bool operator ==(const TargetDescription::NamedVariable &lhs, const TargetDescription::NamedVariable &rhs)
+	//! Per-thread free lists of storage for messages, by size class, so that no locking is needed.
+	//! Storage freed by another thread than the one that allocated it joins the lists of the freeing thread.
+	class MessagePool
 	{
-		return lhs.size == rhs.size && lhs.name == rhs.name;
-	}
+	public:
+		static const size_t granularity = 16; //!< difference of size between two classes
+		static const size_t classesCount = 16; //!< number of size classes, larger messages use the global heap
+		static const size_t maxFreeBlocks = 64; //!< maximum number of free blocks kept per size class
 
-	//! Compare all data members
-	bool operator ==(const TargetDescription::LocalEvent &lhs, const TargetDescription::LocalEvent &rhs)
-	{
-		return lhs.name == rhs.name && lhs.description == rhs.description;
-	}
+		~MessagePool()
+		{
+			for (auto block : freeBlocks)
+				while (block)
+				{
+					FreeBlock* next(block->next);
+					::operator delete(block);
+					block = next;
+				}
+			destroyed = true;
+		}
+
+		//! Return storage for size bytes
+		void* allocate(size_t size)
+		{
+			const size_t sizeClass(classOf(size));
+			if (sizeClass >= classesCount || destroyed)
+				return ::operator new(size);
+			FreeBlock* block(freeBlocks[sizeClass]);
+			if (!block)
+				return ::operator new((sizeClass + 1) * granularity);
+			freeBlocks[sizeClass] = block->next;
+			--freeCounts[sizeClass];
+			return block;
+		}
+
+		//! Give back storage of size bytes returned by allocate()
+		void release(void* ptr, size_t size)
+		{
+			const size_t sizeClass(classOf(size));
+			if (sizeClass >= classesCount || destroyed || freeCounts[sizeClass] >= maxFreeBlocks)
+			{
+				::operator delete(ptr);
+				return;
+			}
+			FreeBlock* block(static_cast<FreeBlock*>(ptr));
+			block->next = freeBlocks[sizeClass];
+			freeBlocks[sizeClass] = block;
+			++freeCounts[sizeClass];
+		}
+
+		//! Whether the pool of this thread is gone, messages deleted by later static destructors use the global heap
+		static thread_local bool destroyed;
+
+	protected:
+		//! A free block, linked to the next one of its size class
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		static size_t classOf(size_t size)
+		{
+			return size ? (size - 1) / granularity : 0;
+		}
+
+		array<FreeBlock*, classesCount> freeBlocks = {};
+		array<size_t, classesCount> freeCounts = {};
+	};
 
-	//! Compare all data members
-	bool operator ==(const TargetDescription::NativeFunctionParameter &lhs, const TargetDescription::NativeFunctionParameter &rhs)
+	thread_local bool MessagePool::destroyed = false;
+	static thread_local MessagePool messagePool;
+
+	void* Message::operator new(size_t size)
 	{
-		return lhs.size == rhs.size && lhs.name == rhs.name;
+		return messagePool.allocate(size);
 	}
 
-	//! Compare all data members
-	bool operator ==(const TargetDescription::NativeFunction &lhs, const TargetDescription::NativeFunction &rhs)
+	void Message::operator delete(void* ptr, size_t size)
 	{
-		return lhs.name == rhs.name && lhs.description == rhs.description && lhs.parameters == rhs.parameters;
+		if (ptr)
+			messagePool.release(ptr, size);
 	}
 
 	//
 
+	//
+
 	void Message::serialize(Stream* stream) const
 	{
-		SerializationBuffer buffer;
-		serializeSpecific(buffer);
-		auto len = static_cast<uint16_t>(buffer.rawData.size());
-
-		if (len > ASEBA_MAX_EVENT_ARG_SIZE)
-		{
-			cerr << "Message::serialize() : fatal error: message size exceeds maximum packet size.\n";
-			cerr << "message payload size: " << len << ", maximum packet payload size (excluding type): " << ASEBA_MAX_EVENT_ARG_SIZE << ", message type: " << hex << showbase << type << dec << noshowbase;
-			cerr << endl;
-			terminate();
-		}
-		uint16_t t;
-		swapEndian(len);
-		stream->write(&len, 2);
-		t = swapEndianCopy(source);
-		stream->write(&t, 2);
-		t = swapEndianCopy(type);
-		stream->write(&t, 2);
-		if (buffer.rawData.size())
-			stream->write(&buffer.rawData[0], buffer.rawData.size());
+		// build the frame in storage reused by successive calls from this thread, and write it at once
+		static thread_local RawMessage raw;
+		raw.encode(*this);
+		raw.serialize(stream);
 	}
 
 	Message *Message::receive(Stream* stream)
 	{
-		// read header
-		uint16_t len, source, type;
-		stream->read(&len, 2);
-		swapEndian(len);
-		stream->read(&source, 2);
-		swapEndian(source);
-		stream->read(&type, 2);
-		swapEndian(type);
-
-		// read content
-		SerializationBuffer buffer;
-		buffer.rawData.resize(len);
-		if (len)
-			stream->read(&buffer.rawData[0], len);
+		// the storage of the payload is reused by successive calls from this thread
+		static thread_local RawMessage raw;
+		raw.receive(stream);
 
 		// deserialize message
-		return create(source, type, buffer);
+		return raw.toMessage();
 	}
 
 	Message *Message::create(uint16_t source, uint16_t type, SerializationBuffer& buffer)
@@ -255,12 +331,110 @@ namespace Aseba
 		;
 	}
 
+	//
+
+	//! Read a message from stream, replacing the content of this one
+	void RawMessage::receive(Stream* stream)
+	{
+		// read header at once, keeping the capacity of the previous frame
+		frame.rawData.resize(headerSize);
+		stream->read(&frame.rawData[0], headerSize);
+
+		// read content just after it
+		const uint16_t len(getWord(0));
+		frame.rawData.resize(headerSize + len);
+		if (len)
+			stream->read(&frame.rawData[headerSize], len);
+	}
+
+	//! Serialize message, replacing the content of this one
+	void RawMessage::encode(const Message& message)
+	{
+		frame.rawData.resize(headerSize);
+		message.serializeSpecific(frame);
+		const size_t len(getPayloadSize());
+
+		if (len > ASEBA_MAX_EVENT_ARG_SIZE)
+		{
+			cerr << "Message::serialize() : fatal error: message size exceeds maximum packet size.\n";
+			cerr << "message payload size: " << len << ", maximum packet payload size (excluding type): " << ASEBA_MAX_EVENT_ARG_SIZE << ", message type: " << hex << showbase << message.type << dec << noshowbase;
+			cerr << endl;
+			terminate();
+		}
+		setWord(0, static_cast<uint16_t>(len));
+		setWord(2, message.source);
+		setWord(4, message.type);
+	}
+
+	//! Write this message to stream at once, as it was received or encoded
+	void RawMessage::serialize(Stream* stream) const
+	{
+		stream->write(&frame.rawData[0], frame.rawData.size());
+	}
+
+	//! Deserialize this message, the caller owns the result
+	Message* RawMessage::toMessage()
+	{
+		frame.readPos = headerSize;
+		return Message::create(getSource(), getType(), frame);
+	}
+
+	//! Return the node this message comes from
+	uint16_t RawMessage::getSource() const
+	{
+		return getWord(2);
+	}
+
+	//! Change the node this message comes from, in place
+	void RawMessage::setSource(uint16_t source)
+	{
+		setWord(2, source);
+	}
+
+	//! Return the type of this message
+	uint16_t RawMessage::getType() const
+	{
+		return getWord(4);
+	}
+
+	//! Return whether this message is a command with a destination, as would a CmdMessage
+	bool RawMessage::isCommand() const
+	{
+		return getPayloadSize() >= 2 && messageTypesInitializer.isCommand(getType());
+	}
+
+	//! Return the destination of a command, only valid if isCommand() is true
+	uint16_t RawMessage::getDest() const
+	{
+		assert(isCommand());
+		return getWord(headerSize);
+	}
+
+	//! Change the destination of a command in place, only valid if isCommand() is true
+	void RawMessage::setDest(uint16_t dest)
+	{
+		assert(isCommand());
+		setWord(headerSize, dest);
+	}
+
+	//! Return the word at pos in the frame, words are little endian on the network
+	uint16_t RawMessage::getWord(size_t pos) const
+	{
+		assert(pos + 2 <= frame.rawData.size());
+		return frame.rawData[pos] | (uint16_t(frame.rawData[pos + 1]) << 8);
+	}
+
+	//! Set the word at pos in the frame
+	void RawMessage::setWord(size_t pos, uint16_t value)
+	{
+		assert(pos + 2 <= frame.rawData.size());
+		frame.rawData[pos] = uint8_t(value);
+		frame.rawData[pos + 1] = uint8_t(value >> 8);
+	}
+
 	template<typename T>
 	void Message::SerializationBuffer::add(const T& val)
 	{
-		const size_t pos = rawData.size();
-		rawData.reserve(pos + sizeof(T));
-
 		const T swappedVal(swapEndianCopy(val));
 		const auto *ptr = reinterpret_cast<const uint8_t *>(&swappedVal);
 
@@ -340,14 +514,15 @@ namespace Aseba
 
 	void UserMessage::deserializeSpecific(SerializationBuffer& buffer)
 	{
-		if (buffer.rawData.size() % 2 != 0)
+		const size_t size(buffer.rawData.size() - buffer.readPos);
+		if (size % 2 != 0)
 		{
 			cerr << "UserMessage::deserializeSpecific(SerializationBuffer& buffer) : fatal error: odd size.\n";
-			cerr << "message size: " << buffer.rawData.size() << ", message type: " << type;
+			cerr << "message size: " << size << ", message type: " << type;
 			cerr << endl;
 			terminate();
 		}
-		data.resize(buffer.rawData.size() / 2);
+		data.resize(size / 2);
 
 		for (auto& word: data)
 			word = buffer.get<int16_t>();
@@ -361,6 +536,11 @@ namespace Aseba
 		stream << dec << setfill(wchar_t(' '));
 	}
 
+	void UserMessage::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const UserMessage &lhs, const UserMessage &rhs)
 	{
 		return
@@ -386,6 +566,11 @@ namespace Aseba
 		stream << "dest " << dest << " ";
 	}
 
+	void CmdMessage::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const CmdMessage &lhs, const CmdMessage &rhs)
 	{
 		return
@@ -415,6 +600,11 @@ namespace Aseba
 		stream << pagesCount << " pages of size " << pageSize << " starting at page " << pagesStart;
 	}
 
+	void BootloaderDescription::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BootloaderDescription &lhs, const BootloaderDescription &rhs)
 	{
 		return
@@ -447,6 +637,11 @@ namespace Aseba
 		stream << dec << setfill(wchar_t(' '));
 	}
 
+	void BootloaderDataRead::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BootloaderDataRead &lhs, const BootloaderDataRead &rhs)
 	{
 		return
@@ -484,6 +679,11 @@ namespace Aseba
 		stream << dec << noshowbase;
 	}
 
+	void BootloaderAck::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BootloaderAck &lhs, const BootloaderAck &rhs)
 	{
 		return
@@ -510,6 +710,11 @@ namespace Aseba
 		stream << "protocol version " << version;
 	}
 
+	void ListNodes::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const ListNodes &lhs, const ListNodes &rhs)
 	{
 		return
@@ -520,6 +725,57 @@ namespace Aseba
 
 	//
 
+	void SwitchSubscribe::serializeSpecific(SerializationBuffer& buffer) const
+	{
+		buffer.add(uint16_t(types.size()));
+		for (const auto type: types)
+			buffer.add(type);
+		for (const auto source: sources)
+			buffer.add(source);
+	}
+
+	void SwitchSubscribe::deserializeSpecific(SerializationBuffer& buffer)
+	{
+		// the sources fill the rest of the payload, a count of types larger than it is truncated
+		const size_t typesCount(buffer.get<uint16_t>());
+		types.resize(min(typesCount, (buffer.rawData.size() - buffer.readPos) / 2));
+		for (auto& type: types)
+			type = buffer.get<uint16_t>();
+		sources.resize((buffer.rawData.size() - buffer.readPos) / 2);
+		for (auto& source: sources)
+			source = buffer.get<uint16_t>();
+	}
+
+	void SwitchSubscribe::dumpSpecific(std::wostream &stream) const
+	{
+		stream << "types";
+		if (types.empty())
+			stream << " all";
+		for (const auto type: types)
+			stream << " " << type;
+		stream << ", sources";
+		if (sources.empty())
+			stream << " all";
+		for (const auto source: sources)
+			stream << " " << source;
+	}
+
+	void SwitchSubscribe::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
+	bool operator ==(const SwitchSubscribe &lhs, const SwitchSubscribe &rhs)
+	{
+		return
+			static_cast<const Message&>(lhs) == static_cast<const Message&>(rhs) &&
+			lhs.types == rhs.types &&
+			lhs.sources == rhs.sources
+		;
+	}
+
+	//
+
 	void NodePresent::serializeSpecific(SerializationBuffer& buffer) const
 	{
 		buffer.add(version);
@@ -535,6 +791,11 @@ namespace Aseba
 		stream << "protocol version " << version;
 	}
 
+	void NodePresent::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const NodePresent &lhs, const NodePresent &rhs)
 	{
 		return
@@ -560,6 +821,11 @@ namespace Aseba
 		stream << "protocol version " << version;
 	}
 
+	void GetDescription::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const GetDescription &lhs, const GetDescription &rhs)
 	{
 		return
@@ -591,6 +857,11 @@ namespace Aseba
 		stream << "protocol version " << version;
 	}
 
+	void GetNodeDescription::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const GetNodeDescription &lhs, const GetNodeDescription &rhs)
 	{
 		return
@@ -654,6 +925,11 @@ namespace Aseba
 		// native functions are available separately
 	}
 
+	void Description::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Description &lhs, const Description &rhs)
 	{
 		return
@@ -688,6 +964,11 @@ namespace Aseba
 		stream << name << " of size " << size;
 	}
 
+	void NamedVariableDescription::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const NamedVariableDescription &lhs, const NamedVariableDescription &rhs)
 	{
 		return
@@ -716,6 +997,11 @@ namespace Aseba
 		stream << name << " : " << description;
 	}
 
+	void LocalEventDescription::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const LocalEventDescription &lhs, const LocalEventDescription &rhs)
 	{
 		return
@@ -766,6 +1052,11 @@ namespace Aseba
 		stream << ") : " << description;
 	}
 
+	void NativeFunctionDescription::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const NativeFunctionDescription &lhs, const NativeFunctionDescription &rhs)
 	{
 		return
@@ -778,6 +1069,11 @@ namespace Aseba
 
 	//
 
+	void Disconnected::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Disconnected &lhs, const Disconnected &rhs)
 	{
 		return static_cast<const Message&>(lhs) == static_cast<const Message&>(rhs);
@@ -808,6 +1104,11 @@ namespace Aseba
 		stream << "\n";*/
 	}
 
+	void Variables::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Variables &lhs, const Variables &rhs)
 	{
 		return
@@ -838,6 +1139,11 @@ namespace Aseba
 		stream << "pc " << pc << ", size " << size << ", index " << index ;
 	}
 
+	void ArrayAccessOutOfBounds::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const ArrayAccessOutOfBounds &lhs, const ArrayAccessOutOfBounds &rhs)
 	{
 		return
@@ -865,6 +1171,11 @@ namespace Aseba
 		stream << "pc " << pc;
 	}
 
+	void DivisionByZero::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const DivisionByZero &lhs, const DivisionByZero &rhs)
 	{
 		return
@@ -890,6 +1201,11 @@ namespace Aseba
 		stream << "pc " << pc;
 	}
 
+	void EventExecutionKilled::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const EventExecutionKilled &lhs, const EventExecutionKilled &rhs)
 	{
 		return
@@ -917,6 +1233,11 @@ namespace Aseba
 		stream << "pc " << pc << " " << message;
 	}
 
+	void NodeSpecificError::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const NodeSpecificError &lhs, const NodeSpecificError &rhs)
 	{
 		return
@@ -947,6 +1268,11 @@ namespace Aseba
 		stream << dec << noshowbase;
 	}
 
+	void ExecutionStateChanged::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const ExecutionStateChanged &lhs, const ExecutionStateChanged &rhs)
 	{
 		return
@@ -975,6 +1301,11 @@ namespace Aseba
 		stream << "pc " << pc << ", success " << success;
 	}
 
+	void BreakpointSetResult::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BreakpointSetResult &lhs, const BreakpointSetResult &rhs)
 	{
 		return
@@ -986,6 +1317,11 @@ namespace Aseba
 
 	//
 
+	void BootloaderReset::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BootloaderReset &lhs, const BootloaderReset &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1014,6 +1350,11 @@ namespace Aseba
 		stream << "page " << pageNumber;
 	}
 
+	void BootloaderReadPage::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BootloaderReadPage &lhs, const BootloaderReadPage &rhs)
 	{
 		return
@@ -1045,6 +1386,11 @@ namespace Aseba
 		stream << "page " << pageNumber;
 	}
 
+	void BootloaderWritePage::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BootloaderWritePage &lhs, const BootloaderWritePage &rhs)
 	{
 		return
@@ -1081,6 +1427,11 @@ namespace Aseba
 		stream << dec << setfill(wchar_t(' '));
 	}
 
+	void BootloaderPageDataWrite::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BootloaderPageDataWrite &lhs, const BootloaderPageDataWrite &rhs)
 	{
 		return
@@ -1117,6 +1468,11 @@ namespace Aseba
 		stream << bytecode.size() << " words of bytecode of starting at " << start;
 	}
 
+	void SetBytecode::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const SetBytecode &lhs, const SetBytecode &rhs)
 	{
 		return
@@ -1178,6 +1534,11 @@ namespace Aseba
 
 	//
 
+	void Reset::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Reset &lhs, const Reset &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1185,6 +1546,11 @@ namespace Aseba
 
 	//
 
+	void Run::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Run &lhs, const Run &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1192,6 +1558,11 @@ namespace Aseba
 
 	//
 
+	void Pause::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Pause &lhs, const Pause &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1199,6 +1570,11 @@ namespace Aseba
 
 	//
 
+	void Step::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Step &lhs, const Step &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1206,6 +1582,11 @@ namespace Aseba
 
 	//
 
+	void Stop::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Stop &lhs, const Stop &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1213,6 +1594,11 @@ namespace Aseba
 
 	//
 
+	void GetExecutionState::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const GetExecutionState &lhs, const GetExecutionState &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1241,6 +1627,11 @@ namespace Aseba
 		stream << "pc " << pc;
 	}
 
+	void BreakpointSet::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BreakpointSet &lhs, const BreakpointSet &rhs)
 	{
 		return
@@ -1272,6 +1663,11 @@ namespace Aseba
 		stream << "pc " << pc;
 	}
 
+	void BreakpointClear::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BreakpointClear &lhs, const BreakpointClear &rhs)
 	{
 		return
@@ -1282,6 +1678,11 @@ namespace Aseba
 
 	//
 
+	void BreakpointClearAll::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const BreakpointClearAll &lhs, const BreakpointClearAll &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1319,6 +1720,11 @@ namespace Aseba
 		stream << "start " << start << ", length " << length;
 	}
 
+	void GetVariables::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const GetVariables &lhs, const GetVariables &rhs)
 	{
 		return
@@ -1363,6 +1769,11 @@ namespace Aseba
 		stream << "start " << start << ", variables vector of size " << variables.size();
 	}
 
+	void SetVariables::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const SetVariables &lhs, const SetVariables &rhs)
 	{
 		return
@@ -1374,6 +1785,11 @@ namespace Aseba
 
 	//
 
+	void WriteBytecode::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const WriteBytecode &lhs, const WriteBytecode &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1381,6 +1797,11 @@ namespace Aseba
 
 	//
 
+	void Reboot::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Reboot &lhs, const Reboot &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
@@ -1388,6 +1809,11 @@ namespace Aseba
 
 	//
 
+	void Sleep::accept(MessageVisitor& visitor) const
+	{
+		visitor.visit(*this);
+	}
+
 	bool operator ==(const Sleep &lhs, const Sleep &rhs)
 	{
 		return static_cast<const CmdMessage&>(lhs) == static_cast<const CmdMessage&>(rhs);
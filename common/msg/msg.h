@@ -45,15 +45,11 @@ namespace Aseba
 	*/
 	/*@{*/
 
-	// comparison operators for inner classes of compiler, we need them here because messages use them
-	bool operator ==(const TargetDescription::NamedVariable &lhs, const TargetDescription::NamedVariable &rhs);
-	bool operator ==(const TargetDescription::LocalEvent &lhs, const TargetDescription::LocalEvent &rhs);
-	bool operator ==(const TargetDescription::NativeFunctionParameter &lhs, const TargetDescription::NativeFunctionParameter &rhs);
-	bool operator ==(const TargetDescription::NativeFunction &lhs, const TargetDescription::NativeFunction &rhs);
-
 	//! Vector of data of variables
 	using VariablesDataVector = std::vector<int16_t>;
 
+	class MessageVisitor;
+
 	//! Parent class of any message exchanged over the network
 	class Message
 	{
@@ -86,6 +82,13 @@ namespace Aseba
 
 		virtual ~Message() = default;
 
+		// allocation from per-thread pools, as messages are created and deleted for every packet
+
+		static void* operator new(size_t size);
+		static void* operator new(size_t size, void* where) noexcept { return where; }
+		static void operator delete(void* ptr, size_t size);
+		static void operator delete(void* ptr, void* where) noexcept {}
+
 		// (de-)serialization methods
 
 		void serialize(Dashel::Stream* stream) const;
@@ -99,6 +102,8 @@ namespace Aseba
 		virtual void serializeSpecific(SerializationBuffer& buffer) const = 0;
 		virtual void deserializeSpecific(SerializationBuffer& buffer) = 0;
 		virtual void dumpSpecific(std::wostream &stream) const = 0;
+		//! Call the handler of visitor for the class of this message, a single virtual call
+		virtual void accept(MessageVisitor& visitor) const = 0;
 
 	protected:
 		virtual operator const char * () const { return "message super class"; }
@@ -106,6 +111,34 @@ namespace Aseba
 
 	bool operator ==(const Message &lhs, const Message &rhs);
 
+	//! A message in the form it has on the network, a frame holding its header and its serialized payload.
+	//! It can be forwarded without being deserialized and written to many streams once serialized,
+	//! and successive calls to receive() or encode() reuse the storage of the frame.
+	struct RawMessage
+	{
+		static const size_t headerSize = 6; //!< size of the header: payload length, source and type
+
+		Message::SerializationBuffer frame; //!< header and payload, as on the network
+
+		void receive(Dashel::Stream* stream);
+		void encode(const Message& message);
+		void serialize(Dashel::Stream* stream) const;
+		Message* toMessage();
+
+		uint16_t getSource() const;
+		void setSource(uint16_t source);
+		uint16_t getType() const;
+		size_t getPayloadSize() const { return frame.rawData.size() - headerSize; }
+
+		bool isCommand() const;
+		uint16_t getDest() const;
+		void setDest(uint16_t dest);
+
+	protected:
+		uint16_t getWord(size_t pos) const;
+		void setWord(size_t pos, uint16_t value);
+	};
+
 	//! Any message sent by a script on a node
 	class UserMessage : public Message
 	{
@@ -116,6 +149,7 @@ namespace Aseba
 		UserMessage() : Message(ASEBA_MESSAGE_INVALID) { }
 		UserMessage(uint16_t type, VariablesDataVector data = VariablesDataVector()) : Message(type), data(std::move(data)) { }
 		UserMessage(uint16_t type, const int16_t* data, const size_t length);
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -135,6 +169,9 @@ namespace Aseba
 	protected:
 		CmdMessage(uint16_t type, uint16_t dest) : Message(type), dest(dest) { }
 
+	public:
+		void accept(MessageVisitor& visitor) const override;
+
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
 		void deserializeSpecific(SerializationBuffer& buffer) override;
@@ -154,6 +191,7 @@ namespace Aseba
 
 	public:
 		BootloaderDescription() : Message(ASEBA_MESSAGE_BOOTLOADER_DESCRIPTION) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -172,6 +210,7 @@ namespace Aseba
 
 	public:
 		BootloaderDataRead() : Message(ASEBA_MESSAGE_BOOTLOADER_PAGE_DATA_READ) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -200,6 +239,7 @@ namespace Aseba
 
 	public:
 		BootloaderAck() : Message(ASEBA_MESSAGE_BOOTLOADER_ACK) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -218,6 +258,7 @@ namespace Aseba
 
 	public:
 		ListNodes() : Message(ASEBA_MESSAGE_LIST_NODES) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -228,6 +269,26 @@ namespace Aseba
 
 	bool operator ==(const ListNodes &lhs, const ListNodes &rhs);
 
+	//! Ask the switch a client is connected to for only sending it the messages of some types or from some nodes
+	class SwitchSubscribe : public Message
+	{
+	public:
+		std::vector<uint16_t> types; //!< types of messages to receive, including user events, all if empty
+		std::vector<uint16_t> sources; //!< nodes to receive messages from, all if empty
+
+	public:
+		SwitchSubscribe() : Message(ASEBA_MESSAGE_SWITCH_SUBSCRIBE) { }
+		void accept(MessageVisitor& visitor) const override;
+
+	protected:
+		void serializeSpecific(SerializationBuffer& buffer) const override;
+		void deserializeSpecific(SerializationBuffer& buffer) override;
+		void dumpSpecific(std::wostream &stream) const override;
+		operator const char * () const override { return "switch subscribe"; }
+	};
+
+	bool operator ==(const SwitchSubscribe &lhs, const SwitchSubscribe &rhs);
+
 	//! Answer of a node notifying its presence
 	class NodePresent : public Message
 	{
@@ -236,6 +297,7 @@ namespace Aseba
 
 	public:
 		NodePresent() : Message(ASEBA_MESSAGE_NODE_PRESENT) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -254,6 +316,7 @@ namespace Aseba
 
 	public:
 		GetDescription() : Message(ASEBA_MESSAGE_GET_DESCRIPTION) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -272,6 +335,7 @@ namespace Aseba
 
 	public:
 		GetNodeDescription(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_GET_NODE_DESCRIPTION, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -287,6 +351,7 @@ namespace Aseba
 	{
 	public:
 		Description() : Message(ASEBA_MESSAGE_DESCRIPTION) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -302,6 +367,7 @@ namespace Aseba
 	{
 	public:
 		NamedVariableDescription() : Message(ASEBA_MESSAGE_NAMED_VARIABLE_DESCRIPTION) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -317,6 +383,7 @@ namespace Aseba
 	{
 	public:
 		LocalEventDescription() : Message(ASEBA_MESSAGE_LOCAL_EVENT_DESCRIPTION) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -332,6 +399,7 @@ namespace Aseba
 	{
 	public:
 		NativeFunctionDescription() : Message(ASEBA_MESSAGE_NATIVE_FUNCTION_DESCRIPTION) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -347,6 +415,7 @@ namespace Aseba
 	{
 	public:
 		Disconnected() : Message(ASEBA_MESSAGE_DISCONNECTED) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override {}
@@ -366,6 +435,7 @@ namespace Aseba
 
 	public:
 		Variables() : Message(ASEBA_MESSAGE_VARIABLES) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -386,6 +456,7 @@ namespace Aseba
 
 	public:
 		ArrayAccessOutOfBounds() : Message(ASEBA_MESSAGE_ARRAY_ACCESS_OUT_OF_BOUNDS) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -404,6 +475,7 @@ namespace Aseba
 
 	public:
 		DivisionByZero() : Message(ASEBA_MESSAGE_DIVISION_BY_ZERO) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -422,6 +494,7 @@ namespace Aseba
 
 	public:
 		EventExecutionKilled() : Message(ASEBA_MESSAGE_EVENT_EXECUTION_KILLED) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -441,6 +514,7 @@ namespace Aseba
 
 	public:
 		NodeSpecificError() : Message(ASEBA_MESSAGE_NODE_SPECIFIC_ERROR) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -460,6 +534,7 @@ namespace Aseba
 
 	public:
 		ExecutionStateChanged() : Message(ASEBA_MESSAGE_EXECUTION_STATE_CHANGED) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -479,6 +554,7 @@ namespace Aseba
 
 	public:
 		BreakpointSetResult() : Message(ASEBA_MESSAGE_BREAKPOINT_SET_RESULT) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -494,6 +570,7 @@ namespace Aseba
 	{
 	public:
 		BootloaderReset(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_BOOTLOADER_RESET, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "bootloader reset"; }
@@ -509,6 +586,7 @@ namespace Aseba
 
 	public:
 		BootloaderReadPage(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_BOOTLOADER_READ_PAGE, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -527,6 +605,7 @@ namespace Aseba
 
 	public:
 		BootloaderWritePage(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_BOOTLOADER_WRITE_PAGE, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -545,6 +624,7 @@ namespace Aseba
 
 	public:
 		BootloaderPageDataWrite(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_BOOTLOADER_PAGE_DATA_WRITE, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -565,6 +645,7 @@ namespace Aseba
 	public:
 		SetBytecode() : CmdMessage(ASEBA_MESSAGE_SET_BYTECODE, ASEBA_DEST_INVALID) { }
 		SetBytecode(uint16_t dest, uint16_t start) : CmdMessage(ASEBA_MESSAGE_SET_BYTECODE, dest), start(start) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -585,6 +666,7 @@ namespace Aseba
 	{
 	public:
 		Reset(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_RESET, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "reset"; }
@@ -597,6 +679,7 @@ namespace Aseba
 	{
 	public:
 		Run(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_RUN, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "run"; }
@@ -609,6 +692,7 @@ namespace Aseba
 	{
 	public:
 		Pause(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_PAUSE, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "pause"; }
@@ -621,6 +705,7 @@ namespace Aseba
 	{
 	public:
 		Step(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_STEP, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "step"; }
@@ -633,6 +718,7 @@ namespace Aseba
 	{
 	public:
 		Stop(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_STOP, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "stop"; }
@@ -645,6 +731,7 @@ namespace Aseba
 	{
 	public:
 		GetExecutionState(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_GET_EXECUTION_STATE, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "get execution state"; }
@@ -661,6 +748,7 @@ namespace Aseba
 	public:
 		BreakpointSet() : CmdMessage(ASEBA_MESSAGE_BREAKPOINT_SET, ASEBA_DEST_INVALID) { }
 		BreakpointSet(uint16_t dest, uint16_t pc) : CmdMessage(ASEBA_MESSAGE_BREAKPOINT_SET, dest), pc(pc) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -680,6 +768,7 @@ namespace Aseba
 	public:
 		BreakpointClear() : CmdMessage(ASEBA_MESSAGE_BREAKPOINT_CLEAR, ASEBA_DEST_INVALID) { }
 		BreakpointClear(uint16_t dest, uint16_t pc) : CmdMessage(ASEBA_MESSAGE_BREAKPOINT_CLEAR, dest), pc(pc) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -695,6 +784,7 @@ namespace Aseba
 	{
 	public:
 		BreakpointClearAll(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_BREAKPOINT_CLEAR_ALL, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "breakpoint clear all"; }
@@ -712,6 +802,7 @@ namespace Aseba
 	public:
 		GetVariables() : CmdMessage(ASEBA_MESSAGE_GET_VARIABLES, ASEBA_DEST_INVALID) { }
 		GetVariables(uint16_t dest, uint16_t start, uint16_t length);
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -732,6 +823,7 @@ namespace Aseba
 	public:
 		SetVariables() : CmdMessage(ASEBA_MESSAGE_SET_VARIABLES, ASEBA_DEST_INVALID) { }
 		SetVariables(uint16_t dest, uint16_t start, VariablesDataVector variables);
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		void serializeSpecific(SerializationBuffer& buffer) const override;
@@ -747,6 +839,7 @@ namespace Aseba
 	{
 	public:
 		WriteBytecode(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_WRITE_BYTECODE, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "save bytecode"; }
@@ -759,6 +852,7 @@ namespace Aseba
 	{
 	public:
 		Reboot(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_REBOOT, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "reboot"; }
@@ -773,6 +867,7 @@ namespace Aseba
 	{
 	public:
 		Sleep(uint16_t dest = ASEBA_DEST_INVALID) : CmdMessage(ASEBA_MESSAGE_SUSPEND_TO_RAM, dest) { }
+		void accept(MessageVisitor& visitor) const override;
 
 	protected:
 		operator const char * () const override { return "sleep"; }
@@ -780,6 +875,80 @@ namespace Aseba
 
 	bool operator ==(const Sleep &lhs, const Sleep &rhs);
 
+	//! Handlers of messages by class, called by Message::accept().
+	//! By default, the handler of a class calls the one of its parent class, so a visitor
+	//! can handle all commands at once through CmdMessage, or anything through Message.
+	class MessageVisitor
+	{
+	public:
+		virtual ~MessageVisitor() = default;
+
+		virtual void visit(const Message& message) {}
+		virtual void visit(const UserMessage& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const CmdMessage& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const BootloaderDescription& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const BootloaderDataRead& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const BootloaderAck& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const ListNodes& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const SwitchSubscribe& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const NodePresent& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const GetDescription& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const GetNodeDescription& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const Description& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const NamedVariableDescription& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const LocalEventDescription& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const NativeFunctionDescription& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const Disconnected& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const Variables& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const ArrayAccessOutOfBounds& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const DivisionByZero& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const EventExecutionKilled& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const NodeSpecificError& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const ExecutionStateChanged& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const BreakpointSetResult& message) { visit(static_cast<const Message&>(message)); }
+		virtual void visit(const BootloaderReset& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const BootloaderReadPage& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const BootloaderWritePage& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const BootloaderPageDataWrite& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const SetBytecode& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const Reset& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const Run& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const Pause& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const Step& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const Stop& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const GetExecutionState& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const BreakpointSet& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const BreakpointClear& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const BreakpointClearAll& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const GetVariables& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const SetVariables& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const WriteBytecode& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const Reboot& message) { visit(static_cast<const CmdMessage&>(message)); }
+		virtual void visit(const Sleep& message) { visit(static_cast<const CmdMessage&>(message)); }
+	};
+
+	//! Return message as a Sub if it is of class Sub or of a class deriving from it, nullptr otherwise.
+	//! This is equivalent to dynamic_cast, but costs a single virtual call.
+	template<typename Sub>
+	const Sub* messageCast(const Message* message)
+	{
+		struct Caster: MessageVisitor
+		{
+			const Sub* result = nullptr;
+			using MessageVisitor::visit;
+			void visit(const Sub& message) override { result = &message; }
+		} caster;
+		message->accept(caster);
+		return caster.result;
+	}
+
+	//! Return message as a Sub if it is of class Sub or of a class deriving from it, nullptr otherwise
+	template<typename Sub>
+	Sub* messageCast(Message* message)
+	{
+		return const_cast<Sub*>(messageCast<Sub>(static_cast<const Message*>(message)));
+	}
+
 	/*@}*/
 } // namespace Aseba
 
@@ -77,7 +77,7 @@ namespace Aseba
 			unique_ptr<Message> message(Message::receive(stream));
 
 			// handle ack
-			BootloaderAck *ackMessage = dynamic_cast<BootloaderAck *>(message.get());
+			BootloaderAck *ackMessage = messageCast<BootloaderAck>(message.get());
 			if (ackMessage && (ackMessage->source == dest))
 			{
 				if (ackMessage->errorCode == BootloaderAck::ErrorCode::SUCCESS)
@@ -91,7 +91,7 @@ namespace Aseba
 			}
 
 			// handle data
-			BootloaderDataRead *dataMessage = dynamic_cast<BootloaderDataRead *>(message.get());
+			BootloaderDataRead *dataMessage = messageCast<BootloaderDataRead>(message.get());
 			if (dataMessage && (dataMessage->source == dest))
 			{
 				if (dataRead >= pageSize)
@@ -144,7 +144,7 @@ namespace Aseba
 				unique_ptr<Message> message(Message::receive(stream));
 
 				// handle ack
-				BootloaderAck *ackMessage = dynamic_cast<BootloaderAck *>(message.get());
+				BootloaderAck *ackMessage = messageCast<BootloaderAck>(message.get());
 				if (ackMessage && (ackMessage->source == bootloaderDest))
 				{
 					if (ackMessage->errorCode == BootloaderAck::ErrorCode::SUCCESS)
@@ -170,7 +170,7 @@ namespace Aseba
 					unique_ptr<Message> message(Message::receive(stream));
 
 					// handle ack
-					BootloaderAck *ackMessage = dynamic_cast<BootloaderAck *>(message);
+					BootloaderAck *ackMessage = messageCast<BootloaderAck>(message);
 					if (ackMessage && (ackMessage->source == dest))
 					{
 						if (ackMessage->errorCode == BootloaderAck::ErrorCode::SUCCESS)
@@ -193,7 +193,7 @@ namespace Aseba
 			unique_ptr<Message> message(Message::receive(stream));
 
 			// handle ack
-			BootloaderAck *ackMessage = dynamic_cast<BootloaderAck *>(message.get());
+			BootloaderAck *ackMessage = messageCast<BootloaderAck>(message.get());
 			if (ackMessage && (ackMessage->source == bootloaderDest))
 			{
 				if (ackMessage->errorCode == BootloaderAck::ErrorCode::SUCCESS)
@@ -240,7 +240,7 @@ namespace Aseba
 			while (true)
 			{
 				unique_ptr<Message> message(Message::receive(stream));
-				Disconnected* disconnectedMessage(dynamic_cast<Disconnected*>(message.get()));
+				Disconnected* disconnectedMessage(messageCast<Disconnected>(message.get()));
 				if (disconnectedMessage)
 					break;
 			}*/
@@ -254,7 +254,7 @@ namespace Aseba
 			while (true)
 			{
 				unique_ptr<Message> message(Message::receive(stream));
-				BootloaderDescription *bDescMessage = dynamic_cast<BootloaderDescription *>(message.get());
+				BootloaderDescription *bDescMessage = messageCast<BootloaderDescription>(message.get());
 				if (bDescMessage && (bDescMessage->source == bootloaderDest))
 				{
 					pageSize = bDescMessage->pageSize;
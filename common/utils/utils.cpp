@@ -311,6 +311,37 @@ namespace Aseba
 		return crc_xmodem_update(oldCrc, reinterpret_cast<const uint8_t*>(&v), 2);
 	}
 
+	//! Write a 16-bit value in little endian
+	static void write16(std::ostream& stream, uint16_t value)
+	{
+		stream.put(char(value & 0xff));
+		stream.put(char(value >> 8));
+	}
+
+	bool writeBinaryObject(std::ostream& stream, uint16_t protocolVersion, uint16_t productId, uint16_t firmwareVersion, uint16_t nodeId, const std::wstring& nodeName, uint16_t descriptionCrc, const std::vector<uint16_t>& bytecode)
+	{
+		// header
+		stream.write("ABO", 4);
+		write16(stream, 0); // binary format version
+		write16(stream, protocolVersion);
+		write16(stream, productId);
+		write16(stream, firmwareVersion);
+		write16(stream, nodeId);
+		write16(stream, crcXModem(0, nodeName));
+		write16(stream, descriptionCrc);
+
+		// bytecode
+		write16(stream, bytecode.size());
+		uint16_t crc(0);
+		for (const uint16_t word : bytecode)
+		{
+			write16(stream, word);
+			crc = crcXModem(crc, word);
+		}
+		write16(stream, crc);
+		return stream.good();
+	}
+
 	template<typename T>
 	std::vector<T> split(const T& s, const T& delim)
 	{
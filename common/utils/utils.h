@@ -184,6 +184,10 @@ namespace Aseba
 	//! Update the XModem CRC (x^16 + x^12 + x^5 + 1 (0x1021)) with a uint16_t value
 	uint16_t crcXModem(const uint16_t oldCrc, const uint16_t v);
 
+	//! Write linked bytecode as an Aseba Binary Object (see AS001 at https://aseba.wikidot.com/asebaspecifications),
+	//! return whether stream is still good
+	bool writeBinaryObject(std::ostream& stream, uint16_t protocolVersion, uint16_t productId, uint16_t firmwareVersion, uint16_t nodeId, const std::wstring& nodeName, uint16_t descriptionCrc, const std::vector<uint16_t>& bytecode);
+
 	//! Split a string using given delimiters
 	template<typename T>
 	std::vector<T> split(const T& s, const T& delim);
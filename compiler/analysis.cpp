@@ -22,107 +22,438 @@
 #include "../common/consts.h"
 #include <cassert>
 #include <iostream>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace Aseba
 {
 	/** \addtogroup compiler */
 	/*@{*/
 
-	//! Verify that no call path can create a stack overflow
-	bool Compiler::verifyStackCalls(PreLinkBytecode& preLinkBytecode)
+	namespace
 	{
-		// check stack for events
-		for (auto it = preLinkBytecode.events.begin(); it != preLinkBytecode.events.end(); ++it)
+		//! Add two instructions counts, saturating at UNBOUNDED_INSTRUCTIONS
+		InstructionsCount addInstructions(InstructionsCount a, InstructionsCount b)
 		{
-			if (it->second.maxStackDepth > targetDescription->stackSize)
+			return a > UNBOUNDED_INSTRUCTIONS - b ? UNBOUNDED_INSTRUCTIONS : a + b;
+		}
+
+		//! Multiply an instructions count, saturating at UNBOUNDED_INSTRUCTIONS
+		InstructionsCount multiplyInstructions(InstructionsCount a, InstructionsCount b)
+		{
+			return b != 0 && a > UNBOUNDED_INSTRUCTIONS / b ? UNBOUNDED_INSTRUCTIONS : a * b;
+		}
+
+		//! Variables some code might write to, directly or through the subroutines it calls
+		struct Writes
+		{
+			std::set<unsigned> addresses; //!< variables stored to or passed to native functions
+			std::vector<std::pair<unsigned, unsigned>> arrays; //!< address and size of arrays written at a dynamic index
+
+			//! Return whether address might be written to
+			bool covers(unsigned address) const
+			{
+				if (addresses.find(address) != addresses.end())
+					return true;
+				for (const auto& array : arrays)
+					if (address >= array.first && address < array.first + array.second)
+						return true;
 				return false;
+			}
+
+			void merge(const Writes& other)
+			{
+				addresses.insert(other.addresses.begin(), other.addresses.end());
+				arrays.insert(arrays.end(), other.arrays.begin(), other.arrays.end());
+			}
+		};
+		typedef std::map<unsigned, Writes> SubroutinesWrites;
+
+		//! Upper bound of the instructions executed by the bytecode of an event or of a subroutine.
+		//! Code generation only produces structured control flow, in which the only backward jumps
+		//! close loops. As the peephole optimizer threads jumps into the branches leading to them,
+		//! backward conditional branches close loops as well. The bound is thus the longest path through
+		//! the code, in which each loop counts as the longest path through its body times its number of
+		//! iterations, plus the final test.
+		class InstructionsBound
+		{
+		public:
+			InstructionsBound(const PreLinkBytecode& preLinkBytecode, const BytecodeVector& bytecode, const SubroutinesWrites& subroutinesWrites) :
+				preLinkBytecode(preLinkBytecode),
+				subroutinesWrites(subroutinesWrites)
+			{
+				decode(bytecode);
+			}
+
+			//! Return the bound for the whole code, UNBOUNDED_INSTRUCTIONS if some loop is unbounded
+			InstructionsCount compute()
+			{
+				return instructions.empty() ? 0 : pathBound(0, instructions.size());
+			}
+
+			//! Return the variables this code might write to, including in the subroutines it calls
+			Writes writes() const
+			{
+				return rangeWrites(0, int(instructions.size()) - 1);
+			}
+
+			//! Positions of the loops whose number of iterations is unknown
+			std::vector<SourcePos> unboundedLoops;
+
+		protected:
+			//! An instruction with its successors in the code
+			struct Instruction
+			{
+				unsigned short type;
+				unsigned short word0; //!< first word, holding the opcode
+				unsigned short word1; //!< second word for instructions having one
+				unsigned line; //!< line in the source
+				int target{-1}; //!< index of the target of jumps and branches, -1 if none or out of the code
+				int loopEnd{-1}; //!< for the first instruction of a loop, index of the last jump or branch closing it
+			};
 
-			const BytecodeVector& bytecode = it->second;
-			for (size_t pc = 0; pc < bytecode.size();)
+			void decode(const BytecodeVector& bytecode)
 			{
-				switch (bytecode[pc] >> 12)
+				std::vector<int> pcToIndex(bytecode.size(), -1);
+				std::vector<int> pcs;
+				instructions.reserve(bytecode.size());
+				for (size_t pc = 0; pc < bytecode.size();)
+				{
+					const unsigned size(bytecode[pc].getWordSize());
+					Instruction instruction;
+					instruction.word0 = bytecode[pc].bytecode;
+					instruction.word1 = pc + 1 < bytecode.size() ? bytecode[pc + 1].bytecode : 0;
+					instruction.type = instruction.word0 >> 12;
+					instruction.line = bytecode[pc].line;
+					pcToIndex[pc] = instructions.size();
+					pcs.push_back(pc);
+					instructions.push_back(instruction);
+					pc += size;
+				}
+				for (size_t i = 0; i < instructions.size(); ++i)
 				{
-					case ASEBA_BYTECODE_SUB_CALL:
+					Instruction& instruction(instructions[i]);
+					int disp;
+					if (instruction.type == ASEBA_BYTECODE_JUMP)
+						disp = (signed short)(instruction.word0 << 4) >> 4;
+					else if (instruction.type == ASEBA_BYTECODE_CONDITIONAL_BRANCH)
+						disp = (signed short)instruction.word1;
+					else
+						continue;
+					const int targetPc(pcs[i] + disp);
+					if (targetPc < 0 || targetPc >= int(pcToIndex.size()) || pcToIndex[targetPc] < 0)
+						continue;
+					instruction.target = pcToIndex[targetPc];
+					if (instruction.target <= int(i))
 					{
-						unsigned id = bytecode[pc] & 0x0fff;
-						auto destIt = preLinkBytecode.subroutines.find(id);
-						assert(destIt != preLinkBytecode.subroutines.end());
-						destIt->second.callDepth = 1;
-						pc += 1;
+						int& loopEnd(instructions[instruction.target].loopEnd);
+						loopEnd = std::max(loopEnd, int(i));
 					}
-					break;
+				}
+			}
 
-					case ASEBA_BYTECODE_LARGE_IMMEDIATE:
-					case ASEBA_BYTECODE_LOAD_INDIRECT:
-					case ASEBA_BYTECODE_STORE_INDIRECT:
+			//! Call f with the index of every instruction that might follow the one at index
+			template<typename F>
+			void forEachSuccessor(int index, F f) const
+			{
+				const Instruction& instruction(instructions[index]);
+				switch (instruction.type)
+				{
+					case ASEBA_BYTECODE_STOP:
+					case ASEBA_BYTECODE_SUB_RET:
+						break;
+					case ASEBA_BYTECODE_JUMP:
+						f(instruction.target);
+						break;
 					case ASEBA_BYTECODE_CONDITIONAL_BRANCH:
-						pc += 2;
-					break;
+						f(index + 1);
+						f(instruction.target);
+						break;
+					default:
+						f(index + 1);
+						break;
+				}
+			}
 
-					case ASEBA_BYTECODE_EMIT:
-						pc += 3;
-					break;
+			//! Return the number of instructions executed by the instruction at index
+			InstructionsCount cost(int index) const
+			{
+				const Instruction& instruction(instructions[index]);
+				if (instruction.type != ASEBA_BYTECODE_SUB_CALL)
+					return 1;
+				const auto it(preLinkBytecode.subroutines.find(instruction.word0 & 0x0fff));
+				assert(it != preLinkBytecode.subroutines.end());
+				return addInstructions(1, it->second.maxInstructions);
+			}
 
-					default:
-						pc += 1;
-					break;
+			//! Return the longest execution starting at begin until leaving [begin, end)
+			InstructionsCount pathBound(int begin, int end)
+			{
+				std::vector<InstructionsCount> distances(end - begin, 0);
+				std::vector<bool> reached(end - begin, false);
+				reached[0] = true;
+				auto relax = [&](int index, InstructionsCount distance) {
+					if (index <= begin || index >= end)
+						return;
+					reached[index - begin] = true;
+					distances[index - begin] = std::max(distances[index - begin], distance);
+				};
+
+				InstructionsCount bound(0);
+				for (int index = begin; index < end; ++index)
+				{
+					if (!reached[index - begin])
+						continue;
+					const int loopEnd(instructions[index].loopEnd);
+					if (loopEnd >= 0 && loopEnd < end && !(index == begin && loopEnd == end - 1))
+					{
+						// a nested loop, continue after it
+						const InstructionsCount distance(addInstructions(distances[index - begin], loopBound(index, loopEnd)));
+						bound = std::max(bound, distance);
+						for (int inside = index; inside <= loopEnd; ++inside)
+							forEachSuccessor(inside, [&](int successor) {
+								if (successor > loopEnd)
+									relax(successor, distance);
+							});
+						index = loopEnd;
+					}
+					else
+					{
+						const InstructionsCount distance(addInstructions(distances[index - begin], cost(index)));
+						bound = std::max(bound, distance);
+						// backward jumps end an iteration of the enclosing loop
+						forEachSuccessor(index, [&](int successor) {
+							if (successor > index)
+								relax(successor, distance);
+						});
+					}
 				}
+				return bound;
 			}
-		}
 
-		// check stack for subroutines
-		bool wasActivity;
-		do
-		{
-			wasActivity = false;
-			for (auto it = preLinkBytecode.subroutines.begin(); it != preLinkBytecode.subroutines.end(); ++it)
+			//! Return the bound of the loop starting at begin and closed by the jump or branch at last
+			InstructionsCount loopBound(int begin, int last)
 			{
-				unsigned myDepth = it->second.callDepth;
-				if (myDepth + it->second.maxStackDepth > targetDescription->stackSize)
+				const InstructionsCount iteration(pathBound(begin, last + 1));
+				const auto it(preLinkBytecode.loopBounds.find(instructions[begin].line));
+				if (it == preLinkBytecode.loopBounds.end() || it->second.iterations == 0 || modifiesCounter(begin, last, it->second.counterAddr))
 				{
-					return false;
+					unboundedLoops.push_back(it != preLinkBytecode.loopBounds.end() ? it->second.pos : SourcePos());
+					return UNBOUNDED_INSTRUCTIONS;
 				}
+				return multiplyInstructions(iteration, InstructionsCount(it->second.iterations) + 1);
+			}
 
-				const BytecodeVector& bytecode = it->second;
-				for (size_t pc = 0; pc < bytecode.size();)
+			//! Return whether the loop in [begin, last] modifies its counter otherwise than by its final increment
+			bool modifiesCounter(int begin, int last, unsigned counterAddr) const
+			{
+				unsigned stores(0);
+				for (int index = begin; index <= last; ++index)
 				{
-					switch (bytecode[pc] >> 12)
+					const Instruction& instruction(instructions[index]);
+					if (instruction.type == ASEBA_BYTECODE_STORE && (instruction.word0 & 0x0fff) == counterAddr)
+						++stores;
+				}
+				Writes writes(rangeWrites(begin, last, false));
+				return stores > 1 || writes.covers(counterAddr);
+			}
+
+			//! Return the variables written in [begin, last], optionally ignoring direct stores
+			Writes rangeWrites(int begin, int last, bool withStores = true) const
+			{
+				Writes writes;
+				std::set<unsigned> immediates;
+				bool nativeCall(false);
+				for (int index = begin; index <= last; ++index)
+				{
+					const Instruction& instruction(instructions[index]);
+					switch (instruction.type)
 					{
+						case ASEBA_BYTECODE_STORE:
+							if (withStores)
+								writes.addresses.insert(instruction.word0 & 0x0fff);
+							break;
+						case ASEBA_BYTECODE_STORE_INDIRECT:
+							writes.arrays.emplace_back(instruction.word0 & 0x0fff, instruction.word1);
+							break;
+						case ASEBA_BYTECODE_SMALL_IMMEDIATE:
+							immediates.insert(unsigned((signed short)(instruction.word0 << 4) >> 4));
+							break;
+						case ASEBA_BYTECODE_LARGE_IMMEDIATE:
+							immediates.insert(instruction.word1);
+							break;
+						case ASEBA_BYTECODE_NATIVE_CALL:
+							nativeCall = true;
+							break;
 						case ASEBA_BYTECODE_SUB_CALL:
 						{
-							unsigned id = bytecode[pc] & 0x0fff;
-							auto destIt = preLinkBytecode.subroutines.find(id);
-							assert(destIt != preLinkBytecode.subroutines.end());
-							if (myDepth + 1 > destIt->second.callDepth)
-							{
-								wasActivity = true;
-								destIt->second.callDepth = myDepth + 1;
-							}
-							pc += 1;
+							const auto it(subroutinesWrites.find(instruction.word0 & 0x0fff));
+							assert(it != subroutinesWrites.end());
+							writes.merge(it->second);
 						}
 						break;
+						default:
+							break;
+					}
+				}
+				// native functions receive the addresses of their arguments as immediates
+				if (nativeCall)
+					writes.addresses.insert(immediates.begin(), immediates.end());
+				return writes;
+			}
 
-						case ASEBA_BYTECODE_LARGE_IMMEDIATE:
-						case ASEBA_BYTECODE_LOAD_INDIRECT:
-						case ASEBA_BYTECODE_STORE_INDIRECT:
-						case ASEBA_BYTECODE_CONDITIONAL_BRANCH:
-							pc += 2;
-						break;
+			const PreLinkBytecode& preLinkBytecode;
+			const SubroutinesWrites& subroutinesWrites;
+			std::vector<Instruction> instructions;
+		};
+	} // namespace
 
-						case ASEBA_BYTECODE_EMIT:
-							pc += 3;
-						break;
+	//! Verify that no call path can create a stack overflow.
+	//! The call graph recorded during code generation is traversed depth-first once,
+	//! so that the worst-case stack depth of every subroutine, including the subroutines
+	//! it calls, is computed in time linear in the number of calls.
+	//! A recursion is reported with the cycle of subroutines leading to it.
+	void Compiler::verifyStackCalls(PreLinkBytecode& preLinkBytecode)
+	{
+		enum VisitState
+		{
+			UNVISITED = 0,
+			VISITING,
+			VISITED
+		};
+		std::map<unsigned, VisitState> states;
 
-						default:
-							pc += 1;
-						break;
+		// a frame of the depth-first traversal: a subroutine and its next call to follow
+		struct Frame
+		{
+			unsigned id;
+			PreLinkBytecode::SubroutineCalls::const_iterator nextCall;
+		};
+		std::vector<Frame> path;
+
+		const PreLinkBytecode::SubroutineCalls noCalls;
+		auto callsOf = [&](unsigned id) -> const PreLinkBytecode::SubroutineCalls& {
+			const auto it(preLinkBytecode.subroutinesCalls.find(id));
+			return it != preLinkBytecode.subroutinesCalls.end() ? it->second : noCalls;
+		};
+		auto worstDepthOf = [&](unsigned id) -> unsigned {
+			const auto it(preLinkBytecode.subroutines.find(id));
+			assert(it != preLinkBytecode.subroutines.end());
+			return it->second.worstStackDepth;
+		};
+
+		for (auto& subroutine : preLinkBytecode.subroutines)
+		{
+			if (states[subroutine.first] != UNVISITED)
+				continue;
+
+			states[subroutine.first] = VISITING;
+			path.push_back({subroutine.first, callsOf(subroutine.first).begin()});
+			while (!path.empty())
+			{
+				Frame& frame(path.back());
+				if (frame.nextCall != callsOf(frame.id).end())
+				{
+					const unsigned calleeId(frame.nextCall->first);
+					const SourcePos& callPos(frame.nextCall->second);
+					++frame.nextCall;
+
+					VisitState& calleeState(states[calleeId]);
+					if (calleeState == VISITING)
+					{
+						// the callee is on the current path, report the cycle
+						std::wstring cycle;
+						auto it(path.begin());
+						while (it->id != calleeId)
+							++it;
+						for (; it != path.end(); ++it)
+							cycle += subroutineTable[it->id].name + L" -> ";
+						cycle += subroutineTable[calleeId].name;
+						throw TranslatableError(callPos, ERROR_RECURSIVE_SUBROUTINE_CALL).arg(cycle);
+					}
+					else if (calleeState == UNVISITED)
+					{
+						calleeState = VISITING;
+						path.push_back({calleeId, callsOf(calleeId).begin()});
 					}
 				}
+				else
+				{
+					// all callees are done, a call costs one stack word for the return address
+					auto it(preLinkBytecode.subroutines.find(frame.id));
+					assert(it != preLinkBytecode.subroutines.end());
+					unsigned worstStackDepth(it->second.maxStackDepth);
+					for (const auto& call : callsOf(frame.id))
+						worstStackDepth = std::max(worstStackDepth, 1 + worstDepthOf(call.first));
+					it->second.worstStackDepth = worstStackDepth;
+					states[frame.id] = VISITED;
+					path.pop_back();
+				}
 			}
 		}
-		while (wasActivity);
 
-		return true;
+		// events are roots of the call graph
+		for (auto& event : preLinkBytecode.events)
+		{
+			unsigned worstStackDepth(event.second.maxStackDepth);
+			const auto callsIt(preLinkBytecode.eventsCalls.find(event.first));
+			if (callsIt != preLinkBytecode.eventsCalls.end())
+				for (const auto& call : callsIt->second)
+					worstStackDepth = std::max(worstStackDepth, 1 + worstDepthOf(call.first));
+			event.second.worstStackDepth = worstStackDepth;
+			if (worstStackDepth > targetDescription->stackSize)
+				throw TranslatableError(SourcePos(), ERROR_STACK_OVERFLOW);
+		}
+
+		// subroutines not called from any event might still overflow on their own
+		for (const auto& subroutine : preLinkBytecode.subroutines)
+			if (subroutine.second.worstStackDepth > targetDescription->stackSize)
+				throw TranslatableError(SourcePos(), ERROR_STACK_OVERFLOW);
+	}
+
+	//! Compute an upper bound of the number of instructions executed by every event and subroutine,
+	//! and warn about loops without a constant bound and about events over the instructions budget
+	void Compiler::boundInstructions(PreLinkBytecode& preLinkBytecode)
+	{
+		SubroutinesWrites subroutinesWrites;
+		auto warnUnboundedLoops = [&](const InstructionsBound& bound, const std::wstring& name) {
+			for (const auto& pos : bound.unboundedLoops)
+				warnings.push_back(TranslatableError(pos, WARNING_UNBOUNDED_LOOP).arg(name).toError());
+		};
+
+		// subroutines are bounded after the ones they call, recursion has already been rejected
+		std::function<void(unsigned)> boundSubroutine = [&](unsigned id) {
+			if (subroutinesWrites.find(id) != subroutinesWrites.end())
+				return;
+			const auto callsIt(preLinkBytecode.subroutinesCalls.find(id));
+			if (callsIt != preLinkBytecode.subroutinesCalls.end())
+				for (const auto& call : callsIt->second)
+					boundSubroutine(call.first);
+			BytecodeVector& bytecode(preLinkBytecode.subroutines[id]);
+			InstructionsBound bound(preLinkBytecode, bytecode, subroutinesWrites);
+			bytecode.maxInstructions = bound.compute();
+			subroutinesWrites[id] = bound.writes();
+			warnUnboundedLoops(bound, subroutineTable[id].name);
+		};
+		for (const auto& subroutine : preLinkBytecode.subroutines)
+			boundSubroutine(subroutine.first);
+
+		for (auto& event : preLinkBytecode.events)
+		{
+			InstructionsBound bound(preLinkBytecode, event.second, subroutinesWrites);
+			event.second.maxInstructions = bound.compute();
+			warnUnboundedLoops(bound, eventName(event.first));
+			if (instructionsBudget && event.second.maxInstructions != UNBOUNDED_INSTRUCTIONS && event.second.maxInstructions > instructionsBudget)
+				warnings.push_back(TranslatableError(SourcePos(), WARNING_INSTRUCTIONS_BUDGET_EXCEEDED)
+					.arg(eventName(event.first))
+					.arg(std::to_wstring(event.second.maxInstructions))
+					.arg(std::to_wstring(instructionsBudget))
+					.toError());
+		}
 	}
 
 	/*@}*/
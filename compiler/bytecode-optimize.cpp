@@ -0,0 +1,489 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "compiler.h"
+#include "../common/consts.h"
+#include <cassert>
+#include <cstdlib>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <iostream>
+
+namespace Aseba
+{
+	/**
+		\file bytecode-optimize.cpp
+		Peephole optimizations on the bytecode of events and subroutines, applied before linking.
+		\addtogroup compiler
+	*/
+	/*@{*/
+
+	namespace
+	{
+		//! An instruction of a bytecode segment, with its target if it is a jump or a branch
+		struct Instruction
+		{
+			std::vector<BytecodeElement> elements; //!< bytecode elements of this instruction
+			int target{-1}; //!< index of the target instruction for jumps and branches, -1 otherwise
+			bool removed{false}; //!< whether this instruction has been optimized out
+
+			unsigned short type() const { return elements[0].bytecode >> 12; }
+			unsigned short line() const { return elements[0].line; }
+			bool isImmediate() const { return type() == ASEBA_BYTECODE_SMALL_IMMEDIATE || type() == ASEBA_BYTECODE_LARGE_IMMEDIATE; }
+			bool isTerminal() const { return type() == ASEBA_BYTECODE_STOP || type() == ASEBA_BYTECODE_SUB_RET; }
+			int immediateValue() const
+			{
+				if (type() == ASEBA_BYTECODE_SMALL_IMMEDIATE)
+					return (signed short)(elements[0].bytecode << 4) >> 4;
+				else
+					return (signed short)elements[1].bytecode;
+			}
+		};
+
+		//! Return the bytecode elements to push value on the stack, as the code generator would
+		std::vector<BytecodeElement> immediateElements(int value, unsigned short line)
+		{
+			std::vector<BytecodeElement> elements;
+			if ((abs(value) >> 11) == 0)
+			{
+				elements.emplace_back(AsebaBytecodeFromId(ASEBA_BYTECODE_SMALL_IMMEDIATE) | (((unsigned)value) & 0x0fff), line);
+			}
+			else
+			{
+				elements.emplace_back(AsebaBytecodeFromId(ASEBA_BYTECODE_LARGE_IMMEDIATE), line);
+				elements.emplace_back((unsigned short)value, line);
+			}
+			return elements;
+		}
+
+		//! Compute a binary operation the same way as the VM does, return false if it must be left to run time
+		bool foldBinaryOperation(int16_t valueOne, int16_t valueTwo, unsigned op, int16_t& result)
+		{
+			switch (op)
+			{
+				case ASEBA_OP_SHIFT_LEFT:
+				case ASEBA_OP_SHIFT_RIGHT:
+					if (valueTwo < 0 || valueTwo > 15)
+						return false;
+					result = (op == ASEBA_OP_SHIFT_LEFT) ? (int16_t)(valueOne << valueTwo) : (int16_t)(valueOne >> valueTwo);
+					return true;
+				case ASEBA_OP_ADD: result = valueOne + valueTwo; return true;
+				case ASEBA_OP_SUB: result = valueOne - valueTwo; return true;
+				case ASEBA_OP_MULT: result = valueOne * valueTwo; return true;
+				case ASEBA_OP_DIV:
+					// division by zero is reported by the VM at run time
+					if (valueTwo == 0 || (valueOne == -32768 && valueTwo == -1))
+						return false;
+					result = valueOne / valueTwo;
+					return true;
+				case ASEBA_OP_MOD:
+					if (valueTwo == 0 || (valueOne == -32768 && valueTwo == -1))
+						return false;
+					result = valueOne % valueTwo;
+					return true;
+
+				case ASEBA_OP_BIT_OR: result = valueOne | valueTwo; return true;
+				case ASEBA_OP_BIT_XOR: result = valueOne ^ valueTwo; return true;
+				case ASEBA_OP_BIT_AND: result = valueOne & valueTwo; return true;
+
+				case ASEBA_OP_EQUAL: result = valueOne == valueTwo; return true;
+				case ASEBA_OP_NOT_EQUAL: result = valueOne != valueTwo; return true;
+				case ASEBA_OP_BIGGER_THAN: result = valueOne > valueTwo; return true;
+				case ASEBA_OP_BIGGER_EQUAL_THAN: result = valueOne >= valueTwo; return true;
+				case ASEBA_OP_SMALLER_THAN: result = valueOne < valueTwo; return true;
+				case ASEBA_OP_SMALLER_EQUAL_THAN: result = valueOne <= valueTwo; return true;
+
+				case ASEBA_OP_OR: result = valueOne || valueTwo; return true;
+				case ASEBA_OP_AND: result = valueOne && valueTwo; return true;
+
+				default: return false;
+			}
+		}
+
+		//! Peephole optimizer working on the instructions of one segment
+		class PeepholeOptimizer
+		{
+		public:
+			PeepholeOptimizer(BytecodeVector& bytecode, std::wostream* dump) :
+				bytecode(bytecode),
+				dump(dump)
+			{}
+
+			//! Optimize the segment in place, return false and leave it untouched if it cannot be decoded
+			bool run()
+			{
+				if (!decode())
+					return false;
+
+				bool changed;
+				unsigned iterations(0);
+				do
+				{
+					changed = false;
+					changed |= threadJumps();
+					changed |= foldConstants();
+					changed |= removeLoadStorePairs();
+					changed |= removeUselessJumps();
+					changed |= removeUnreachable();
+					++iterations;
+				}
+				while (changed && iterations < 16);
+
+				return encode();
+			}
+
+		protected:
+			//! Split the segment into instructions and resolve branch targets
+			bool decode()
+			{
+				std::map<int, int> pcToIndex;
+				for (size_t pc = 0; pc < bytecode.size();)
+				{
+					const unsigned size(bytecode[pc].getWordSize());
+					if (pc + size > bytecode.size())
+						return false;
+					Instruction instruction;
+					instruction.elements.assign(bytecode.begin() + pc, bytecode.begin() + pc + size);
+					pcToIndex[pc] = instructions.size();
+					instructions.push_back(instruction);
+					pcs.push_back(pc);
+					pc += size;
+				}
+				for (size_t i = 0; i < instructions.size(); ++i)
+				{
+					Instruction& instruction(instructions[i]);
+					int disp;
+					if (instruction.type() == ASEBA_BYTECODE_JUMP)
+						disp = (signed short)(instruction.elements[0].bytecode << 4) >> 4;
+					else if (instruction.type() == ASEBA_BYTECODE_CONDITIONAL_BRANCH)
+						disp = (signed short)instruction.elements[1].bytecode;
+					else
+						continue;
+					// targets outside the segment are left alone
+					auto it(pcToIndex.find(pcs[i] + disp));
+					if (it == pcToIndex.end())
+						return false;
+					instruction.target = it->second;
+				}
+				return true;
+			}
+
+			//! Write back instructions into the segment, return false if a displacement does not fit
+			bool encode()
+			{
+				std::vector<int> newPcs(instructions.size() + 1, 0);
+				int pc(0);
+				for (size_t i = 0; i < instructions.size(); ++i)
+				{
+					newPcs[i] = pc;
+					if (!instructions[i].removed)
+						pc += instructions[i].elements.size();
+				}
+				newPcs[instructions.size()] = pc;
+
+				std::deque<BytecodeElement> elements;
+				for (size_t i = 0; i < instructions.size(); ++i)
+				{
+					Instruction& instruction(instructions[i]);
+					if (instruction.removed)
+						continue;
+					if (instruction.target >= 0)
+					{
+						const int disp(newPcs[resolve(instruction.target)] - newPcs[i]);
+						if (instruction.type() == ASEBA_BYTECODE_JUMP)
+						{
+							if (disp < -2048 || disp > 2047)
+								return false;
+							instruction.elements[0].bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_JUMP) | (((unsigned)disp) & 0x0fff);
+						}
+						else
+							instruction.elements[1].bytecode = (unsigned short)disp;
+					}
+					std::copy(instruction.elements.begin(), instruction.elements.end(), std::back_inserter(elements));
+				}
+
+				const size_t oldSize(bytecode.size());
+				static_cast<std::deque<BytecodeElement>&>(bytecode) = elements;
+				if (dump && oldSize != bytecode.size())
+					*dump << L"  " << oldSize - bytecode.size() << L" words saved\n";
+				return true;
+			}
+
+			//! Return the index of the first instruction which is not removed, starting at index
+			int resolve(int index) const
+			{
+				while (index < (int)instructions.size() && instructions[index].removed)
+					++index;
+				assert(index < (int)instructions.size());
+				return index;
+			}
+
+			//! Return the index of the next instruction which is not removed, or -1
+			int next(int index) const
+			{
+				++index;
+				while (index < (int)instructions.size() && instructions[index].removed)
+					++index;
+				return index < (int)instructions.size() ? index : -1;
+			}
+
+			//! Return whether an instruction is the target of some live jump or branch
+			std::vector<bool> labels() const
+			{
+				std::vector<bool> isLabel(instructions.size(), false);
+				for (const auto& instruction : instructions)
+					if (!instruction.removed && instruction.target >= 0)
+						isLabel[resolve(instruction.target)] = true;
+				return isLabel;
+			}
+
+			//! Retarget jumps and branches to jumps to their final destination
+			bool threadJumps()
+			{
+				bool changed(false);
+				for (size_t i = 0; i < instructions.size(); ++i)
+				{
+					Instruction& instruction(instructions[i]);
+					if (instruction.removed || instruction.target < 0)
+						continue;
+					int target(resolve(instruction.target));
+					// follow unconditional jumps, the bound protects against cycles
+					for (size_t steps = 0; steps < instructions.size() && instructions[target].type() == ASEBA_BYTECODE_JUMP && target != (int)i; ++steps)
+						target = resolve(instructions[target].target);
+					if (target != resolve(instruction.target))
+					{
+						if (dump)
+							*dump << L"  jump chain threaded at line " << instruction.line() + 1 << L"\n";
+						instruction.target = target;
+						changed = true;
+					}
+					// a jump to a stop or a return is the stop or return itself
+					if (instruction.type() == ASEBA_BYTECODE_JUMP && instructions[target].isTerminal())
+					{
+						if (dump)
+							*dump << L"  jump to end replaced by end at line " << instruction.line() + 1 << L"\n";
+						instruction.elements[0].bytecode = instructions[target].elements[0].bytecode;
+						instruction.target = -1;
+						changed = true;
+					}
+				}
+				return changed;
+			}
+
+			//! Merge immediates with the operations consuming them
+			bool foldConstants()
+			{
+				bool changed(false);
+				const std::vector<bool> isLabel(labels());
+				for (int i = 0; i >= 0 && i < (int)instructions.size(); i = next(i))
+				{
+					if (instructions[i].removed || !instructions[i].isImmediate())
+						continue;
+					const int j(next(i));
+					if (j < 0 || isLabel[j])
+						continue;
+					Instruction& second(instructions[j]);
+
+					// unary operation on immediate
+					if (second.type() == ASEBA_BYTECODE_UNARY_ARITHMETIC)
+					{
+						const int16_t value(instructions[i].immediateValue());
+						const unsigned op(second.elements[0].bytecode & ASEBA_UNARY_OPERATOR_MASK);
+						int16_t result;
+						if (op == ASEBA_UNARY_OP_SUB)
+							result = -value;
+						else if (op == ASEBA_UNARY_OP_BIT_NOT)
+							result = ~value;
+						else if (op == ASEBA_UNARY_OP_ABS && value != -32768)
+							result = value < 0 ? -value : value;
+						else
+							continue;
+						if (dump)
+							*dump << L"  unary operation on immediate merged at line " << second.line() + 1 << L"\n";
+						instructions[i].elements = immediateElements(result, second.line());
+						second.removed = true;
+						changed = true;
+						continue;
+					}
+
+					if (!second.isImmediate())
+						continue;
+					const int k(next(j));
+					if (k < 0 || isLabel[k])
+						continue;
+					Instruction& third(instructions[k]);
+					const unsigned op(third.elements[0].bytecode & ASEBA_BINARY_OPERATOR_MASK);
+					int16_t result;
+
+					// binary operation on two immediates
+					if (third.type() == ASEBA_BYTECODE_BINARY_ARITHMETIC)
+					{
+						if (!foldBinaryOperation(instructions[i].immediateValue(), second.immediateValue(), op, result))
+							continue;
+						if (dump)
+							*dump << L"  binary operation on immediates merged at line " << third.line() + 1 << L"\n";
+						instructions[i].elements = immediateElements(result, third.line());
+						second.removed = true;
+						third.removed = true;
+						changed = true;
+					}
+					// branch on two immediates, only if not edge-sensitive as the result then depends on the past
+					else if (third.type() == ASEBA_BYTECODE_CONDITIONAL_BRANCH && !(third.elements[0].bytecode & (1 << ASEBA_IF_IS_WHEN_BIT)))
+					{
+						if (!foldBinaryOperation(instructions[i].immediateValue(), second.immediateValue(), op, result))
+							continue;
+						if (dump)
+							*dump << L"  branch on immediates resolved at line " << third.line() + 1 << L"\n";
+						instructions[i].removed = true;
+						second.removed = true;
+						if (result)
+						{
+							third.removed = true;
+						}
+						else
+						{
+							third.elements.resize(1);
+							third.elements[0].bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_JUMP);
+						}
+						changed = true;
+					}
+				}
+				return changed;
+			}
+
+			//! Remove loading a variable immediately followed by storing it back
+			bool removeLoadStorePairs()
+			{
+				bool changed(false);
+				const std::vector<bool> isLabel(labels());
+				for (int i = 0; i >= 0 && i < (int)instructions.size(); i = next(i))
+				{
+					if (instructions[i].removed || instructions[i].type() != ASEBA_BYTECODE_LOAD)
+						continue;
+					const int j(next(i));
+					if (j < 0 || isLabel[j])
+						continue;
+					if (instructions[j].type() != ASEBA_BYTECODE_STORE)
+						continue;
+					if ((instructions[i].elements[0].bytecode & 0x0fff) != (instructions[j].elements[0].bytecode & 0x0fff))
+						continue;
+					if (dump)
+						*dump << L"  load followed by store to same variable removed at line " << instructions[i].line() + 1 << L"\n";
+					instructions[i].removed = true;
+					instructions[j].removed = true;
+					changed = true;
+				}
+				return changed;
+			}
+
+			//! Remove jumps to the next instruction
+			bool removeUselessJumps()
+			{
+				bool changed(false);
+				for (size_t i = 0; i < instructions.size(); ++i)
+				{
+					Instruction& instruction(instructions[i]);
+					if (instruction.removed || instruction.type() != ASEBA_BYTECODE_JUMP)
+						continue;
+					if (resolve(instruction.target) == next(i))
+					{
+						if (dump)
+							*dump << L"  jump to next instruction removed at line " << instruction.line() + 1 << L"\n";
+						instruction.removed = true;
+						changed = true;
+					}
+				}
+				return changed;
+			}
+
+			//! Remove instructions that cannot be reached from the start of the segment
+			bool removeUnreachable()
+			{
+				std::vector<bool> reached(instructions.size(), false);
+				std::vector<int> toVisit;
+				if (!instructions.empty())
+					toVisit.push_back(resolve(0));
+				while (!toVisit.empty())
+				{
+					const int i(toVisit.back());
+					toVisit.pop_back();
+					if (i < 0 || reached[i])
+						continue;
+					reached[i] = true;
+					const Instruction& instruction(instructions[i]);
+					if (instruction.target >= 0)
+						toVisit.push_back(resolve(instruction.target));
+					if (!instruction.isTerminal() && instruction.type() != ASEBA_BYTECODE_JUMP)
+						toVisit.push_back(next(i));
+				}
+
+				bool changed(false);
+				for (size_t i = 0; i < instructions.size(); ++i)
+				{
+					if (!instructions[i].removed && !reached[i])
+					{
+						if (dump)
+							*dump << L"  unreachable code removed at line " << instructions[i].line() + 1 << L"\n";
+						instructions[i].removed = true;
+						changed = true;
+					}
+				}
+				return changed;
+			}
+
+		protected:
+			BytecodeVector& bytecode; //!< segment being optimized
+			std::wostream* dump; //!< stream to send dump messages to
+			std::vector<Instruction> instructions; //!< decoded instructions
+			std::vector<int> pcs; //!< original address of each instruction in the segment
+		};
+	} // namespace
+
+	//! Apply peephole optimizations to this bytecode segment, which must be a complete event or subroutine
+	void BytecodeVector::peepholeOptimize(std::wostream* dump)
+	{
+		PeepholeOptimizer optimizer(*this, dump);
+		if (!optimizer.run() && dump)
+			*dump << L"  segment left unoptimized\n";
+	}
+
+	//! Apply peephole optimizations to all events and subroutines, must be called after fixup()
+	void PreLinkBytecode::peepholeOptimize(std::wostream* dump)
+	{
+		for (auto& event : events)
+		{
+			if (dump)
+				*dump << L"event " << event.first << L":\n";
+			event.second.peepholeOptimize(dump);
+		}
+		for (auto& subroutine : subroutines)
+		{
+			if (dump)
+				*dump << L"subroutine " << subroutine.first << L":\n";
+			subroutine.second.peepholeOptimize(dump);
+		}
+	}
+
+	/*@}*/
+
+} // namespace Aseba
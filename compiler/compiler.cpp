@@ -33,6 +33,8 @@
 #include <memory>
 #include <limits>
 #include <iterator>
+#include <algorithm>
+#include <chrono>
 
 namespace Aseba
 {
@@ -65,9 +67,17 @@ namespace Aseba
 	{
 		targetDescription = nullptr;
 		commonDefinitions = nullptr;
+		optimizationGoal = OPTIMIZE_FOR_SPEED;
+		instructionsBudget = 0;
 		freeVariableIndex = 0;
 		endVariableIndex = 0;
-		TranslatableError::setTranslateCB(ErrorMessages::defaultCallback);
+		temporaryMemoryPeak = 0;
+		temporaryVariableUid = 0;
+		maxStackDepth = 0;
+		mapsValid = false;
+		targetVariablesSize = 0;
+		cancelled = nullptr;
+		translateCallback = ErrorMessages::defaultCallback;
 	}
 
 	//! Set the description of the target as returned by the microcontroller. You must call this function before any call to compile().
@@ -82,37 +92,159 @@ namespace Aseba
 		commonDefinitions = definitions;
 	}
 
-	//! Compile a new condition
+	//! Return the name of a phase of the compilation
+	const wchar_t* CompilationStatistics::phaseName(Phase phase)
+	{
+		switch (phase)
+		{
+			case PHASE_TOKENIZE: return L"tokenize";
+			case PHASE_PARSE: return L"parse";
+			case PHASE_CHECK_VECTOR_SIZE: return L"vector size check";
+			case PHASE_EXPAND: return L"expand";
+			case PHASE_TYPECHECK: return L"type check";
+			case PHASE_OPTIMIZE: return L"optimize";
+			case PHASE_EMIT: return L"emit";
+			case PHASE_VERIFY: return L"verify";
+			case PHASE_LINK: return L"link";
+			default: return L"unknown";
+		}
+	}
+
+	//! Return the wall time of the whole compilation in microseconds
+	double CompilationStatistics::totalDuration() const
+	{
+		double duration(0);
+		for (const double phaseDuration : phaseDurations)
+			duration += phaseDuration;
+		return duration;
+	}
+
+	//! Return a number of executed instructions as a string, or "unbounded"
+	std::wstring instructionsCountToWString(InstructionsCount count)
+	{
+		return count == UNBOUNDED_INSTRUCTIONS ? std::wstring(L"unbounded") : std::to_wstring(count);
+	}
+
+	//! Return a human-readable description of a number of executed instructions
+	static std::wstring instructionsCountDescription(InstructionsCount count)
+	{
+		return count == UNBOUNDED_INSTRUCTIONS ? std::wstring(L"unbounded instructions") : L"at most " + std::to_wstring(count) + L" instructions";
+	}
+
+	//! Return a human-readable summary of the statistics
+	std::wstring CompilationStatistics::toWString() const
+	{
+		std::wostringstream oss;
+		oss << std::fixed << std::setprecision(0);
+		oss << L"Compiled in " << totalDuration() << L" us:";
+		for (unsigned phase = 0; phase < PHASES_COUNT; ++phase)
+			oss << (phase ? L"," : L"") << L" " << phaseName(Phase(phase)) << L" " << phaseDurations[phase];
+		oss << L"\n";
+		oss << L"Syntax tree of " << nodesBeforeExpansion << L" nodes, " << nodesAfterExpansion << L" once expanded\n";
+		oss << L"Using " << variablesUsed << L" on " << variablesSize << L" words of variable space, " << bytecodeSize << L" words of bytecode\n";
+		for (const auto& event : events)
+			oss << L"onevent " << event.name << L": " << event.words << L" words, stack depth " << event.maxStackDepth << L", " << instructionsCountDescription(event.maxInstructions) << L"\n";
+		for (const auto& subroutine : subroutines)
+			oss << L"sub " << subroutine.name << L": " << subroutine.words << L" words, stack depth " << subroutine.maxStackDepth << L", " << instructionsCountDescription(subroutine.maxInstructions) << L"\n";
+		return oss.str();
+	}
+
+	namespace
+	{
+		//! Install the translation callback of a compiler for the calling thread, restoring the previous one on exit
+		class TranslationScope
+		{
+		public:
+			explicit TranslationScope(ErrorMessages::ErrorCallback callback) :
+				previous(TranslatableError::translateCB)
+			{
+				TranslatableError::setTranslateCB(callback);
+			}
+
+			~TranslationScope()
+			{
+				TranslatableError::setTranslateCB(previous);
+			}
+
+		protected:
+			const ErrorMessages::ErrorCallback previous;
+		};
+
+		//! Measure the wall time of a phase of the compilation, if statistics are requested
+		class PhaseTimer
+		{
+		public:
+			PhaseTimer(CompilationStatistics* statistics, CompilationStatistics::Phase phase) :
+				statistics(statistics),
+				phase(phase),
+				start(std::chrono::steady_clock::now())
+			{}
+
+			~PhaseTimer()
+			{
+				if (statistics)
+					statistics->phaseDurations[phase] += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+			}
+
+		protected:
+			CompilationStatistics* statistics;
+			const CompilationStatistics::Phase phase;
+			const std::chrono::steady_clock::time_point start;
+		};
+
+		//! Return the number of nodes of the tree rooted at node
+		unsigned countNodes(const Node* node)
+		{
+			unsigned count(1);
+			for (const auto child : node->children)
+				if (child)
+					count += countNodes(child);
+			return count;
+		}
+
+		//! Attribute every instruction of linked bytecode, after the event vector table, to its line of source
+		void countLinesCosts(const BytecodeVector& bytecode, CompilationStatistics::LinesCosts& lines)
+		{
+			for (size_t pc = bytecode.empty() ? 0 : bytecode[0].bytecode; pc < bytecode.size();)
+			{
+				const unsigned size(bytecode[pc].getWordSize());
+				CompilationStatistics::LineCost& cost(lines[bytecode[pc].line]);
+				cost.words += size;
+				cost.instructions += 1;
+				pc += size;
+			}
+		}
+	} // namespace
+
+	//! Run the phases of the compilation up to type checking, the ones that report errors in the source
 	//! \param source stream to read the source code from
-	//! \param bytecode destination array for bytecode
-	//! \param allocatedVariablesCount amount of allocated variables
 	//! \param errorDescription error is copied there on error
 	//! \param dump stream to send dump messages to
-	//! \return returns true on success 
-	bool Compiler::compile(std::wistream& source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount, Error &errorDescription, std::wostream* dump)
+	//! \param statistics if not null, filled with the duration of each phase and the size of the tree
+	//! \return the type-checked program, owned by the caller, or nullptr on error
+	Node* Compiler::parseAndTypeCheck(std::wistream& source, Error &errorDescription, std::wostream* dump, CompilationStatistics* statistics)
 	{
-		assert(targetDescription);
-		assert(commonDefinitions);
-
 		unsigned indent = 0;
+		warnings.clear();
 
-		// we need to build maps at each compilation in case previous ones produced errors and messed maps up
+		// we need to reset maps at each compilation in case previous ones produced errors and messed maps up
 		buildMaps();
 		if (freeVariableIndex > targetDescription->variablesSize)
 		{
 			errorDescription = TranslatableError(SourcePos(), ERROR_BROKEN_TARGET).toError();
-			return false;
+			return nullptr;
 		}
 
 		// tokenization
 		try
 		{
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_TOKENIZE);
 			tokenize(source);
 		}
 		catch (TranslatableError error)
 		{
 			errorDescription = error.toError();
-			return false;
+			return nullptr;
 		}
 
 		if (dump)
@@ -126,12 +258,14 @@ namespace Aseba
 		std::unique_ptr<Node> program;
 		try
 		{
+			throwIfCancelled();
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_PARSE);
 			program.reset(parseProgram());
 		}
 		catch (TranslatableError error)
 		{
 			errorDescription = error.toError();
-			return false;
+			return nullptr;
 		}
 
 		if (dump)
@@ -142,15 +276,21 @@ namespace Aseba
 			*dump << "Checking the vectors' size:\n";
 		}
 
+		// size of the syntax tree as parsed
+		if (statistics)
+			statistics->nodesBeforeExpansion = countNodes(program.get());
+
 		// check vectors' size
 		try
 		{
+			throwIfCancelled();
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_CHECK_VECTOR_SIZE);
 			program->checkVectorSize();
 		}
 		catch(TranslatableError error)
 		{
 			errorDescription = error.toError();
-			return false;
+			return nullptr;
 		}
 
 		if (dump)
@@ -163,6 +303,8 @@ namespace Aseba
 		// expand the syntax tree to Aseba-like syntax
 		try
 		{
+			throwIfCancelled();
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_EXPAND);
 			Node* expandedProgram(program->expandAbstractNodes(dump));
 			program.release();
 			program.reset(expandedProgram);
@@ -170,7 +312,7 @@ namespace Aseba
 		catch (TranslatableError error)
 		{
 			errorDescription = error.toError();
-			return false;
+			return nullptr;
 		}
 
 		if (dump)
@@ -181,9 +323,13 @@ namespace Aseba
 			*dump << "Second pass for vectorial operations:\n";
 		}
 
-		// expand the vectorial nodes into scalar operations
+		// expand the vectorial nodes into scalar operations,
+		// with temporaries beyond the ones of any statement as they might be allocated within them
+		endVariableIndex = temporaryMemoryPeak;
 		try
 		{
+			throwIfCancelled();
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_EXPAND);
 			Node* expandedProgram(program->expandVectorialNodes(dump, this));
 			program.release();
 			program.reset(expandedProgram);
@@ -191,9 +337,12 @@ namespace Aseba
 		catch (TranslatableError error)
 		{
 			errorDescription = error.toError();
-			return false;
+			return nullptr;
 		}
 
+		if (statistics)
+			statistics->nodesAfterExpansion = countNodes(program.get());
+
 		if (dump)
 		{
 			*dump << "Expanded syntax tree (pass 2):\n";
@@ -205,14 +354,66 @@ namespace Aseba
 		// typecheck
 		try
 		{
+			throwIfCancelled();
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_TYPECHECK);
 			program->typeCheck(this);
 		}
 		catch(TranslatableError error)
 		{
 			errorDescription = error.toError();
-			return false;
+			return nullptr;
 		}
 
+		return program.release();
+	}
+
+	//! Check a program for errors without generating code, for instance to give feedback while it is edited
+	//! \param source stream to read the source code from
+	//! \param errorDescription error is copied there on error
+	//! \param cancelled if not null, the check is aborted with ERROR_COMPILATION_CANCELLED when it becomes true, it can be set from another thread
+	//! \return returns true if the program has no error up to type checking; errors found by later phases, such as recursive subroutine calls, are only reported by compile()
+	bool Compiler::check(std::wistream& source, Error &errorDescription, const std::atomic<bool>* cancelled)
+	{
+		assert(targetDescription);
+		assert(commonDefinitions);
+
+		const TranslationScope translation(translateCallback);
+		this->cancelled = cancelled;
+		std::unique_ptr<Node> program(parseAndTypeCheck(source, errorDescription, nullptr, nullptr));
+		this->cancelled = nullptr;
+		return program != nullptr;
+	}
+
+	//! Throw ERROR_COMPILATION_CANCELLED if the running check has been cancelled
+	void Compiler::throwIfCancelled() const
+	{
+		if (cancelled && cancelled->load(std::memory_order_relaxed))
+			throw TranslatableError(SourcePos(), ERROR_COMPILATION_CANCELLED);
+	}
+
+	//! Compile a new condition
+	//! \param source stream to read the source code from
+	//! \param bytecode destination array for bytecode
+	//! \param allocatedVariablesCount amount of allocated variables
+	//! \param errorDescription error is copied there on error
+	//! \param dump stream to send dump messages to
+	//! \param statistics if not null, filled with the duration of each phase and the size of the result
+	//! \return returns true on success 
+	bool Compiler::compile(std::wistream& source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount, Error &errorDescription, std::wostream* dump, CompilationStatistics* statistics)
+	{
+		assert(targetDescription);
+		assert(commonDefinitions);
+
+		const TranslationScope translation(translateCallback);
+		cancelled = nullptr;
+		if (statistics)
+			*statistics = CompilationStatistics();
+
+		std::unique_ptr<Node> program(parseAndTypeCheck(source, errorDescription, dump, statistics));
+		if (!program)
+			return false;
+		unsigned indent = 0;
+
 		if (dump)
 		{
 			*dump << "correct.\n";
@@ -223,9 +424,12 @@ namespace Aseba
 		// optimization
 		try
 		{
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_OPTIMIZE);
+			propagateConstants(program.get(), dump);
 			Node* optimizedProgram(program->optimize(dump));
 			program.release();
 			program.reset(optimizedProgram);
+			eliminateCommonSubexpressions(program.get(), dump);
 		}
 		catch (TranslatableError error)
 		{
@@ -233,6 +437,18 @@ namespace Aseba
 			return false;
 		}
 
+		if (dump)
+		{
+			*dump << "\n\n";
+			*dump << "Dead code elimination:\n";
+		}
+
+		// removal of unreachable code, unused subroutines and dead stores
+		{
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_OPTIMIZE);
+			eliminateDeadCode(program.get(), dump);
+		}
+
 		if (dump)
 		{
 			*dump << "\n\n";
@@ -243,6 +459,11 @@ namespace Aseba
 
 		// set the number of allocated variables
 		allocatedVariablesCount = freeVariableIndex;
+		if (statistics)
+		{
+			statistics->variablesUsed = allocatedVariablesCount;
+			statistics->variablesSize = targetDescription->variablesSize;
+		}
 
 		if (dump)
 		{
@@ -253,23 +474,81 @@ namespace Aseba
 
 		// code generation
 		PreLinkBytecode preLinkBytecode;
-		program->emit(preLinkBytecode);
+		{
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_EMIT);
+			program->emit(preLinkBytecode);
+
+			// fix-up (add of missing STOP and RET bytecodes at code generation)
+			preLinkBytecode.fixup(subroutineTable);
 
-		// fix-up (add of missing STOP and RET bytecodes at code generation)
-		preLinkBytecode.fixup(subroutineTable);
+			if (dump)
+				*dump << "Bytecode optimizations:\n";
+
+			// peephole optimization of each event and subroutine
+			preLinkBytecode.peepholeOptimize(dump);
+		}
+
+		if (dump)
+			*dump << "\n\n";
 
 		// stack check
-		if (!verifyStackCalls(preLinkBytecode))
 		{
-			errorDescription = TranslatableError(SourcePos(), ERROR_STACK_OVERFLOW).toError();
-			return false;
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_VERIFY);
+			try
+			{
+				verifyStackCalls(preLinkBytecode);
+			}
+			catch (TranslatableError error)
+			{
+				errorDescription = error.toError();
+				return false;
+			}
+			maxStackDepth = 0;
+			for (const auto& event : preLinkBytecode.events)
+				maxStackDepth = std::max(maxStackDepth, event.second.worstStackDepth);
+			for (const auto& subroutine : preLinkBytecode.subroutines)
+				maxStackDepth = std::max(maxStackDepth, subroutine.second.worstStackDepth);
+
+			// execution time check
+			boundInstructions(preLinkBytecode);
+		}
+
+		if (dump)
+		{
+			*dump << "Worst-case stack depth (of " << targetDescription->stackSize << "):\n";
+			for (const auto& event : preLinkBytecode.events)
+				*dump << "event " << eventName(event.first) << ": " << event.second.worstStackDepth << "\n";
+			for (const auto& subroutine : preLinkBytecode.subroutines)
+				*dump << "sub " << subroutineTable[subroutine.first].name << ": " << subroutine.second.worstStackDepth << "\n";
+			*dump << "\n\n";
+			*dump << "Worst-case executed instructions:\n";
+			for (const auto& event : preLinkBytecode.events)
+				*dump << "event " << eventName(event.first) << ": " << instructionsCountToWString(event.second.maxInstructions) << "\n";
+			for (const auto& subroutine : preLinkBytecode.subroutines)
+				*dump << "sub " << subroutineTable[subroutine.first].name << ": " << instructionsCountToWString(subroutine.second.maxInstructions) << "\n";
+			for (const auto& warning : warnings)
+				*dump << warning.toWString(L"Warning") << "\n";
+			*dump << "\n\n";
 		}
 
 		// linking (flattening of complex structure into linear vector)
-		if (!link(preLinkBytecode, bytecode))
 		{
-			errorDescription = TranslatableError(SourcePos(), ERROR_SCRIPT_TOO_BIG).toError();
-			return false;
+			const PhaseTimer timer(statistics, CompilationStatistics::PHASE_LINK);
+			if (!link(preLinkBytecode, bytecode))
+			{
+				errorDescription = TranslatableError(SourcePos(), ERROR_SCRIPT_TOO_BIG).toError();
+				return false;
+			}
+		}
+
+		if (statistics)
+		{
+			for (const auto& event : preLinkBytecode.events)
+				statistics->events.push_back({eventName(event.first), unsigned(event.second.size()), event.second.worstStackDepth, event.second.maxInstructions});
+			for (const auto& subroutine : preLinkBytecode.subroutines)
+				statistics->subroutines.push_back({subroutineTable[subroutine.first].name, unsigned(subroutine.second.size()), subroutine.second.worstStackDepth, subroutine.second.maxInstructions});
+			statistics->bytecodeSize = bytecode.size();
+			countLinesCosts(bytecode, statistics->lines);
 		}
 
 		if (dump)
@@ -378,14 +657,15 @@ namespace Aseba
 		const BytecodeVector::EventAddressesToIdsMap eventAddr(bytecode.getEventAddressesToIds());
 		std::map<unsigned, unsigned> subroutinesAddr;
 
-		// build subroutine map
+		// build subroutine map, skipping the ones removed because never called
 		for (size_t id = 0; id < subroutineTable.size(); ++id)
-			subroutinesAddr[subroutineTable[id].address] = id;
+			if (preLinkBytecode.subroutines.find(id) != preLinkBytecode.subroutines.end())
+				subroutinesAddr[subroutineTable[id].address] = id;
 
 		// event table
 		const unsigned eventCount = eventAddr.size();
 		const float fillPercentage = float(bytecode.size() * 100.f) / float(targetDescription->bytecodeSize);
-		dump << "Disassembling " << eventCount + subroutineTable.size() << " segments (" << bytecode.size() << " words on " << targetDescription->bytecodeSize << ", " << fillPercentage << "% filled):\n";
+		dump << "Disassembling " << eventCount + subroutinesAddr.size() << " segments (" << bytecode.size() << " words on " << targetDescription->bytecodeSize << ", " << fillPercentage << "% filled):\n";
 
 		// bytecode
 		unsigned pc = eventCount*2 + 1;
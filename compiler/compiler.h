@@ -26,9 +26,13 @@
 #include <deque>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <set>
 #include <utility>
 #include <istream>
+#include <limits>
+#include <atomic>
 
 #include "errors_code.h"
 #include "../common/types.h"
@@ -64,6 +68,12 @@ namespace Aseba
 		unsigned short line{0}; //!< line in source code
 	};
 
+	//! Number of executed instructions, saturating at UNBOUNDED_INSTRUCTIONS
+	typedef unsigned long long InstructionsCount;
+	//! Number of executed instructions of code that might never terminate
+	const InstructionsCount UNBOUNDED_INSTRUCTIONS = std::numeric_limits<InstructionsCount>::max();
+	std::wstring instructionsCountToWString(InstructionsCount count);
+
 	//! Bytecode array in the form of a dequeue, for construction
 	struct BytecodeVector: std::deque<BytecodeElement>
 	{
@@ -71,7 +81,8 @@ namespace Aseba
 		BytecodeVector() = default;
 
 		unsigned maxStackDepth{0}; //!< maximum depth of the stack used by all the computations of the bytecode
-		unsigned callDepth{0}; //!< for callable bytecode (i.e. subroutines), used in analysis of stack check
+		unsigned worstStackDepth{0}; //!< maximum depth of the stack including the subroutines called, set by the stack check
+		InstructionsCount maxInstructions{0}; //!< maximum number of instructions executed including the subroutines called, set by the instructions analysis
 		unsigned lastLine{0}; //!< last line added, normally equal *this[this->size()-1].line, but may differ for instance on loops
 
 		void push_back(const BytecodeElement& be)
@@ -82,6 +93,7 @@ namespace Aseba
 
 		void changeStopToRetSub();
 		unsigned short getTypeOfLast() const;
+		void peepholeOptimize(std::wostream* dump = nullptr);
 
 		//! A map of event addresses to identifiers
 		typedef std::map<unsigned, unsigned> EventAddressesToIdsMap;
@@ -125,8 +137,8 @@ namespace Aseba
 		//! Create an empty error
 		Error() = default;
 
-		//! Return a string describing the error
-		std::wstring toWString() const;
+		//! Return a string describing the error, kind being for instance "Error" or "Warning"
+		std::wstring toWString(const wchar_t* kind = L"Error") const;
 	};
 
 	struct TranslatableError : public Error
@@ -142,7 +154,8 @@ namespace Aseba
 		Error toError();
 		static void setTranslateCB(ErrorMessages::ErrorCallback newCB);
 
-		static ErrorMessages::ErrorCallback translateCB;
+		//! Callback translating the messages of errors created by the calling thread
+		static thread_local ErrorMessages::ErrorCallback translateCB;
 		WFormatableString message;
 	};
 
@@ -157,6 +170,8 @@ namespace Aseba
 
 		std::wstring name; //!< name part of the pair
 		int value; //!< value part of the pair
+
+		bool operator==(const NamedValue& that) const { return name == that.name && value == that.value; }
 	};
 
 	//! An event description is a name - value pair
@@ -187,6 +202,60 @@ namespace Aseba
 
 		//! Clear all the content
 		void clear() { events.clear(); constants.clear(); }
+		bool operator==(const CommonDefinitions& that) const { return events == that.events && constants == that.constants; }
+		bool operator!=(const CommonDefinitions& that) const { return !(*this == that); }
+	};
+
+	//! Statistics of a compilation, filled by Compiler::compile on request
+	struct CompilationStatistics
+	{
+		//! Phases of the compilation, in execution order
+		enum Phase
+		{
+			PHASE_TOKENIZE = 0,
+			PHASE_PARSE,
+			PHASE_CHECK_VECTOR_SIZE,
+			PHASE_EXPAND,
+			PHASE_TYPECHECK,
+			PHASE_OPTIMIZE,
+			PHASE_EMIT,
+			PHASE_VERIFY,
+			PHASE_LINK,
+			PHASES_COUNT
+		};
+
+		//! Size and stack usage of the code of an event or of a subroutine
+		struct CodeStatistics
+		{
+			std::wstring name; //!< name of the event or of the subroutine
+			unsigned words; //!< size of the bytecode
+			unsigned maxStackDepth; //!< worst-case stack depth, including the subroutines it calls
+			InstructionsCount maxInstructions; //!< worst-case number of executed instructions, including the subroutines it calls
+		};
+		using CodeStatisticsVector = std::vector<CodeStatistics>;
+
+		//! Bytecode generated for a line of source
+		struct LineCost
+		{
+			unsigned words{0}; //!< words of bytecode
+			unsigned instructions{0}; //!< instructions, regardless of how many times they are executed
+		};
+		//! Map of lines of source, starting at 0, to the bytecode generated for them
+		typedef std::map<unsigned, LineCost> LinesCosts;
+
+		double phaseDurations[PHASES_COUNT] = {}; //!< wall time of each phase in microseconds, 0 for phases not reached
+		unsigned nodesBeforeExpansion{0}; //!< number of nodes of the syntax tree after parsing
+		unsigned nodesAfterExpansion{0}; //!< number of nodes of the syntax tree once expanded to scalar operations
+		CodeStatisticsVector events; //!< code of each event, in vector table order
+		CodeStatisticsVector subroutines; //!< code of each subroutine, in call id order
+		unsigned bytecodeSize{0}; //!< words of bytecode, including the event vector table
+		LinesCosts lines; //!< bytecode of each line of source, excluding the event vector table
+		unsigned variablesUsed{0}; //!< words of variable space used
+		unsigned variablesSize{0}; //!< words of variable space on the target
+
+		static const wchar_t* phaseName(Phase phase);
+		double totalDuration() const;
+		std::wstring toWString() const;
 	};
 
 	//! Aseba Event Scripting Language compiler
@@ -267,12 +336,13 @@ namespace Aseba
 				TOKEN_OP_MINUS_MINUS
 
 			} type{TOKEN_END_OF_STREAM}; //!< type of this token
-			std::wstring sValue; //!< string version of the value
+			const std::wstring* string{nullptr}; //!< interned string value for identifiers, owned by the compiler
 			int iValue{0}; //!< int version of the value, 0 if not applicable
 			SourcePos pos;//!< position of token in source code
 
 			Token()  = default;
-			Token(Type type, SourcePos pos = SourcePos(), const std::wstring& value = L"");
+			Token(Type type, SourcePos pos = SourcePos(), const std::wstring* sValue = nullptr, int iValue = 0);
+			const std::wstring& sValue() const;
 			const std::wstring typeName() const;
 			std::wstring toWString() const;
 			operator Type () const { return type; }
@@ -290,13 +360,20 @@ namespace Aseba
 		//! Lookup table for subroutines id => (name, address, line)
 		using SubroutineTable = std::vector<SubroutineDescriptor>;
 		//! Reverse Lookup table for subroutines name => id
-		typedef std::map<std::wstring, unsigned> SubroutineReverseTable;
+		typedef std::unordered_map<std::wstring, unsigned> SubroutineReverseTable;
 		//! Lookup table to keep track of implemented events
 		using ImplementedEvents = std::set<unsigned int>;
 		//! Lookup table for constant name => value
-		typedef std::map<std::wstring, int> ConstantsMap;
+		typedef std::unordered_map<std::wstring, int> ConstantsMap;
 		//! Lookup table for event name => id
-		typedef std::map<std::wstring, unsigned> EventsMap;
+		typedef std::unordered_map<std::wstring, unsigned> EventsMap;
+
+		//! What the generated code is optimized for, when there is a choice
+		enum OptimizationGoal
+		{
+			OPTIMIZE_FOR_SPEED = 0, //!< fewest executed instructions
+			OPTIMIZE_FOR_SIZE //!< fewest bytecode words
+		};
 
 		friend struct AssignmentNode;
 		friend struct CallSubNode;
@@ -308,8 +385,18 @@ namespace Aseba
 		const VariablesMap *getVariablesMap() const { return &variablesMap; }
 		const SubroutineTable *getSubroutineTable() const { return &subroutineTable; }
 		void setCommonDefinitions(const CommonDefinitions *definitions);
-		bool compile(std::wistream& source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount, Error &errorDescription, std::wostream* dump = nullptr);
-		void setTranslateCallback(ErrorMessages::ErrorCallback newCB) { TranslatableError::setTranslateCB(newCB); }
+		bool compile(std::wistream& source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount, Error &errorDescription, std::wostream* dump = nullptr, CompilationStatistics* statistics = nullptr);
+		bool check(std::wistream& source, Error &errorDescription, const std::atomic<bool>* cancelled = nullptr);
+		void setOptimizationGoal(OptimizationGoal goal) { optimizationGoal = goal; }
+		OptimizationGoal getOptimizationGoal() const { return optimizationGoal; }
+		unsigned getMaxStackDepth() const { return maxStackDepth; }
+		//! Set the number of instructions an event may execute before a warning, 0 for no limit
+		void setInstructionsBudget(InstructionsCount budget) { instructionsBudget = budget; }
+		InstructionsCount getInstructionsBudget() const { return instructionsBudget; }
+		//! Return the warnings of the last compilation
+		const std::vector<Error>& getWarnings() const { return warnings; }
+		//! Set the callback translating the error messages of this compiler
+		void setTranslateCallback(ErrorMessages::ErrorCallback newCB) { translateCallback = newCB; }
 		static std::wstring translate(ErrorCode error) { return TranslatableError::translateCB(error); }
 		static bool isKeyword(const std::wstring& word);
 
@@ -345,13 +432,20 @@ namespace Aseba
 		SubroutineReverseTable::const_iterator findSubroutine(const std::wstring& name, const SourcePos& pos) const;
 		bool constantExists(const std::wstring& name) const;
 		void buildMaps();
+		Node* parseAndTypeCheck(std::wistream& source, Error &errorDescription, std::wostream* dump, CompilationStatistics* statistics);
+		void throwIfCancelled() const;
 		void tokenize(std::wistream& source);
-		wchar_t getNextCharacter(std::wistream& source, SourcePos& pos);
-		bool testNextCharacter(std::wistream& source, SourcePos& pos, wchar_t test, Token::Type tokenIfTrue);
+		void tokenize(const wchar_t* begin, const wchar_t* end);
+		wchar_t getNextCharacter(const wchar_t*& cursor, SourcePos& pos);
+		bool testNextCharacter(const wchar_t*& cursor, const wchar_t* end, SourcePos& pos, wchar_t test, Token::Type tokenIfTrue);
 		void dumpTokens(std::wostream &dest) const;
-		bool verifyStackCalls(PreLinkBytecode& preLinkBytecode);
+		void verifyStackCalls(PreLinkBytecode& preLinkBytecode);
+		void boundInstructions(PreLinkBytecode& preLinkBytecode);
 		bool link(const PreLinkBytecode& preLinkBytecode, BytecodeVector& bytecode);
 		void disassemble(BytecodeVector& bytecode, const PreLinkBytecode& preLinkBytecode, std::wostream& dump) const;
+		void propagateConstants(Node* program, std::wostream* dump);
+		void eliminateCommonSubexpressions(Node* program, std::wostream* dump);
+		void eliminateDeadCode(Node* program, std::wostream* dump);
 
 	protected:
 		Node* parseProgram();
@@ -398,6 +492,8 @@ namespace Aseba
 
 	protected:
 		std::deque<Token> tokens; //!< parsed tokens
+		std::unordered_set<std::wstring> identifiers; //!< interned identifiers, referenced by tokens
+		std::wstring identifierScratch; //!< reused buffer to look up identifiers without allocating
 		VariablesMap variablesMap; //!< variables lookup
 		ImplementedEvents implementedEvents; //!< list of implemented events
 		FunctionsMap functionsMap; //!< functions lookup
@@ -408,10 +504,24 @@ namespace Aseba
 		SubroutineReverseTable subroutineReverseTable; //!< subroutine reverse lookup
 		unsigned freeVariableIndex; //!< index pointing to the first free variable
 		unsigned endVariableIndex; //!< (endMemory - endVariableIndex) is pointing to the first free variable at the end
+		unsigned temporaryMemoryPeak; //!< largest value reached by endVariableIndex during this compilation
+		unsigned temporaryVariableUid; //!< number of temporary variables allocated by this compiler, to name them
+		unsigned maxStackDepth; //!< worst-case stack depth of the last compiled program, including subroutine calls
 		const TargetDescription *targetDescription; //!< description of the target VM
 		const CommonDefinitions *commonDefinitions; //!< common definitions, such as events or some constants
-
-		ErrorMessages translator;
+		OptimizationGoal optimizationGoal; //!< whether vector operations are generated for speed or size
+		InstructionsCount instructionsBudget; //!< number of instructions an event may execute before a warning, 0 for no limit
+		std::vector<Error> warnings; //!< warnings of the last compilation
+		const std::atomic<bool>* cancelled; //!< if not null, aborts the running check() when it becomes true
+
+		bool mapsValid; //!< whether the maps were built from mapsTargetDescription and mapsCommonDefinitions
+		TargetDescription mapsTargetDescription; //!< copy of the target description the maps were built from
+		CommonDefinitions mapsCommonDefinitions; //!< copy of the common definitions the maps were built from
+		unsigned targetVariablesSize; //!< size of the variables of the target
+		std::vector<std::wstring> programVariables; //!< variables added to variablesMap by the last program, removed before the next one
+		std::vector<std::wstring> programConstants; //!< constants added to constantsMap by the last program, removed before the next one
+
+		ErrorMessages::ErrorCallback translateCallback; //!< translates error messages, installed for the calling thread during compile()
 	}; // Compiler
 
 	//! Bytecode use for compilation previous to linking
@@ -425,11 +535,32 @@ namespace Aseba
 		typedef std::map<unsigned, BytecodeVector> SubroutinesBytecode;
 		SubroutinesBytecode subroutines; //!< bytecode for routines
 
+		//! Map of subroutines id called by some bytecode to the position of one of the calls
+		typedef std::map<unsigned, SourcePos> SubroutineCalls;
+		//! Map of events or subroutines id to the subroutines they call
+		typedef std::map<unsigned, SubroutineCalls> CallGraph;
+		CallGraph eventsCalls; //!< subroutines called by each event
+		CallGraph subroutinesCalls; //!< subroutines called by each subroutine
+
+		//! Bound of a loop, recorded at code generation
+		struct LoopBound
+		{
+			SourcePos pos; //!< position of the loop
+			unsigned iterations; //!< maximum number of iterations, 0 if unknown
+			unsigned counterAddr; //!< address of the counter, which the body must not modify for the bound to hold
+		};
+		//! Map of source lines to the bound of the loops on them
+		typedef std::map<unsigned, LoopBound> LoopBounds;
+		LoopBounds loopBounds; //!< bounds of the loops, by line
+
 		BytecodeVector *current; //!< pointer to bytecode being constructed
+		SubroutineCalls *currentCalls; //!< pointer to the calls of the event or subroutine being constructed
 
 		PreLinkBytecode();
 
 		void fixup(const Compiler::SubroutineTable &subroutineTable);
+		void addLoopBound(const SourcePos& pos, unsigned iterations, unsigned counterAddr);
+		void peepholeOptimize(std::wostream* dump = nullptr);
 	};
 
 	/*@}*/
@@ -36,6 +36,11 @@ namespace Aseba
 		error_map[ERROR_BROKEN_TARGET] =			L"Broken target description: not enough room for internal variables";
 		error_map[ERROR_STACK_OVERFLOW] =			L"Execution stack will overflow, check for any recursive subroutine call and cut long mathematical expressions";
 		error_map[ERROR_SCRIPT_TOO_BIG] =			L"Script too big for target bytecode size";
+		error_map[ERROR_COMPILATION_CANCELLED] =		L"Compilation cancelled";
+		// analysis.cpp
+		error_map[ERROR_RECURSIVE_SUBROUTINE_CALL] =		L"Recursive subroutine call %0, the execution stack would overflow";
+		error_map[WARNING_UNBOUNDED_LOOP] =			L"Cannot bound the iterations of this loop, the execution time of %0 is unbounded";
+		error_map[WARNING_INSTRUCTIONS_BUDGET_EXCEEDED] =	L"Event %0 might execute up to %1 instructions, over the budget of %2";
 		// identifier-lookup.cpp
 		error_map[ERROR_VARIABLE_NOT_DEFINED] =			L"%0 is not a defined variable";
 		error_map[ERROR_VARIABLE_NOT_DEFINED_GUESS] =		L"%0 is not a defined variable, do you mean %1?";
@@ -186,6 +191,9 @@ namespace Aseba
 
 	const std::wstring ErrorMessages::defaultCallback(ErrorCode error)
 	{
+		// fill the messages once, compilers might run in several threads
+		static const ErrorMessages messages;
+
 		if (error >= ERROR_END)
 			return std::wstring(error_map[ERROR_UNKNOWN_ERROR]);
 		else
@@ -193,17 +201,17 @@ namespace Aseba
 	}
 
 	//! Return the string version of this error
-	std::wstring Error::toWString() const
+	std::wstring Error::toWString(const wchar_t* kind) const
 	{
 		std::wostringstream oss;
 		if (pos.valid)
-			oss << "Error at Line: " << pos.row + 1 << " Col: " << pos.column + 1 << " : " << message;
+			oss << kind << " at Line: " << pos.row + 1 << " Col: " << pos.column + 1 << " : " << message;
 		else
-			oss << "Error : " << message;
+			oss << kind << " : " << message;
 		return oss.str();
 	}
 
-	ErrorMessages::ErrorCallback TranslatableError::translateCB = nullptr;
+	thread_local ErrorMessages::ErrorCallback TranslatableError::translateCB = ErrorMessages::defaultCallback;
 
 	TranslatableError::TranslatableError(const SourcePos& pos, ErrorCode error)
 	{
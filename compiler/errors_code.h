@@ -18,6 +18,11 @@ namespace Aseba
 		ERROR_BROKEN_TARGET = 0,
 		ERROR_STACK_OVERFLOW,
 		ERROR_SCRIPT_TOO_BIG,
+		ERROR_COMPILATION_CANCELLED,
+		// analysis.cpp
+		ERROR_RECURSIVE_SUBROUTINE_CALL,
+		WARNING_UNBOUNDED_LOOP,
+		WARNING_INSTRUCTIONS_BUDGET_EXCEEDED,
 		// identifier-lookup.cpp
 		ERROR_VARIABLE_NOT_DEFINED,
 		ERROR_VARIABLE_NOT_DEFINED_GUESS,
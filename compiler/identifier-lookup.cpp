@@ -31,6 +31,7 @@
 #include <memory>
 #include <limits>
 #include <algorithm>
+#include <functional>
 #ifndef __APPLE__
 	#include <malloc.h>
 #endif
@@ -73,34 +74,50 @@ namespace Aseba
 	}
 
 	//! Compute the edit distance between two vector-style containers, inspired from http://en.wikibooks.org/wiki/Algorithm_Implementation/Strings/Levenshtein_distance#C.2B.2B
+	//! Only a band of width 2*maxDist+1 around the diagonal is computed, and the computation stops as soon as maxDist is reached; in that case maxDist is returned
 	template <class T> unsigned int editDistance(const T& s1, const T& s2, const unsigned maxDist)
 	{
 		// Dynamic programming implementation.
-		// Uses only O(len(s2)) space and O(len(s1)*len(s2)) time.
-		const auto l1(s1.size());
-		const auto l2(s2.size());
+		// Uses only O(len(s2)) space and O(len(s1)*maxDist) time.
+		const size_t l1(s1.size());
+		const size_t l2(s2.size());
+		// the length difference is a lower bound of the distance
+		if ((l1 > l2 ? l1 - l2 : l2 - l1) >= maxDist)
+			return maxDist;
 		// States on s1 are folded into current (Dn) and last (Do),
-		// achieving O(len(s2)) in space.
-		std::vector<int> Do(l2+1, 0);
-		std::vector<int> Dn(l2+1, 0);
+		// achieving O(len(s2)) in space. Values are saturated at maxDist.
+		std::vector<unsigned> Do(l2+1, 0);
+		std::vector<unsigned> Dn(l2+1, 0);
 
 		// first row, nothing matches empty string
 		for (size_t j = 1; j <= l2; ++j)
-			Do[j] = Do[j-1] + 1;
+			Do[j] = std::min<unsigned>(j, maxDist);
 		// note: j indices for accessing s2 are shifted by 1 compared to i indices for accessing s
 		// all rows
 		for (size_t i = 0; i < l1; ++i)
 		{
-			// all elements in row i+1
-			Dn[0] = Do[0] + 1; // nothing matches empty string
-			for (size_t j = 1; j <= l2; ++j)
+			// elements in row i+1 within the band
+			const size_t jMin(i + 1 > maxDist ? i + 1 - maxDist : 1);
+			const size_t jMax(std::min(l2, i + 1 + maxDist));
+			Dn[0] = std::min<unsigned>(i + 1, maxDist); // nothing matches empty string
+			if (jMin > 1)
+				Dn[jMin-1] = maxDist;
+			unsigned rowMin(jMin == 1 ? Dn[0] : maxDist);
+			for (size_t j = jMin; j <= jMax; ++j)
 			{
-				Dn[j] = std::min(std::min(
+				Dn[j] = std::min(std::min(std::min(
 					Do[j] + 1,
 					Dn[j-1] + 1),
-					Do[j-1] + (s1[i] == s2[j-1] ? 0 : 1)
+					Do[j-1] + (s1[i] == s2[j-1] ? 0 : 1)),
+					maxDist
 				);
+				rowMin = std::min(rowMin, Dn[j]);
 			}
+			if (jMax < l2)
+				Dn[jMax+1] = maxDist;
+			// the distance can only grow from one row to the next
+			if (rowMin >= maxDist)
+				return maxDist;
 			std::swap(Dn, Do);
 		}
 		return Do.back();
@@ -115,12 +132,13 @@ namespace Aseba
 		{
 			const unsigned maxDist(3);
 			std::wstring bestName;
-			unsigned bestDist(std::numeric_limits<unsigned>::max());
+			unsigned bestDist(maxDist);
 			for (auto jt(map.begin()); jt != map.end(); ++jt)
 			{
-				const std::wstring thatName(jt->first);
-				const unsigned d(editDistance<std::wstring>(name, thatName, maxDist));
-				if (d < bestDist && d < maxDist)
+				const std::wstring& thatName(jt->first);
+				// bound the search by the best distance so far, keeping ties to select them alphabetically
+				const unsigned d(editDistance<std::wstring>(name, thatName, std::min(bestDist + 1, maxDist)));
+				if (d < maxDist && (d < bestDist || (d == bestDist && thatName < bestName)))
 				{
 					bestDist = d;
 					bestName = thatName;
@@ -189,39 +207,64 @@ namespace Aseba
 	void Compiler::buildMaps()
 	{
 		assert(targetDescription);
+		assert(commonDefinitions);
 
 		// erase tables
 		implementedEvents.clear();
 		subroutineTable.clear();
 		subroutineReverseTable.clear();
 
-		// fill variables map
-		variablesMap = targetDescription->getVariablesMap(freeVariableIndex);
+		// remove what the previous program added to the maps, they then only hold the target and common definitions
+		for (const auto& name : programVariables)
+			variablesMap.erase(name);
+		programVariables.clear();
+		for (const auto& name : programConstants)
+			constantsMap.erase(name);
+		programConstants.clear();
 
-		// fill functions map
-		functionsMap = targetDescription->getFunctionsMap();
-
-		// fill contants maps
-		constantsMap.clear();
-		for (unsigned i = 0; i < commonDefinitions->constants.size(); i++)
+		// rebuild maps depending on target and common definitions only if these changed since last compilation
+		if (!mapsValid || *targetDescription != mapsTargetDescription || *commonDefinitions != mapsCommonDefinitions)
 		{
-			const NamedValue &constant(commonDefinitions->constants[i]);
-			constantsMap[constant.name] = constant.value;
-		}
+			mapsValid = false;
 
-		// fill global events map
-		globalEventsMap.clear();
-		for (unsigned i = 0; i < commonDefinitions->events.size(); i++)
-		{
-			globalEventsMap[commonDefinitions->events[i].name] = i;
-		}
+			// fill variables map
+			variablesMap = targetDescription->getVariablesMap(targetVariablesSize);
 
-		// fill all events map
-		allEventsMap = globalEventsMap;
-		for (unsigned i = 0; i < targetDescription->localEvents.size(); ++i)
-		{
-			allEventsMap[targetDescription->localEvents[i].name] = ASEBA_EVENT_LOCAL_EVENTS_START - i;
+			// fill functions map
+			functionsMap = targetDescription->getFunctionsMap();
+
+			// fill contants maps
+			constantsMap.clear();
+			constantsMap.reserve(commonDefinitions->constants.size());
+			for (unsigned i = 0; i < commonDefinitions->constants.size(); i++)
+			{
+				const NamedValue &constant(commonDefinitions->constants[i]);
+				constantsMap[constant.name] = constant.value;
+			}
+
+			// fill global events map
+			globalEventsMap.clear();
+			globalEventsMap.reserve(commonDefinitions->events.size());
+			for (unsigned i = 0; i < commonDefinitions->events.size(); i++)
+			{
+				globalEventsMap[commonDefinitions->events[i].name] = i;
+			}
+
+			// fill all events map
+			allEventsMap = globalEventsMap;
+			for (unsigned i = 0; i < targetDescription->localEvents.size(); ++i)
+			{
+				allEventsMap[targetDescription->localEvents[i].name] = ASEBA_EVENT_LOCAL_EVENTS_START - i;
+			}
+
+			// keep exact copies, so that any change is noticed
+			mapsTargetDescription = *targetDescription;
+			mapsCommonDefinitions = *commonDefinitions;
+			mapsValid = true;
 		}
+
+		freeVariableIndex = targetVariablesSize;
+		temporaryMemoryPeak = 0;
 	}
 
 	/*@}*/
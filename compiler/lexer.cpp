@@ -26,63 +26,26 @@
 #include <cctype>
 #include <cstdio>
 #include <cwctype>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
 
 namespace Aseba
 {
-	#ifdef ANDROID
-	long int wcstol_fix( const wchar_t * str, wchar_t ** endptr, int base )
+	//! Construct a new token of given type, with an interned string or an integer value
+	Compiler::Token::Token(Type type, SourcePos pos, const std::wstring* sValue, int iValue) :
+		type(type),
+		string(sValue),
+		iValue(iValue),
+		pos(pos)
 	{
-		long int v(0);
-		while (*str)
-		{
-			v *= base;
-			if (str[0] <= '9')
-			{
-				v += (str[0] - '0');
-			}
-			else
-			{
-				const long int maskedVal(str[0] & (~(1<<5)));
-				v += (maskedVal - 'A') + 10;
-			}
-			++str;
-		}
-		return v;
 	}
-	#define wcstol wcstol_fix
-	#endif // ANDROID
 
-	//! Construct a new token of given type and value
-	Compiler::Token::Token(Type type, SourcePos pos, const std::wstring& value) :
-		type(type),
-		sValue(value),
-		pos(pos)
+	//! Return the string value of this token, empty if not applicable
+	const std::wstring& Compiler::Token::sValue() const
 	{
-		if (type == TOKEN_INT_LITERAL)
-		{
-			long int decode;
-			bool wasUnsigned = false;
-			// all values are assumed to be signed 16-bits
-			if ((value.length() > 1) && (value[1] == 'x')) {
-				decode = wcstol(value.c_str() + 2, nullptr, 16);
-				wasUnsigned = true;
-			}
-			else if ((value.length() > 1) && (value[1] == 'b')) {
-				decode = wcstol(value.c_str() + 2, nullptr, 2);
-				wasUnsigned = true;
-			}
-			else
-				decode = wcstol(value.c_str(), nullptr, 10);
-			if (decode >= 65536)
-				throw TranslatableError(pos, ERROR_INT16_OUT_OF_RANGE).arg(decode);
-			if (wasUnsigned && decode > 32767)
-				decode -= 65536;
-			iValue = decode;
-		}
-		else
-			iValue = 0;
-		pos.column--; // column has already been incremented when token is created, so we remove one
-		pos.character--; // character has already been incremented when token is created, so we remove one
+		static const std::wstring empty;
+		return string ? *string : empty;
 	}
 
 	//! Return the name of the type of this token
@@ -166,26 +129,91 @@ namespace Aseba
 		if (type == TOKEN_INT_LITERAL)
 			oss << L" : " << iValue;
 		if (type == TOKEN_STRING_LITERAL)
-			oss << L" : " << sValue;
+			oss << L" : " << sValue();
 		return oss.str();
 	}
 
 
-	//! Parse source and build tokens vector
+	//! Keywords of the language and their tokens
+	static const std::unordered_map<std::wstring, Compiler::Token::Type>& keywords()
+	{
+		static const std::unordered_map<std::wstring, Compiler::Token::Type> keywords = {
+			{ L"when", Compiler::Token::TOKEN_STR_when },
+			{ L"emit", Compiler::Token::TOKEN_STR_emit },
+			{ L"_emit", Compiler::Token::TOKEN_STR_hidden_emit },
+			{ L"for", Compiler::Token::TOKEN_STR_for },
+			{ L"in", Compiler::Token::TOKEN_STR_in },
+			{ L"step", Compiler::Token::TOKEN_STR_step },
+			{ L"while", Compiler::Token::TOKEN_STR_while },
+			{ L"do", Compiler::Token::TOKEN_STR_do },
+			{ L"if", Compiler::Token::TOKEN_STR_if },
+			{ L"then", Compiler::Token::TOKEN_STR_then },
+			{ L"else", Compiler::Token::TOKEN_STR_else },
+			{ L"elseif", Compiler::Token::TOKEN_STR_elseif },
+			{ L"end", Compiler::Token::TOKEN_STR_end },
+			{ L"var", Compiler::Token::TOKEN_STR_var },
+			{ L"const", Compiler::Token::TOKEN_STR_const },
+			{ L"call", Compiler::Token::TOKEN_STR_call },
+			{ L"sub", Compiler::Token::TOKEN_STR_sub },
+			{ L"callsub", Compiler::Token::TOKEN_STR_callsub },
+			{ L"onevent", Compiler::Token::TOKEN_STR_onevent },
+			{ L"abs", Compiler::Token::TOKEN_STR_abs },
+			{ L"return", Compiler::Token::TOKEN_STR_return },
+			{ L"or", Compiler::Token::TOKEN_OP_OR },
+			{ L"and", Compiler::Token::TOKEN_OP_AND },
+			{ L"not", Compiler::Token::TOKEN_OP_NOT },
+		};
+		return keywords;
+	}
+
+	//! Return whether c can continue an identifier or a number, with a fast path for ASCII
+	static inline bool isIdentifierCharacter(wchar_t c)
+	{
+		if (c < 0x80)
+			return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) || (c == '_') || (c == '.');
+		return std::iswalnum(c);
+	}
+
+	//! Return the value of digits in base, saturating instead of overflowing
+	static long int decodeDigits(const wchar_t* begin, const wchar_t* end, int base)
+	{
+		const long int limit(std::numeric_limits<long int>::max());
+		long int value(0);
+		for (const wchar_t* it = begin; it != end; ++it)
+		{
+			const wchar_t c(*it);
+			const int digit((c <= '9') ? (c - '0') : ((c | 0x20) - 'a' + 10));
+			if (value > (limit - digit) / base)
+				return limit;
+			value = value * base + digit;
+		}
+		return value;
+	}
+
+	//! Read source into a buffer, then build tokens from it
 	//! \param source source code
 	void Compiler::tokenize(std::wistream& source)
+	{
+		const std::wstring buffer((std::istreambuf_iterator<wchar_t>(source)), std::istreambuf_iterator<wchar_t>());
+		tokenize(buffer.data(), buffer.data() + buffer.size());
+	}
+
+	//! Parse source and build tokens vector
+	//! \param begin start of the source code
+	//! \param end end of the source code
+	void Compiler::tokenize(const wchar_t* begin, const wchar_t* end)
 	{
 		tokens.clear();
+		identifiers.clear();
 		SourcePos pos(0, 0, 0);
 		const unsigned tabSize = 4;
+		const wchar_t* cursor(begin);
+		const auto peek = [&cursor, end]() { return cursor != end ? int(*cursor) : int(WEOF); };
 
 		// tokenize text source
-		while (source.good())
+		while (cursor != end)
 		{
-			wchar_t c = source.get();
-
-			if (source.eof())
-				break;
+			wchar_t c = *cursor++;
 
 			pos.column++;
 			pos.character++;
@@ -209,14 +237,14 @@ namespace Aseba
 				case '#':
 				{
 					// check if it's a comment block #* ... *#
-					if (source.peek() == '*')
+					if (peek() == '*')
 					{
 						// comment block
 						// record position of the begining
 						SourcePos begin(pos);
 						// move forward by 2 characters then search for the end
 						int step = 2;
-						while ((step > 0) || (c != '*') || (source.peek() != '#'))
+						while ((step > 0) || (c != '*') || (peek() != '#'))
 						{
 							if (step)
 								step--;
@@ -230,27 +258,29 @@ namespace Aseba
 							}
 							else
 								pos.column++;
-							c = source.get();
 							pos.character++;
-							if (source.eof())
+							if (cursor == end)
 							{
 								// EOF -> unbalanced block
 								throw TranslatableError(begin, ERROR_UNBALANCED_COMMENT_BLOCK);
 							}
+							c = *cursor++;
 						}
 						// fetch the #
-						getNextCharacter(source, pos);
+						getNextCharacter(cursor, pos);
 					}
 					else
 					{
 						// simple comment
-						while ((c != '\n') && (c != '\r') && (!source.eof()))
+						bool eof(false);
+						while ((c != '\n') && (c != '\r') && (!eof))
 						{
 							if (c == '\t')
 								pos.column += tabSize;
 							else
 								pos.column++;
-							c = source.get();
+							eof = (cursor == end);
+							c = eof ? 0 : *cursor++;
 							pos.character++;
 						}
 						if (c == '\n')
@@ -266,53 +296,53 @@ namespace Aseba
 
 				// cases that require one character look-ahead
 				case '+':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_ADD_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_ADD_EQUAL))
 						break;
-					if (testNextCharacter(source, pos, '+', Token::TOKEN_OP_PLUS_PLUS))
+					if (testNextCharacter(cursor, end, pos, '+', Token::TOKEN_OP_PLUS_PLUS))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_ADD, pos);
 					break;
 
 				case '-':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_NEG_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_NEG_EQUAL))
 						break;
-					if (testNextCharacter(source, pos, '-', Token::TOKEN_OP_MINUS_MINUS))
+					if (testNextCharacter(cursor, end, pos, '-', Token::TOKEN_OP_MINUS_MINUS))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_NEG, pos);
 					break;
 
 				case '*':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_MULT_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_MULT_EQUAL))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_MULT, pos);
 					break;
 
 				case '/':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_DIV_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_DIV_EQUAL))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_DIV, pos);
 					break;
 
 				case '%':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_MOD_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_MOD_EQUAL))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_MOD, pos);
 					break;
 
 				case '|':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_BIT_OR_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_BIT_OR_EQUAL))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_BIT_OR, pos);
 					break;
 
 				case '^':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_BIT_XOR_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_BIT_XOR_EQUAL))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_BIT_XOR, pos);
 					break;
 
 				case '&':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_BIT_AND_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_BIT_AND_EQUAL))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_BIT_AND, pos);
 					break;
@@ -322,46 +352,46 @@ namespace Aseba
 					break;
 
 				case '!':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_NOT_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_NOT_EQUAL))
 						break;
 					throw TranslatableError(pos, ERROR_SYNTAX);
 					break;
 
 				case '=':
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_EQUAL))
 						break;
 					tokens.emplace_back(Token::TOKEN_ASSIGN, pos);
 					break;
 
 				// cases that require two characters look-ahead
 				case '<':
-					if (source.peek() == '<')
+					if (peek() == '<')
 					{
 						// <<
-						getNextCharacter(source, pos);
-						if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_SHIFT_LEFT_EQUAL))
+						getNextCharacter(cursor, pos);
+						if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_SHIFT_LEFT_EQUAL))
 							break;
 						tokens.emplace_back(Token::TOKEN_OP_SHIFT_LEFT, pos);
 						break;
 					}
 					// <
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_SMALLER_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_SMALLER_EQUAL))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_SMALLER, pos);
 					break;
 
 				case '>':
-					if (source.peek() == '>')
+					if (peek() == '>')
 					{
 						// >>
-						getNextCharacter(source, pos);
-						if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_SHIFT_RIGHT_EQUAL))
+						getNextCharacter(cursor, pos);
+						if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_SHIFT_RIGHT_EQUAL))
 							break;
 						tokens.emplace_back(Token::TOKEN_OP_SHIFT_RIGHT, pos);
 						break;
 					}
 					// >
-					if (testNextCharacter(source, pos, '=', Token::TOKEN_OP_BIGGER_EQUAL))
+					if (testNextCharacter(cursor, end, pos, '=', Token::TOKEN_OP_BIGGER_EQUAL))
 						break;
 					tokens.emplace_back(Token::TOKEN_OP_BIGGER, pos);
 					break;
@@ -370,108 +400,69 @@ namespace Aseba
 				default:
 				{
 					// check first character
-					if (!std::iswalnum(c) && (c != '_'))
+					if ((c == '.') || !isIdentifierCharacter(c))
 						throw TranslatableError(pos, ERROR_INVALID_IDENTIFIER).arg((unsigned)c, 0, 16);
 
-					// get a string
-					std::wstring s;
-					s += c;
-					wchar_t nextC = source.peek();
-					int posIncrement = 0;
-					while ((source.good()) && (std::iswalnum(nextC) || (nextC == '_') || (nextC == '.')))
-					{
-						s += nextC;
-						source.get();
-						posIncrement++;
-						nextC = source.peek();
-					}
+					// get a word from the buffer, without copying it
+					const wchar_t* wordBegin(cursor - 1);
+					while ((cursor != end) && isIdentifierCharacter(*cursor))
+						++cursor;
+					const wchar_t* wordEnd(cursor);
+					const size_t length(wordEnd - wordBegin);
+					const int posIncrement(length - 1);
 
-					// we now have a string, let's check what it is
-					if (std::iswdigit(s[0]))
+					// we now have a word, let's check what it is
+					if (std::iswdigit(wordBegin[0]))
 					{
 						// check if hex or binary
-						if ((s.length() > 1) && (s[0] == '0') && (!std::iswdigit(s[1])))
+						long int decode;
+						bool wasUnsigned = false;
+						if ((length > 1) && (wordBegin[0] == '0') && (!std::iswdigit(wordBegin[1])))
 						{
 							// check if we have a valid number
-							if (s[1] == 'x')
+							if (wordBegin[1] == 'x')
 							{
-								for (unsigned i = 2; i < s.size(); i++)
-									if (!std::iswxdigit(s[i]))
+								for (const wchar_t* it = wordBegin + 2; it != wordEnd; ++it)
+									if (!std::iswxdigit(*it))
 										throw TranslatableError(pos, ERROR_INVALID_HEXA_NUMBER);
+								decode = decodeDigits(wordBegin + 2, wordEnd, 16);
 							}
-							else if (s[1] == 'b')
+							else if (wordBegin[1] == 'b')
 							{
-								for (unsigned i = 2; i < s.size(); i++)
-									if ((s[i] != '0') && (s[i] != '1'))
+								for (const wchar_t* it = wordBegin + 2; it != wordEnd; ++it)
+									if ((*it != '0') && (*it != '1'))
 										throw TranslatableError(pos, ERROR_INVALID_BINARY_NUMBER);
+								decode = decodeDigits(wordBegin + 2, wordEnd, 2);
 							}
 							else
 								throw TranslatableError(pos, ERROR_NUMBER_INVALID_BASE);
-
+							wasUnsigned = true;
 						}
 						else
 						{
 							// check if we have a valid number
-							for (unsigned i = 1; i < s.size(); i++)
-								if (!std::iswdigit(s[i]))
+							for (const wchar_t* it = wordBegin + 1; it != wordEnd; ++it)
+								if (!std::iswdigit(*it))
 									throw TranslatableError(pos, ERROR_IN_NUMBER);
+							decode = decodeDigits(wordBegin, wordEnd, 10);
 						}
-						tokens.emplace_back(Token::TOKEN_INT_LITERAL, pos, s);
+
+						// all values are assumed to be signed 16-bits
+						if (decode >= 65536)
+							throw TranslatableError(pos, ERROR_INT16_OUT_OF_RANGE).arg(decode);
+						if (wasUnsigned && decode > 32767)
+							decode -= 65536;
+						tokens.emplace_back(Token::TOKEN_INT_LITERAL, pos, nullptr, int(decode));
 					}
 					else
 					{
-						// check if it is a known keyword
-						// FIXME: clean-up that with a table
-						if (s == L"when")
-							tokens.emplace_back(Token::TOKEN_STR_when, pos);
-						else if (s == L"emit")
-							tokens.emplace_back(Token::TOKEN_STR_emit, pos);
-						else if (s == L"_emit")
-							tokens.emplace_back(Token::TOKEN_STR_hidden_emit, pos);
-						else if (s == L"for")
-							tokens.emplace_back(Token::TOKEN_STR_for, pos);
-						else if (s == L"in")
-							tokens.emplace_back(Token::TOKEN_STR_in, pos);
-						else if (s == L"step")
-							tokens.emplace_back(Token::TOKEN_STR_step, pos);
-						else if (s == L"while")
-							tokens.emplace_back(Token::TOKEN_STR_while, pos);
-						else if (s == L"do")
-							tokens.emplace_back(Token::TOKEN_STR_do, pos);
-						else if (s == L"if")
-							tokens.emplace_back(Token::TOKEN_STR_if, pos);
-						else if (s == L"then")
-							tokens.emplace_back(Token::TOKEN_STR_then, pos);
-						else if (s == L"else")
-							tokens.emplace_back(Token::TOKEN_STR_else, pos);
-						else if (s == L"elseif")
-							tokens.emplace_back(Token::TOKEN_STR_elseif, pos);
-						else if (s == L"end")
-							tokens.emplace_back(Token::TOKEN_STR_end, pos);
-						else if (s == L"var")
-							tokens.emplace_back(Token::TOKEN_STR_var, pos);
-						else if (s == L"const")
-							tokens.emplace_back(Token::TOKEN_STR_const, pos);
-						else if (s == L"call")
-							tokens.emplace_back(Token::TOKEN_STR_call, pos);
-						else if (s == L"sub")
-							tokens.emplace_back(Token::TOKEN_STR_sub, pos);
-						else if (s == L"callsub")
-							tokens.emplace_back(Token::TOKEN_STR_callsub, pos);
-						else if (s == L"onevent")
-							tokens.emplace_back(Token::TOKEN_STR_onevent, pos);
-						else if (s == L"abs")
-							tokens.emplace_back(Token::TOKEN_STR_abs, pos);
-						else if (s == L"return")
-							tokens.emplace_back(Token::TOKEN_STR_return, pos);
-						else if (s == L"or")
-							tokens.emplace_back(Token::TOKEN_OP_OR, pos);
-						else if (s == L"and")
-							tokens.emplace_back(Token::TOKEN_OP_AND, pos);
-						else if (s == L"not")
-							tokens.emplace_back(Token::TOKEN_OP_NOT, pos);
+						// check if it is a known keyword, otherwise it is an identifier
+						identifierScratch.assign(wordBegin, wordEnd);
+						const auto keywordIt(keywords().find(identifierScratch));
+						if (keywordIt != keywords().end())
+							tokens.emplace_back(keywordIt->second, pos);
 						else
-							tokens.emplace_back(Token::TOKEN_STRING_LITERAL, pos, s);
+							tokens.emplace_back(Token::TOKEN_STRING_LITERAL, pos, &*identifiers.insert(identifierScratch).first);
 					}
 
 					pos.column += posIncrement;
@@ -479,24 +470,24 @@ namespace Aseba
 				}
 				break;
 			} // switch (c)
-		} // while (source.good())
+		} // while (cursor != end)
 
 		tokens.emplace_back(Token::TOKEN_END_OF_STREAM, pos);
 	}
 
-	wchar_t Compiler::getNextCharacter(std::wistream &source, SourcePos &pos)
+	wchar_t Compiler::getNextCharacter(const wchar_t*& cursor, SourcePos &pos)
 	{
 		pos.column++;
 		pos.character++;
-		return source.get();
+		return *cursor++;
 	}
 
-	bool Compiler::testNextCharacter(std::wistream &source, SourcePos &pos, wchar_t test, Token::Type tokenIfTrue)
+	bool Compiler::testNextCharacter(const wchar_t*& cursor, const wchar_t* end, SourcePos &pos, wchar_t test, Token::Type tokenIfTrue)
 	{
-		if ((int)source.peek() == int(test))
+		if ((cursor != end) && (*cursor == test))
 		{
 			tokens.emplace_back(tokenIfTrue, pos);
-			getNextCharacter(source, pos);
+			getNextCharacter(cursor, pos);
 			return true;
 		}
 		return false;
@@ -512,56 +503,6 @@ namespace Aseba
 	//! Return whether a string is a language keyword
 	bool Compiler::isKeyword(const std::wstring& s)
 	{
-		// FIXME: clean-up that with a table
-		if (s == L"when")
-			return true;
-		else if (s == L"emit")
-			return true;
-		else if (s == L"_emit")
-			return true;
-		else if (s == L"for")
-			return true;
-		else if (s == L"in")
-			return true;
-		else if (s == L"step")
-			return true;
-		else if (s == L"while")
-			return true;
-		else if (s == L"do")
-			return true;
-		else if (s == L"if")
-			return true;
-		else if (s == L"then")
-			return true;
-		else if (s == L"else")
-			return true;
-		else if (s == L"elseif")
-			return true;
-		else if (s == L"end")
-			return true;
-		else if (s == L"var")
-			return true;
-		else if (s == L"const")
-			return true;
-		else if (s == L"call")
-			return true;
-		else if (s == L"sub")
-			return true;
-		else if (s == L"callsub")
-			return true;
-		else if (s == L"onevent")
-			return true;
-		else if (s == L"abs")
-			return true;
-		else if (s == L"return")
-			return true;
-		else if (s == L"or")
-			return true;
-		else if (s == L"and")
-			return true;
-		else if (s == L"not")
-			return true;
-		else
-			return false;
+		return keywords().find(s) != keywords().end();
 	}
 } // namespace Aseba
@@ -103,7 +103,7 @@ namespace Aseba
 	unsigned Compiler::expectPositiveConstant() const
 	{
 		expect(Token::TOKEN_STRING_LITERAL);
-		const std::wstring name = tokens.front().sValue;
+		const std::wstring name = tokens.front().sValue();
 		const SourcePos pos = tokens.front().pos;
 		const ConstantsMap::const_iterator constIt(findConstant(name, pos));
 
@@ -111,7 +111,7 @@ namespace Aseba
 		if (value < 0 || value > 32767)
 			throw TranslatableError(tokens.front().pos,
 				ERROR_PCONSTANT_OUT_OF_RANGE)
-					.arg(tokens.front().sValue)
+					.arg(tokens.front().sValue())
 					.arg(value);
 		return value;
 	}
@@ -120,7 +120,7 @@ namespace Aseba
 	int Compiler::expectConstant() const
 	{
 		expect(Token::TOKEN_STRING_LITERAL);
-		const std::wstring name = tokens.front().sValue;
+		const std::wstring name = tokens.front().sValue();
 		const SourcePos pos = tokens.front().pos;
 		const ConstantsMap::const_iterator constIt(findConstant(name, pos));
 
@@ -128,7 +128,7 @@ namespace Aseba
 		if (value < -32768 || value > 32767)
 			throw TranslatableError(tokens.front().pos,
 				ERROR_CONSTANT_OUT_OF_RANGE)
-					.arg(tokens.front().sValue)
+					.arg(tokens.front().sValue())
 					.arg(value);
 		return value;
 	}
@@ -177,7 +177,7 @@ namespace Aseba
 
 		expect(Token::TOKEN_STRING_LITERAL);
 
-		const std::wstring & name = tokens.front().sValue;
+		const std::wstring & name = tokens.front().sValue();
 		const SourcePos pos = tokens.front().pos;
 		const EventsMap::const_iterator eventIt(findGlobalEvent(name, pos));
 
@@ -191,7 +191,7 @@ namespace Aseba
 
 		expect(Token::TOKEN_STRING_LITERAL);
 
-		const std::wstring & name = tokens.front().sValue;
+		const std::wstring & name = tokens.front().sValue();
 		const SourcePos pos = tokens.front().pos;
 		const EventsMap::const_iterator eventIt(findAnyEvent(name, pos));
 
@@ -201,6 +201,9 @@ namespace Aseba
 	//! Return the name of an event given its identifier
 	std::wstring Compiler::eventName(unsigned eventId) const
 	{
+		if (eventId == ASEBA_EVENT_INIT)
+			return L"init";
+
 		// search for global
 		if (eventId < commonDefinitions->events.size())
 			return commonDefinitions->events[eventId].name;
@@ -254,6 +257,7 @@ namespace Aseba
 		unsigned endOfMemory = targetDescription->variablesSize - endVariableIndex;
 		unsigned varAddr = endOfMemory - size;
 		endVariableIndex += size;
+		temporaryMemoryPeak = std::max(temporaryMemoryPeak, endVariableIndex);
 
 		// free space check
 		if (freeVariableIndex + endVariableIndex > targetDescription->variablesSize)
@@ -264,14 +268,12 @@ namespace Aseba
 
 	AssignmentNode* Compiler::allocateTemporaryVariable(const SourcePos varPos, Node* rValue)
 	{
-		static unsigned uid = 0;
-
 		// allocate the temporary variable
 		const unsigned size = rValue->getVectorSize();
 		const unsigned addr = allocateTemporaryMemory(varPos, size);
 
 		// create assignment
-		MemoryVectorNode* lValue = new MemoryVectorNode(varPos, addr, size, WFormatableString(L"temp%0").arg(uid++));
+		MemoryVectorNode* lValue = new MemoryVectorNode(varPos, addr, size, WFormatableString(L"temp%0").arg(temporaryVariableUid++));
 		return new AssignmentNode(varPos, lValue, rValue);
 	}
 
@@ -309,6 +311,9 @@ namespace Aseba
 		// reset temporary variables
 		freeTemporaryMemory();
 
+		// large programs take a while to parse, let a newer check abort this one
+		throwIfCancelled();
+
 		switch (tokens.front())
 		{
 			case Token::TOKEN_STR_var: throw TranslatableError(tokens.front().pos, ERROR_MISPLACED_VARDEF);
@@ -354,7 +359,7 @@ namespace Aseba
 			throw TranslatableError(tokens.front().pos,
 				ERROR_EXPECTING_IDENTIFIER).arg(tokens.front().toWString());
 
-		std::wstring constName = tokens.front().sValue;
+		std::wstring constName = tokens.front().sValue();
 		SourcePos constPos = tokens.front().pos;
 		tokens.pop_front();
 
@@ -371,6 +376,7 @@ namespace Aseba
 
 		// save constant
 		constantsMap[constName] = constValue;
+		programConstants.push_back(constName);
 	}
 
 	//! Parse "var def" grammar element.
@@ -384,7 +390,7 @@ namespace Aseba
 				ERROR_EXPECTING_IDENTIFIER).arg(tokens.front().toWString());
 
 		// save variable
-		std::wstring varName = tokens.front().sValue;
+		std::wstring varName = tokens.front().sValue();
 		SourcePos varPos = tokens.front().pos;
 		unsigned varSize = Node::E_NOVAL;
 		unsigned varAddr = freeVariableIndex;
@@ -419,6 +425,7 @@ namespace Aseba
 
 		// save variable
 		variablesMap[varName] = std::make_pair(varAddr, varSize);
+		programVariables.push_back(varName);
 		freeVariableIndex += varSize;
 
 		// check space
@@ -659,6 +666,11 @@ namespace Aseba
 
 			// create while and condition
 			auto* whileNode = new WhileNode(whilePos);
+			// the counter is a 16-bit word, if stepping past the end overflows it, it wraps and the loop never terminates
+			const int iterations((rangeEndIndex - rangeStartIndex) / step + 1);
+			const int afterLastIndex(rangeStartIndex + iterations * step);
+			if (afterLastIndex >= -32768 && afterLastIndex <= 32767)
+				whileNode->iterations = iterations;
 			blockNode->children.push_back(whileNode);
 			auto* comparisonNode = new BinaryArithmeticNode(whilePos);
 			whileNode->children.push_back(comparisonNode);
@@ -793,7 +805,7 @@ namespace Aseba
 
 		expect(Token::TOKEN_STRING_LITERAL);
 
-		const std::wstring& name = tokens.front().sValue;
+		const std::wstring& name = tokens.front().sValue();
 		const SubroutineReverseTable::const_iterator it = subroutineReverseTable.find(name);
 		if (it != subroutineReverseTable.end())
 			throw TranslatableError(tokens.front().pos, ERROR_SUBROUTINE_ALREADY_DEF).arg(name);
@@ -815,7 +827,7 @@ namespace Aseba
 
 		expect(Token::TOKEN_STRING_LITERAL);
 
-		const std::wstring name = tokens.front().sValue;
+		const std::wstring name = tokens.front().sValue();
 
 		tokens.pop_front();
 
@@ -1094,7 +1106,6 @@ namespace Aseba
 					// immediate -> negate it, then perform again the switch
 					tokens.pop_front();
 					tokens[0].iValue *= -1;
-					tokens[0].sValue = L"-" + tokens[0].sValue;
 					return parseUnaryExpression();	// recursive call
 				}
 				else {
@@ -1191,7 +1202,7 @@ namespace Aseba
 	Node* Compiler::parseConstantAndVariable()
 	{
 		expect(Token::TOKEN_STRING_LITERAL);
-		std::wstring varName = tokens.front().sValue;
+		std::wstring varName = tokens.front().sValue();
 		if (constantExists(varName))
 		{
 			std::unique_ptr<TupleVectorNode> arrayCtor(new TupleVectorNode(tokens.front().pos));
@@ -1208,7 +1219,7 @@ namespace Aseba
 	MemoryVectorNode* Compiler::parseVariable()
 	{
 		expect(Token::TOKEN_STRING_LITERAL);
-		std::wstring varName = tokens.front().sValue;
+		std::wstring varName = tokens.front().sValue();
 		SourcePos varPos = tokens.front().pos;
 		auto varIt(findVariable(varName, varPos));
 
@@ -1381,7 +1392,7 @@ namespace Aseba
 
 		expect(Token::TOKEN_STRING_LITERAL);
 
-		std::wstring funcName = tokens.front().sValue;
+		std::wstring funcName = tokens.front().sValue();
 		auto funcIt(findFunction(funcName, pos));
 
 		const TargetDescription::NativeFunction &function = targetDescription->nativeFunctions[funcIt->second];
@@ -24,6 +24,8 @@
 #include <cstdlib>
 #include <algorithm>
 #include <iterator>
+#include <utility>
+#include <vector>
 
 namespace Aseba
 {
@@ -49,13 +51,159 @@ namespace Aseba
 		}
 	}
 
+	//! Return whether the operands of op can be exchanged, possibly by mirroring op
+	static bool isCommutative(AsebaBinaryOperator op)
+	{
+		switch (op)
+		{
+			case ASEBA_OP_ADD:
+			case ASEBA_OP_MULT:
+			case ASEBA_OP_BIT_OR:
+			case ASEBA_OP_BIT_XOR:
+			case ASEBA_OP_BIT_AND:
+			case ASEBA_OP_EQUAL:
+			case ASEBA_OP_NOT_EQUAL:
+			case ASEBA_OP_BIGGER_THAN:
+			case ASEBA_OP_BIGGER_EQUAL_THAN:
+			case ASEBA_OP_SMALLER_THAN:
+			case ASEBA_OP_SMALLER_EQUAL_THAN:
+			case ASEBA_OP_OR:
+			case ASEBA_OP_AND:
+			return true;
+
+			default:
+			return false;
+		}
+	}
+
+	//! Return whether chains of op can be evaluated in any grouping, as in 16-bit wrap-around arithmetic
+	static bool isAssociative(AsebaBinaryOperator op)
+	{
+		switch (op)
+		{
+			case ASEBA_OP_ADD:
+			case ASEBA_OP_MULT:
+			case ASEBA_OP_BIT_OR:
+			case ASEBA_OP_BIT_XOR:
+			case ASEBA_OP_BIT_AND:
+			case ASEBA_OP_OR:
+			case ASEBA_OP_AND:
+			return true;
+
+			default:
+			return false;
+		}
+	}
+
+	//! Return the operator giving the same result as op when its operands are exchanged
+	static AsebaBinaryOperator mirroredOperator(AsebaBinaryOperator op)
+	{
+		switch (op)
+		{
+			case ASEBA_OP_BIGGER_THAN: return ASEBA_OP_SMALLER_THAN;
+			case ASEBA_OP_BIGGER_EQUAL_THAN: return ASEBA_OP_SMALLER_EQUAL_THAN;
+			case ASEBA_OP_SMALLER_THAN: return ASEBA_OP_BIGGER_THAN;
+			case ASEBA_OP_SMALLER_EQUAL_THAN: return ASEBA_OP_BIGGER_EQUAL_THAN;
+			default: return op;
+		}
+	}
+
+	//! An operand of a binary operation chain, with the stack depth needed to evaluate it
+	struct ScheduledOperand
+	{
+		const Node* node;
+		unsigned stackDepth;
+	};
+	using ScheduledOperands = std::vector<ScheduledOperand>;
+
+	//! Collect the operands of a chain of op, such as a + (b + c) + d
+	static void collectChainOperands(const Node* node, AsebaBinaryOperator op, ScheduledOperands& operands)
+	{
+		const auto* binary(dynamic_cast<const BinaryArithmeticNode*>(node));
+		if (binary && binary->op == op)
+		{
+			collectChainOperands(binary->children[0], op, operands);
+			collectChainOperands(binary->children[1], op, operands);
+		}
+		else
+			operands.push_back({node, node->getStackDepth()});
+	}
+
+	//! Return the operands of a binary operation in the order using the least stack, mirroring op if they are exchanged.
+	//! Commutative operands are exchanged when the right one is deeper (Sethi-Ullman ordering);
+	//! associative chains are flattened and evaluated deepest operand first.
+	static ScheduledOperands scheduleOperands(const Node* left, const Node* right, AsebaBinaryOperator& op)
+	{
+		ScheduledOperands operands;
+		if (isAssociative(op))
+		{
+			collectChainOperands(left, op, operands);
+			collectChainOperands(right, op, operands);
+			// stable, so that a chain of equally deep operands keeps its source order
+			std::stable_sort(operands.begin(), operands.end(),
+				[](const ScheduledOperand& a, const ScheduledOperand& b) { return a.stackDepth > b.stackDepth; });
+			return operands;
+		}
+
+		operands.push_back({left, left->getStackDepth()});
+		operands.push_back({right, right->getStackDepth()});
+		if (isCommutative(op) && operands[1].stackDepth > operands[0].stackDepth)
+		{
+			std::swap(operands[0], operands[1]);
+			op = mirroredOperator(op);
+		}
+		return operands;
+	}
+
+	//! Return the stack depth needed to evaluate operands in order, applying a binary operator after the first one
+	static unsigned scheduledStackDepth(const ScheduledOperands& operands)
+	{
+		unsigned stackDepth(operands[0].stackDepth);
+		for (size_t i = 1; i < operands.size(); ++i)
+			stackDepth = std::max(stackDepth, operands[i].stackDepth + 1);
+		return stackDepth;
+	}
+
+	//! Emit code evaluating operands in order, combining them with op
+	static void emitScheduledOperands(const ScheduledOperands& operands, AsebaBinaryOperator op, const SourcePos& sourcePos, PreLinkBytecode& bytecodes)
+	{
+		operands[0].node->emit(bytecodes);
+		for (size_t i = 1; i < operands.size(); ++i)
+		{
+			operands[i].node->emit(bytecodes);
+			if (i + 1 < operands.size())
+				bytecodes.current->push_back(BytecodeElement(AsebaBytecodeFromId(ASEBA_BYTECODE_BINARY_ARITHMETIC) | op, sourcePos.row));
+		}
+	}
+
 	//! Add init event and point to currentBytecode it
 	PreLinkBytecode::PreLinkBytecode()
 	{
 		events[ASEBA_EVENT_INIT] = BytecodeVector();
 		current = &events[ASEBA_EVENT_INIT];
+		currentCalls = &eventsCalls[ASEBA_EVENT_INIT];
 	};
 
+	//! Record the bound of the loop at pos, an iterations count of 0 meaning unbounded.
+	//! Loops sharing a line get the loosest bound, as they cannot be told apart in the bytecode.
+	void PreLinkBytecode::addLoopBound(const SourcePos& pos, unsigned iterations, unsigned counterAddr)
+	{
+		auto it(loopBounds.find(pos.row));
+		if (it == loopBounds.end())
+		{
+			loopBounds.emplace(pos.row, LoopBound{pos, iterations, counterAddr});
+			return;
+		}
+		LoopBound& bound(it->second);
+		if (bound.iterations == 0 || iterations == 0 || bound.counterAddr != counterAddr)
+		{
+			bound.pos = pos;
+			bound.iterations = 0;
+		}
+		else
+			bound.iterations = std::max(bound.iterations, iterations);
+	}
+
 	//! Fixup prelinked bytecodes by making sure that each vector is closed correctly,
 	//! i.e. with a STOP for events and a RET for subroutines
 	void PreLinkBytecode::fixup(const Compiler::SubroutineTable &subroutineTable)
@@ -146,6 +294,15 @@ namespace Aseba
 		}
 	}
 
+	unsigned AssignmentNode::getStackDepth() const
+	{
+		// the value stays on the stack while the index of an array write is computed
+		unsigned stackDepth = 0;
+		for (size_t i = 0; i < children.size(); i += 2)
+			stackDepth = std::max(stackDepth, std::max(children[i+1]->getStackDepth(), children[i+0]->getStackDepth() + 1));
+		return stackDepth;
+	}
+
 
 	void IfWhenNode::emit(PreLinkBytecode& bytecodes) const
 	{
@@ -177,12 +334,16 @@ namespace Aseba
 		// save real current bytecode
 		BytecodeVector* currentBytecode = bytecodes.current;
 
+		// evaluate the deepest expression first
+		AsebaBinaryOperator scheduledOp(op);
+		const ScheduledOperands operands(scheduleOperands(children[0], children[1], scheduledOp));
+
 		// generate code for left expression
 		bytecodes.current = &ble;
-		children[0]->emit(bytecodes);
+		operands[0].node->emit(bytecodes);
 		// generate code for right expression
 		bytecodes.current = &bre;
-		children[1]->emit(bytecodes);
+		operands[1].node->emit(bytecodes);
 		// generate code for true block
 		bytecodes.current = &btb;
 		children[2]->emit(bytecodes);
@@ -200,7 +361,7 @@ namespace Aseba
 		std::copy(bre.begin(), bre.end(), std::back_inserter(*bytecodes.current));
 
 		bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_CONDITIONAL_BRANCH);
-		bytecode |= op;
+		bytecode |= scheduledOp;
 		bytecode |= edgeSensitive ? (1 << ASEBA_IF_IS_WHEN_BIT) : 0;
 		bytecodes.current->push_back(BytecodeElement(bytecode, sourcePos.row));
 
@@ -230,7 +391,8 @@ namespace Aseba
 
 	unsigned FoldedIfWhenNode::getStackDepth() const
 	{
-		unsigned stackDepth = children[0]->getStackDepth() + children[1]->getStackDepth();
+		AsebaBinaryOperator scheduledOp(op);
+		unsigned stackDepth = scheduledStackDepth(scheduleOperands(children[0], children[1], scheduledOp));
 		stackDepth = std::max(stackDepth, children[2]->getStackDepth());
 		if (children.size() == 4)
 			stackDepth = std::max(stackDepth, children[3]->getStackDepth());
@@ -266,12 +428,16 @@ namespace Aseba
 		// save real current bytecode
 		BytecodeVector* currentBytecode = bytecodes.current;
 
+		// evaluate the deepest expression first
+		AsebaBinaryOperator scheduledOp(op);
+		const ScheduledOperands operands(scheduleOperands(children[0], children[1], scheduledOp));
+
 		// generate code for left expression
 		bytecodes.current = &ble;
-		children[0]->emit(bytecodes);
+		operands[0].node->emit(bytecodes);
 		// generate code for right expression
 		bytecodes.current = &bre;
-		children[1]->emit(bytecodes);
+		operands[1].node->emit(bytecodes);
 		// generate code for block
 		bytecodes.current = &bb;
 		children[2]->emit(bytecodes);
@@ -284,7 +450,7 @@ namespace Aseba
 
 		std::copy(bre.begin(), bre.end(), std::back_inserter(*bytecodes.current));
 
-		bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_CONDITIONAL_BRANCH) | op;
+		bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_CONDITIONAL_BRANCH) | scheduledOp;
 		bytecodes.current->push_back(BytecodeElement(bytecode, sourcePos.row));
 		bytecodes.current->push_back(BytecodeElement(2 + bb.size() + 1, sourcePos.row));
 
@@ -293,11 +459,19 @@ namespace Aseba
 		bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_JUMP);
 		bytecode |= ((unsigned)(-(int)(ble.size() + bre.size() + bb.size() + 2))) & 0x0fff;
 		bytecodes.current->push_back(BytecodeElement(bytecode, sourcePos.row));
+
+		// loops over a constant range are bounded as long as their counter is only incremented
+		const auto* counter(dynamic_cast<const LoadNode*>(children[0]));
+		if (iterations && counter)
+			bytecodes.addLoopBound(sourcePos, iterations, counter->varAddr);
+		else
+			bytecodes.addLoopBound(sourcePos, 0, 0);
 	}
 
 	unsigned FoldedWhileNode::getStackDepth() const
 	{
-		unsigned stackDepth = children[0]->getStackDepth() + children[1]->getStackDepth();
+		AsebaBinaryOperator scheduledOp(op);
+		unsigned stackDepth = scheduledStackDepth(scheduleOperands(children[0], children[1], scheduledOp));
 		stackDepth = std::max(stackDepth, children[2]->getStackDepth());
 		return stackDepth;
 	}
@@ -311,6 +485,7 @@ namespace Aseba
 		// create new bytecode for event
 		bytecodes.events[eventId] = BytecodeVector();
 		bytecodes.current = &bytecodes.events[eventId];
+		bytecodes.currentCalls = &bytecodes.eventsCalls[eventId];
 	}
 
 
@@ -335,6 +510,7 @@ namespace Aseba
 		// create new bytecode for subroutine
 		bytecodes.subroutines[subroutineId] = BytecodeVector();
 		bytecodes.current = &bytecodes.subroutines[subroutineId];
+		bytecodes.currentCalls = &bytecodes.subroutinesCalls[subroutineId];
 	}
 
 
@@ -343,20 +519,25 @@ namespace Aseba
 		unsigned short bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_SUB_CALL);
 		bytecode |= subroutineId;
 		bytecodes.current->push_back(BytecodeElement(bytecode, sourcePos.row));
+
+		// record the edge of the call graph, for stack analysis
+		bytecodes.currentCalls->emplace(subroutineId, sourcePos);
 	}
 
 
 	void BinaryArithmeticNode::emit(PreLinkBytecode& bytecodes) const
 	{
-		children[0]->emit(bytecodes);
-		children[1]->emit(bytecodes);
-		unsigned short bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_BINARY_ARITHMETIC) | op;
+		AsebaBinaryOperator scheduledOp(op);
+		const ScheduledOperands operands(scheduleOperands(children[0], children[1], scheduledOp));
+		emitScheduledOperands(operands, scheduledOp, sourcePos, bytecodes);
+		unsigned short bytecode = AsebaBytecodeFromId(ASEBA_BYTECODE_BINARY_ARITHMETIC) | scheduledOp;
 		bytecodes.current->push_back(BytecodeElement(bytecode, sourcePos.row));
 	}
 
 	unsigned BinaryArithmeticNode::getStackDepth() const
 	{
-		return children[0]->getStackDepth() + children[1]->getStackDepth();
+		AsebaBinaryOperator scheduledOp(op);
+		return scheduledStackDepth(scheduleOperands(children[0], children[1], scheduledOp));
 	}
 
 
@@ -490,7 +671,7 @@ namespace Aseba
 	{
 		unsigned stackDepth = 0;
 		for (size_t i = 0; i < children.size(); i++)
-			stackDepth = std::max(stackDepth, unsigned(templateArgs.size()+i)+children[i]->getStackDepth());
+			stackDepth = std::max(stackDepth, unsigned(templateArgs.size()+children.size()-1-i)+children[i]->getStackDepth());
 
 		return stackDepth;
 	}
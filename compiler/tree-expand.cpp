@@ -26,6 +26,7 @@
 #include <cassert>
 #include <memory>
 #include <iostream>
+#include <vector>
 
 namespace Aseba
 {
@@ -208,8 +209,310 @@ namespace Aseba
 		return newMe.release();
 	}
 
-	//! Assignment between vectors is expanded into multiple scalar assignments
+	/*
+	 * helper functions to generate element-wise vector assignments either unrolled,
+	 * as a bytecode loop, or as a call to a native function of the target
+	 */
+
+	//! An element-wise vector assignment: dest = src1, dest = value, or dest = src1 op src2
+	struct VectorOperation
+	{
+		enum Kind
+		{
+			COPY = 0,
+			FILL,
+			BINARY
+		} kind;
+		AsebaBinaryOperator op; //!< operator if BINARY
+		unsigned size; //!< number of elements
+		const MemoryVectorNode* dest; //!< destination
+		const MemoryVectorNode* src1; //!< first operand if COPY or BINARY
+		const MemoryVectorNode* src2; //!< second operand if BINARY
+		int value; //!< value if FILL
+	};
+
+	//! Ways to generate a vector operation, ordered by preference in case of equal cost
+	enum VectorCodeGeneration
+	{
+		VECTOR_UNROLLED = 0,
+		VECTOR_NATIVE,
+		VECTOR_LOOP
+	};
+
+	//! Size in words and number of executed instructions of some code
+	struct CodeCost
+	{
+		unsigned words;
+		unsigned instructions;
+	};
+
+	//! Return the number of words of an immediate
+	static unsigned immediateWords(int value)
+	{
+		return ((abs(value) >> 11) == 0) ? 1 : 2;
+	}
+
+	//! Return whether node is a memory range known at compile time that, compared to dest, is either the same or disjoint
+	static const MemoryVectorNode* elementWiseOperand(const Node* node, const MemoryVectorNode* dest)
+	{
+		const auto* operand = dynamic_cast<const MemoryVectorNode*>(node);
+		if (!operand || !operand->isAddressStatic())
+			return nullptr;
+		const unsigned size(dest->getVectorSize());
+		const unsigned addr(operand->getVectorAddr());
+		const unsigned destAddr(dest->getVectorAddr());
+		if (addr == destAddr || addr + size <= destAddr || destAddr + size <= addr)
+			return operand;
+		return nullptr;
+	}
+
+	//! Append the values of a tuple made only of immediates, possibly nested, return false otherwise
+	static bool immediateTupleValues(const Node* node, std::vector<int>& values)
+	{
+		const auto* immediate = dynamic_cast<const ImmediateNode*>(node);
+		if (immediate)
+		{
+			values.push_back(immediate->value);
+			return true;
+		}
+		const auto* tuple = dynamic_cast<const TupleVectorNode*>(node);
+		if (!tuple)
+			return false;
+		for (const auto* child : tuple->children)
+			if (!immediateTupleValues(child, values))
+				return false;
+		return true;
+	}
+
+	//! Return whether the assignment of right to left is an element-wise operation supported by a loop or a native function
+	static bool matchVectorOperation(const MemoryVectorNode* left, const Node* right, VectorOperation& operation)
+	{
+		operation.size = left->getVectorSize();
+		if (!left->isAddressStatic() || operation.size < 2)
+			return false;
+		operation.dest = left;
+		operation.src1 = nullptr;
+		operation.src2 = nullptr;
+
+		// dest = src
+		operation.src1 = elementWiseOperand(right, left);
+		if (operation.src1)
+		{
+			operation.kind = VectorOperation::COPY;
+			return true;
+		}
+
+		// dest = [value, value, ...]
+		std::vector<int> values;
+		if (immediateTupleValues(right, values) && values.size() == operation.size)
+		{
+			operation.kind = VectorOperation::FILL;
+			operation.value = values[0];
+			for (unsigned i = 1; i < operation.size; ++i)
+				if (values[i] != operation.value)
+					return false;
+			return true;
+		}
+
+		// dest = src1 op src2
+		const auto* binary = dynamic_cast<const BinaryArithmeticNode*>(right);
+		if (binary && (binary->op == ASEBA_OP_ADD || binary->op == ASEBA_OP_SUB || binary->op == ASEBA_OP_MULT))
+		{
+			operation.kind = VectorOperation::BINARY;
+			operation.op = binary->op;
+			operation.src1 = elementWiseOperand(binary->children[0], left);
+			operation.src2 = elementWiseOperand(binary->children[1], left);
+			return operation.src1 && operation.src2;
+		}
+
+		return false;
+	}
+
+	//! Return the name of the native function implementing operation
+	static std::wstring vectorOperationNativeName(const VectorOperation& operation)
+	{
+		switch (operation.kind)
+		{
+			case VectorOperation::COPY: return L"math.copy";
+			case VectorOperation::FILL: return L"math.fill";
+			default:
+			switch (operation.op)
+			{
+				case ASEBA_OP_ADD: return L"math.add";
+				case ASEBA_OP_SUB: return L"math.sub";
+				default: return L"math.mul";
+			}
+		}
+	}
+
+	//! Return the cost of generating operation in a given way
+	static CodeCost vectorOperationCost(const VectorOperation& operation, VectorCodeGeneration generation)
+	{
+		const unsigned size(operation.size);
+		CodeCost cost;
+		switch (generation)
+		{
+			case VECTOR_UNROLLED:
+			{
+				// per element: load(s) or immediate, operator, store
+				const unsigned words(operation.kind == VectorOperation::COPY ? 2 : (operation.kind == VectorOperation::FILL ? immediateWords(operation.value) + 1 : 4));
+				const unsigned instructions(operation.kind == VectorOperation::BINARY ? 4 : 2);
+				cost.words = size * words;
+				cost.instructions = size * instructions;
+			}
+			break;
+
+			case VECTOR_LOOP:
+			{
+				// per element: each indirect access loads the counter, the loop tests, increments and jumps
+				unsigned bodyWords(3), bodyInstructions(2);
+				if (operation.kind == VectorOperation::COPY)
+				{
+					bodyWords += 3;
+					bodyInstructions += 2;
+				}
+				else if (operation.kind == VectorOperation::FILL)
+				{
+					bodyWords += immediateWords(operation.value);
+					bodyInstructions += 1;
+				}
+				else
+				{
+					bodyWords += 7;
+					bodyInstructions += 5;
+				}
+				const unsigned testWords(1 + immediateWords(size) + 2);
+				cost.words = 2 + testWords + bodyWords + 4 + 1;
+				cost.instructions = 2 + size * (3 + bodyInstructions + 4 + 1) + 3;
+			}
+			break;
+
+			default:
+			{
+				// addresses and size of arguments, plus storing the value in memory for fill
+				cost.words = immediateWords(size) + 1;
+				cost.instructions = 2;
+				const MemoryVectorNode* operands[] = { operation.dest, operation.src1, operation.src2 };
+				for (auto operand : operands)
+				{
+					if (operand)
+					{
+						cost.words += immediateWords(operand->getVectorAddr());
+						cost.instructions += 1;
+					}
+				}
+				if (operation.kind == VectorOperation::FILL)
+				{
+					cost.words += immediateWords(operation.value) + 1 + 1;
+					cost.instructions += 3;
+				}
+			}
+			break;
+		}
+		return cost;
+	}
+
+	//! Return a read of operand indexed by the variable at counterAddr
+	static Node* indexedRead(const SourcePos& pos, const MemoryVectorNode* operand, unsigned size, unsigned counterAddr)
+	{
+		auto* read = new ArrayReadNode(pos, operand->getVectorAddr(), size, operand->arrayName);
+		read->children.push_back(new LoadNode(pos, counterAddr));
+		return read;
+	}
+
+	//! Generate operation as a loop over the elements, using counterAddr as counter
+	static Node* vectorOperationLoop(const SourcePos& pos, const VectorOperation& operation, unsigned counterAddr)
+	{
+		const unsigned size(operation.size);
+
+		Node* value;
+		if (operation.kind == VectorOperation::COPY)
+			value = indexedRead(pos, operation.src1, size, counterAddr);
+		else if (operation.kind == VectorOperation::FILL)
+			value = new ImmediateNode(pos, operation.value);
+		else
+			value = new BinaryArithmeticNode(pos, operation.op, indexedRead(pos, operation.src1, size, counterAddr), indexedRead(pos, operation.src2, size, counterAddr));
+
+		auto* write = new ArrayWriteNode(pos, operation.dest->getVectorAddr(), size, operation.dest->arrayName);
+		write->children.push_back(new LoadNode(pos, counterAddr));
+
+		// dest[counter] = value; counter = counter + 1
+		auto* body = new BlockNode(pos);
+		body->children.push_back(new AssignmentNode(pos, write, value));
+		body->children.push_back(new AssignmentNode(pos, new StoreNode(pos, counterAddr),
+			new BinaryArithmeticNode(pos, ASEBA_OP_ADD, new LoadNode(pos, counterAddr), new ImmediateNode(pos, 1))));
+
+		// while counter < size
+		auto* loop = new WhileNode(pos);
+		loop->iterations = size;
+		loop->children.push_back(new BinaryArithmeticNode(pos, ASEBA_OP_SMALLER_THAN, new LoadNode(pos, counterAddr), new ImmediateNode(pos, size)));
+		loop->children.push_back(body);
+
+		// counter = 0
+		auto* block = new BlockNode(pos);
+		block->children.push_back(new AssignmentNode(pos, new StoreNode(pos, counterAddr), new ImmediateNode(pos, 0)));
+		block->children.push_back(loop);
+		return block;
+	}
+
+	//! Generate operation as a call to native function funcId, using valueAddr to hold the value of a fill
+	static Node* vectorOperationCall(const SourcePos& pos, const VectorOperation& operation, unsigned funcId, unsigned valueAddr)
+	{
+		auto* call = new CallNode(pos, funcId);
+		call->templateArgs.push_back(operation.size);
+		call->children.push_back(new ImmediateNode(pos, operation.dest->getVectorAddr()));
+		if (operation.kind == VectorOperation::FILL)
+		{
+			auto* block = new BlockNode(pos);
+			block->children.push_back(new AssignmentNode(pos, new StoreNode(pos, valueAddr), new ImmediateNode(pos, operation.value)));
+			block->children.push_back(new ImmediateNode(pos, valueAddr));
+			call->children.push_back(block);
+		}
+		else
+		{
+			call->children.push_back(new ImmediateNode(pos, operation.src1->getVectorAddr()));
+			if (operation.src2)
+				call->children.push_back(new ImmediateNode(pos, operation.src2->getVectorAddr()));
+		}
+		return call;
+	}
+
+	//! Return whether the target provides native function name with the parameters of a vector operation
+	static bool findVectorNative(const FunctionsMap& functionsMap, const TargetDescription* targetDescription, const VectorOperation& operation, unsigned& funcId)
+	{
+		const auto it(functionsMap.find(vectorOperationNativeName(operation)));
+		if (it == functionsMap.end())
+			return false;
+		const std::vector<TargetDescription::NativeFunctionParameter>& parameters(targetDescription->nativeFunctions[it->second].parameters);
+		const size_t count(operation.kind == VectorOperation::BINARY ? 3 : 2);
+		if (parameters.size() != count)
+			return false;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const int expected((operation.kind == VectorOperation::FILL && i == 1) ? 1 : -1);
+			if (parameters[i].size != expected)
+				return false;
+		}
+		funcId = it->second;
+		return true;
+	}
+
+	//! Assignment between vectors is expanded into multiple scalar assignments, a loop or a native call
 	Node* AssignmentNode::expandVectorialNodes(std::wostream *dump, Compiler* compiler, unsigned int index)
+	{
+		// evaluation of constant expressions has no compiler
+		if (!compiler)
+			return expandVectorialAssignment(dump, compiler);
+
+		// temporaries allocated for this assignment are only live while it executes
+		const unsigned endVariableIndex(compiler->endVariableIndex);
+		Node* expanded(expandVectorialAssignment(dump, compiler));
+		compiler->endVariableIndex = endVariableIndex;
+		return expanded;
+	}
+
+	//! Expand an assignment between vectors, choosing the cheapest code for element-wise operations
+	Node* AssignmentNode::expandVectorialAssignment(std::wostream *dump, Compiler* compiler)
 	{
 		assert(children.size() == 2);
 
@@ -222,8 +525,50 @@ namespace Aseba
 		// right vector can be anything
 		Node* rightVector = children[1];
 
+		// element-wise operations can be generated in several ways, choose the cheapest one
+		VectorOperation operation;
+		if (compiler && matchVectorOperation(leftVector, rightVector, operation))
+		{
+			const bool temporaryAvailable(compiler->freeVariableIndex + compiler->endVariableIndex + 1 <= compiler->targetDescription->variablesSize);
+			unsigned funcId(0);
+			const bool nativeAvailable(findVectorNative(compiler->functionsMap, compiler->targetDescription, operation, funcId) &&
+				(operation.kind != VectorOperation::FILL || temporaryAvailable));
+
+			VectorCodeGeneration best(VECTOR_UNROLLED);
+			CodeCost bestCost(vectorOperationCost(operation, VECTOR_UNROLLED));
+			for (auto generation : { VECTOR_NATIVE, VECTOR_LOOP })
+			{
+				if ((generation == VECTOR_NATIVE && !nativeAvailable) || (generation == VECTOR_LOOP && !temporaryAvailable))
+					continue;
+				const CodeCost cost(vectorOperationCost(operation, generation));
+				const bool better(compiler->optimizationGoal == Compiler::OPTIMIZE_FOR_SIZE ?
+					(cost.words < bestCost.words || (cost.words == bestCost.words && cost.instructions < bestCost.instructions)) :
+					(cost.instructions < bestCost.instructions || (cost.instructions == bestCost.instructions && cost.words < bestCost.words)));
+				if (better)
+				{
+					best = generation;
+					bestCost = cost;
+				}
+			}
+
+			if (best == VECTOR_NATIVE)
+			{
+				const unsigned valueAddr(operation.kind == VectorOperation::FILL ? compiler->allocateTemporaryMemory(sourcePos, 1) : 0);
+				if (dump)
+					*dump << sourcePos.toWString() << L" vector assignment of size " << operation.size << L" generated as a call to " << vectorOperationNativeName(operation) << L"\n";
+				return vectorOperationCall(sourcePos, operation, funcId, valueAddr);
+			}
+			if (best == VECTOR_LOOP)
+			{
+				const unsigned counterAddr(compiler->allocateTemporaryMemory(sourcePos, 1));
+				if (dump)
+					*dump << sourcePos.toWString() << L" vector assignment of size " << operation.size << L" generated as a loop\n";
+				return vectorOperationLoop(sourcePos, operation, counterAddr);
+			}
+			// element-wise, so unrolling is safe even if left appears on the right side
+		}
 		// check if the left vector appears somewhere on the right side
-		if (matchNameInMemoryVector(rightVector, leftVector->arrayName) && leftVector->getVectorSize() > 1)
+		else if (matchNameInMemoryVector(rightVector, leftVector->arrayName) && leftVector->getVectorSize() > 1)
 		{
 			// in such case, there is a risk of involuntary overwriting the content
 			// we need to throw in a temporary variable to avoid this risk
@@ -241,7 +586,6 @@ namespace Aseba
 
 			return tempBlock->expandVectorialNodes(dump, compiler); // tempBlock will be reclaimed
 		}
-		// else
 
 		std::unique_ptr<BlockNode> block(new BlockNode(sourcePos)); // top-level block
 
@@ -22,8 +22,17 @@
 #include "power-of-two.h"
 #include "../common/utils/FormatableString.h"
 #include "../common/utils/utils.h"
+#include "../vm/natives-math.h"
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <typeinfo>
+#include <vector>
 
 
 namespace Aseba
@@ -197,6 +206,7 @@ namespace Aseba
 		auto* operation = polymorphic_downcast<BinaryArithmeticNode*>(children[0]);
 		auto *foldedNode = new FoldedWhileNode(sourcePos);
 		foldedNode->op = operation->op;
+		foldedNode->iterations = iterations;
 		foldedNode->children.push_back(operation->children[0]);
 		foldedNode->children.push_back(operation->children[1]);
 		operation->children.clear();
@@ -598,6 +608,1296 @@ namespace Aseba
 		return this;
 	}
 
+
+	namespace
+	{
+		//! Values of variables known at compile time, indexed by address.
+		//! Changes are journaled, so that the values before a branch can be restored without copying them all
+		class KnownValues
+		{
+		public:
+			typedef std::map<unsigned, int> Values;
+			typedef Values::const_iterator const_iterator;
+
+			//! Whether the value of a variable is known, and which one
+			struct State
+			{
+				bool known;
+				int value;
+			};
+			//! States of some variables, indexed by address
+			typedef std::map<unsigned, State> States;
+
+			const_iterator find(unsigned addr) const { return values.find(addr); }
+			const_iterator end() const { return values.end(); }
+
+			//! Return the state of addr
+			State state(unsigned addr) const
+			{
+				const auto it(values.find(addr));
+				if (it == values.end())
+					return {false, 0};
+				return {true, it->second};
+			}
+			//! Record that addr holds value
+			void set(unsigned addr, int value)
+			{
+				journal.push_back({addr, state(addr)});
+				values[addr] = value;
+			}
+			//! Forget the value of addr
+			void erase(unsigned addr)
+			{
+				const auto it(values.find(addr));
+				if (it == values.end())
+					return;
+				journal.push_back({addr, {true, it->second}});
+				values.erase(it);
+			}
+			//! Forget the values of addresses in [begin, end)
+			void erase(unsigned begin, unsigned end)
+			{
+				for (auto it = values.lower_bound(begin); it != values.end() && it->first < end;)
+				{
+					journal.push_back({it->first, {true, it->second}});
+					it = values.erase(it);
+				}
+			}
+			//! Forget all values
+			void clear()
+			{
+				for (const auto& value : values)
+					journal.push_back({value.first, {true, value.second}});
+				values.clear();
+			}
+
+			//! Return a mark of the current values, to roll back to them or to look at the changes since
+			size_t mark() const { return journal.size(); }
+			//! Restore the values as they were at mark
+			void rollback(size_t mark)
+			{
+				for (; journal.size() > mark; journal.pop_back())
+				{
+					const Change& change(journal.back());
+					if (change.previous.known)
+						values[change.addr] = change.previous.value;
+					else
+						values.erase(change.addr);
+				}
+			}
+			//! Return the addresses changed since mark, with their states at mark
+			States changedSince(size_t mark) const
+			{
+				States states;
+				// walk backward, so that the oldest change of an address is the one kept
+				for (size_t i = journal.size(); i > mark; --i)
+					states[journal[i - 1].addr] = journal[i - 1].previous;
+				return states;
+			}
+
+		protected:
+			//! Change of the value of an address
+			struct Change
+			{
+				unsigned addr;
+				State previous;
+			};
+
+			Values values; //!< current values
+			std::vector<Change> journal; //!< changes, most recent last
+		};
+
+		//! Return whether value fits in a word of the VM
+		bool isInt16(int value)
+		{
+			return (value >= -32768) && (value <= 32767);
+		}
+
+		//! Evaluate an expression from immediates and known values.
+		//! Return false if its value is unknown, or if it cannot be computed without overflow nor run-time error
+		bool evaluate(const Node* node, const KnownValues& values, int& result)
+		{
+			if (const auto* immediate = dynamic_cast<const ImmediateNode*>(node))
+			{
+				result = immediate->value;
+				return isInt16(result);
+			}
+			if (const auto* load = dynamic_cast<const LoadNode*>(node))
+			{
+				const auto it(values.find(load->varAddr));
+				if (it == values.end())
+					return false;
+				result = it->second;
+				return true;
+			}
+			if (const auto* arrayRead = dynamic_cast<const ArrayReadNode*>(node))
+			{
+				int index;
+				if (!evaluate(arrayRead->children[0], values, index) || (index < 0) || (unsigned(index) >= arrayRead->arraySize))
+					return false;
+				const auto it(values.find(arrayRead->arrayAddr + index));
+				if (it == values.end())
+					return false;
+				result = it->second;
+				return true;
+			}
+			if (const auto* unary = dynamic_cast<const UnaryArithmeticNode*>(node))
+			{
+				int value;
+				if (!evaluate(unary->children[0], values, value))
+					return false;
+				switch (unary->op)
+				{
+					case ASEBA_UNARY_OP_SUB: result = -value; break;
+					case ASEBA_UNARY_OP_ABS: result = abs(value); break;
+					case ASEBA_UNARY_OP_BIT_NOT: result = ~value; break;
+					case ASEBA_UNARY_OP_NOT: result = !value; break;
+					default: return false;
+				}
+				return isInt16(result);
+			}
+			if (const auto* binary = dynamic_cast<const BinaryArithmeticNode*>(node))
+			{
+				int valueOne, valueTwo;
+				if (!evaluate(binary->children[0], values, valueOne) || !evaluate(binary->children[1], values, valueTwo))
+					return false;
+				switch (binary->op)
+				{
+					case ASEBA_OP_SHIFT_LEFT:
+						if ((valueTwo < 0) || (valueTwo > 15))
+							return false;
+						result = valueOne * (1 << valueTwo);
+					break;
+					case ASEBA_OP_SHIFT_RIGHT:
+						if ((valueTwo < 0) || (valueTwo > 15))
+							return false;
+						result = valueOne >> valueTwo;
+					break;
+					case ASEBA_OP_ADD: result = valueOne + valueTwo; break;
+					case ASEBA_OP_SUB: result = valueOne - valueTwo; break;
+					case ASEBA_OP_MULT: result = valueOne * valueTwo; break;
+					case ASEBA_OP_DIV:
+						if (valueTwo == 0)
+							return false;
+						result = valueOne / valueTwo;
+					break;
+					case ASEBA_OP_MOD:
+						if (valueTwo == 0)
+							return false;
+						result = valueOne % valueTwo;
+					break;
+
+					case ASEBA_OP_BIT_OR: result = valueOne | valueTwo; break;
+					case ASEBA_OP_BIT_XOR: result = valueOne ^ valueTwo; break;
+					case ASEBA_OP_BIT_AND: result = valueOne & valueTwo; break;
+
+					case ASEBA_OP_EQUAL: result = valueOne == valueTwo; break;
+					case ASEBA_OP_NOT_EQUAL: result = valueOne != valueTwo; break;
+					case ASEBA_OP_BIGGER_THAN: result = valueOne > valueTwo; break;
+					case ASEBA_OP_BIGGER_EQUAL_THAN: result = valueOne >= valueTwo; break;
+					case ASEBA_OP_SMALLER_THAN: result = valueOne < valueTwo; break;
+					case ASEBA_OP_SMALLER_EQUAL_THAN: result = valueOne <= valueTwo; break;
+
+					case ASEBA_OP_OR: result = valueOne || valueTwo; break;
+					case ASEBA_OP_AND: result = valueOne && valueTwo; break;
+
+					default: return false;
+				}
+				return isInt16(result);
+			}
+			return false;
+		}
+
+		//! Return whether every arithmetic subexpression of node with constant operands can be computed by evaluate(),
+		//! that is without leaving 16 bits; folding the others in int would not give the result of the VM
+		bool constantsFitInt16(const Node* node)
+		{
+			for (const auto child : node->children)
+				if (child && !constantsFitInt16(child))
+					return false;
+			if (!dynamic_cast<const UnaryArithmeticNode*>(node) && !dynamic_cast<const BinaryArithmeticNode*>(node))
+				return true;
+			const KnownValues noValues;
+			int result;
+			for (const auto child : node->children)
+				if (!evaluate(child, noValues, result))
+					return true;
+			return evaluate(node, noValues, result);
+		}
+
+		//! Forget the values of all variables that node or its children might write
+		void forgetWrittenValues(const Node* node, KnownValues& values)
+		{
+			if (dynamic_cast<const CallNode*>(node) || dynamic_cast<const CallSubNode*>(node))
+			{
+				// native functions write their arguments and subroutines anything
+				values.clear();
+				return;
+			}
+			if (const auto* store = dynamic_cast<const StoreNode*>(node))
+				values.erase(store->varAddr);
+			else if (const auto* arrayWrite = dynamic_cast<const ArrayWriteNode*>(node))
+				values.erase(arrayWrite->arrayAddr, arrayWrite->arrayAddr + arrayWrite->arraySize);
+			for (const auto child : node->children)
+				if (child)
+					forgetWrittenValues(child, values);
+		}
+
+		//! Standard native functions, evaluated on variables at the addresses of their arguments and on the size of
+		//! their template argument with the element loops of the VM. They return false where the VM would fail at run
+		//! time, loop forever or have an undefined behaviour, or where its result depends on the target.
+
+		bool nativeCopy(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_copy(&variables[args[0]], &variables[args[1]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeFill(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_fill(&variables[args[0]], &variables[args[1]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeAddScalar(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_add_scalar(&variables[args[0]], &variables[args[1]], variables[args[2]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeAdd(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_add(&variables[args[0]], &variables[args[1]], &variables[args[2]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeSub(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_sub(&variables[args[0]], &variables[args[1]], &variables[args[2]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeMul(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_mul(&variables[args[0]], &variables[args[1]], &variables[args[2]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeDiv(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			return aseba_vec_div(&variables[args[0]], &variables[args[1]], &variables[args[2]], uint16_t(length)) != 0;
+		}
+
+		bool nativeMin(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_min(&variables[args[0]], &variables[args[1]], &variables[args[2]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeMax(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_max(&variables[args[0]], &variables[args[1]], &variables[args[2]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeClamp(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_clamp(&variables[args[0]], &variables[args[1]], &variables[args[2]], &variables[args[3]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeDot(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			const int16_t shift(variables[args[3]]);
+			if (shift > 32)
+			{
+				variables[args[0]] = 0;
+				return true;
+			}
+			// the VM shifts a 32 bits value, which is undefined for these
+			if (shift < 0 || shift == 32)
+				return false;
+			// DSP targets accumulate in 40 bits with saturation and the others wrap in 32 bits, they only agree if no
+			// partial sum overflows 32 bits
+			int64_t sum(0);
+			for (unsigned i = 0; i < length; ++i)
+			{
+				sum += int64_t(variables[args[1] + i]) * int64_t(variables[args[2] + i]);
+				if (sum < INT32_MIN || sum > INT32_MAX)
+					return false;
+			}
+			variables[args[0]] = int16_t(aseba_vec_dot(&variables[args[1]], &variables[args[2]], uint16_t(length)) >> shift);
+			return true;
+		}
+
+		bool nativeStat(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_stat(&variables[args[0]], &variables[args[1]], &variables[args[2]], &variables[args[3]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeArgBounds(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_vec_argbounds(&variables[args[0]], &variables[args[1]], &variables[args[2]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeSort(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			aseba_comb_sort(&variables[args[0]], uint16_t(length));
+			return true;
+		}
+
+		bool nativeMulDiv(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			return aseba_vec_muldiv(&variables[args[0]], &variables[args[1]], &variables[args[2]], &variables[args[3]], uint16_t(length)) != 0;
+		}
+
+		bool nativeAtan2(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			// the absolute value of -32768 does not fit in 16 bits, and the VM then shifts a negative value
+			for (unsigned i = 0; i < length; ++i)
+				if (variables[args[1] + i] == -32768 || variables[args[2] + i] == -32768)
+					return false;
+			for (unsigned i = 0; i < length; ++i)
+				variables[args[0] + i] = aseba_atan2(variables[args[1] + i], variables[args[2] + i]);
+			return true;
+		}
+
+		bool nativeSin(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			for (unsigned i = 0; i < length; ++i)
+				variables[args[0] + i] = aseba_sin(variables[args[1] + i]);
+			return true;
+		}
+
+		bool nativeCos(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			for (unsigned i = 0; i < length; ++i)
+				variables[args[0] + i] = aseba_cos(variables[args[1] + i]);
+			return true;
+		}
+
+		bool nativeRot2(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			const int32_t x(variables[args[1]]);
+			const int32_t y(variables[args[1] + 1]);
+			const int16_t angle(variables[args[2]]);
+			const int32_t cosAngle(aseba_cos(angle));
+			const int32_t sinAngle(aseba_sin(angle));
+			variables[args[0]] = int16_t((cosAngle * x - sinAngle * y) >> 15);
+			variables[args[0] + 1] = int16_t((cosAngle * y + sinAngle * x) >> 15);
+			return true;
+		}
+
+		bool nativeSqrt(int16_t* variables, const unsigned* args, unsigned length)
+		{
+			// the square root of the VM never returns for negative values
+			for (unsigned i = 0; i < length; ++i)
+				if (variables[args[1] + i] < 0)
+					return false;
+			for (unsigned i = 0; i < length; ++i)
+				variables[args[0] + i] = aseba_sqrt(variables[args[1] + i]);
+			return true;
+		}
+
+		//! Argument of a native function that is read, written, or both
+		enum NativeArgumentUse
+		{
+			NATIVE_IN = 1,
+			NATIVE_OUT = 2,
+			NATIVE_IN_OUT = NATIVE_IN | NATIVE_OUT
+		};
+
+		//! Standard native function without side effect other than writing its arguments
+		struct PureNative
+		{
+			const wchar_t* name; //!< name in the target description
+			std::vector<int> sizes; //!< sizes of the arguments, -1 being the template
+			std::vector<NativeArgumentUse> uses; //!< use of the arguments
+			bool (*evaluate)(int16_t* variables, const unsigned* args, unsigned length); //!< same code as in the VM
+		};
+
+		//! Return the description of the pure standard native function, nullptr if function is not one
+		const PureNative* findPureNative(const TargetDescription::NativeFunction& function)
+		{
+			static const PureNative natives[] = {
+				{ L"math.copy", { -1, -1 }, { NATIVE_OUT, NATIVE_IN }, nativeCopy },
+				{ L"math.fill", { -1, 1 }, { NATIVE_OUT, NATIVE_IN }, nativeFill },
+				{ L"math.addscalar", { -1, -1, 1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN }, nativeAddScalar },
+				{ L"math.add", { -1, -1, -1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN }, nativeAdd },
+				{ L"math.sub", { -1, -1, -1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN }, nativeSub },
+				{ L"math.mul", { -1, -1, -1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN }, nativeMul },
+				{ L"math.div", { -1, -1, -1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN }, nativeDiv },
+				{ L"math.min", { -1, -1, -1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN }, nativeMin },
+				{ L"math.max", { -1, -1, -1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN }, nativeMax },
+				{ L"math.clamp", { -1, -1, -1, -1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN, NATIVE_IN }, nativeClamp },
+				{ L"math.dot", { 1, -1, -1, 1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN, NATIVE_IN }, nativeDot },
+				{ L"math.stat", { -1, 1, 1, 1 }, { NATIVE_IN, NATIVE_OUT, NATIVE_OUT, NATIVE_OUT }, nativeStat },
+				// the indices are only written if a bound is found
+				{ L"math.argbounds", { -1, 1, 1 }, { NATIVE_IN, NATIVE_IN_OUT, NATIVE_IN_OUT }, nativeArgBounds },
+				{ L"math.sort", { -1 }, { NATIVE_IN_OUT }, nativeSort },
+				{ L"math.muldiv", { -1, -1, -1, -1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN, NATIVE_IN }, nativeMulDiv },
+				{ L"math.atan2", { -1, -1, -1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN }, nativeAtan2 },
+				{ L"math.sin", { -1, -1 }, { NATIVE_OUT, NATIVE_IN }, nativeSin },
+				{ L"math.cos", { -1, -1 }, { NATIVE_OUT, NATIVE_IN }, nativeCos },
+				{ L"math.rot2", { 2, 2, 1 }, { NATIVE_OUT, NATIVE_IN, NATIVE_IN }, nativeRot2 },
+				{ L"math.sqrt", { -1, -1 }, { NATIVE_OUT, NATIVE_IN }, nativeSqrt },
+			};
+			for (const auto& native : natives)
+			{
+				if (function.name != native.name || function.parameters.size() != native.sizes.size())
+					continue;
+				// a target might provide a different function with the same name
+				for (size_t i = 0; i < native.sizes.size(); ++i)
+					if (function.parameters[i].size != native.sizes[i])
+						return nullptr;
+				return &native;
+			}
+			return nullptr;
+		}
+
+		//! Add to words and instructions a lower bound of the bytecode of node, counting only the nodes of straight-line code
+		void addStraightLineCost(const Node* node, unsigned& words, unsigned& instructions)
+		{
+			if (const auto* immediate = dynamic_cast<const ImmediateNode*>(node))
+			{
+				words += ((abs(immediate->value) >> 11) == 0) ? 1 : 2;
+				instructions += 1;
+				return;
+			}
+			if (dynamic_cast<const LoadNode*>(node) || dynamic_cast<const StoreNode*>(node) ||
+				dynamic_cast<const UnaryArithmeticNode*>(node) || dynamic_cast<const BinaryArithmeticNode*>(node))
+			{
+				words += 1;
+				instructions += 1;
+			}
+			else if (const auto* call = dynamic_cast<const CallNode*>(node))
+			{
+				for (const auto templateArg : call->templateArgs)
+					words += ((templateArg >> 11) == 0) ? 1 : 2;
+				words += 1;
+				instructions += unsigned(call->templateArgs.size()) + 1;
+			}
+			else if (!dynamic_cast<const BlockNode*>(node) && !dynamic_cast<const AssignmentNode*>(node))
+				return;
+			for (const auto child : node->children)
+				if (child)
+					addStraightLineCost(child, words, instructions);
+		}
+
+		//! Propagate the values of variables known at compile time, from statement to statement within a handler
+		class ConstantPropagation
+		{
+		public:
+			ConstantPropagation(const TargetDescription* targetDescription, unsigned firstUserVariable, bool optimizeForSize, std::wostream* dump) :
+				targetDescription(targetDescription),
+				firstUserVariable(firstUserVariable),
+				optimizeForSize(optimizeForSize),
+				dump(dump)
+			{}
+
+			void statement(Node*& node, KnownValues& values);
+
+		protected:
+			bool evaluateCall(Node*& node, KnownValues& values);
+			unsigned replaceKnownValues(Node*& node, const KnownValues& values, std::wostream* dump);
+			void substitute(Node*& node, const KnownValues& values, bool allowConstant);
+			void assign(unsigned addr, const Node* rValue, KnownValues& values);
+
+		protected:
+			const TargetDescription* targetDescription; //!< for the native functions
+			const unsigned firstUserVariable; //!< target variables might be changed by the target, so we only track the ones of the program
+			const bool optimizeForSize; //!< whether to compare code by size rather than by executed instructions
+			std::wostream* dump;
+		};
+
+		//! Replace loads of known values by immediates in node, return the number of replacements
+		unsigned ConstantPropagation::replaceKnownValues(Node*& node, const KnownValues& values, std::wostream* dump)
+		{
+			int value;
+			if ((dynamic_cast<LoadNode*>(node) || dynamic_cast<ArrayReadNode*>(node)) && evaluate(node, values, value))
+			{
+				if (dump)
+					*dump << node->sourcePos.toWString() << L" variable replaced by its known value\n";
+				const SourcePos pos = node->sourcePos;
+				delete node;
+				node = new ImmediateNode(pos, value);
+				return 1;
+			}
+			// arguments of native functions are addresses, not values
+			if (dynamic_cast<CallNode*>(node) || dynamic_cast<LoadNativeArgNode*>(node))
+				return 0;
+
+			unsigned count = 0;
+			for (auto& child : node->children)
+				if (child)
+					count += replaceKnownValues(child, values, dump);
+			return count;
+		}
+
+		//! Replace known values in expression node, unless this would turn a run-time behaviour into a compile-time one.
+		//! If allowConstant is false, the substitution is also refused if it makes node constant (e.g. in "while" or "when" conditions)
+		void ConstantPropagation::substitute(Node*& node, const KnownValues& values, bool allowConstant)
+		{
+			// try on a copy first: the optimizer throws on operations that would fail at run time (division by zero,
+			// out-of-bound access, ...) and the program must still compile and fail where it would have before, and it
+			// folds constants in int while the VM wraps every intermediate result to 16 bits
+			Node* copy(node->deepCopy());
+			if (replaceKnownValues(copy, values, nullptr) == 0 || !constantsFitInt16(copy))
+			{
+				delete copy;
+				return;
+			}
+			try
+			{
+				copy = copy->optimize(nullptr);
+			}
+			catch (TranslatableError&)
+			{
+				delete copy;
+				return;
+			}
+			const bool constant(dynamic_cast<ImmediateNode*>(copy) != nullptr);
+			delete copy;
+			if (constant && !allowConstant)
+				return;
+
+			replaceKnownValues(node, values, dump);
+		}
+
+		//! Record the value stored in addr, if any
+		void ConstantPropagation::assign(unsigned addr, const Node* rValue, KnownValues& values)
+		{
+			int value;
+			if (addr >= firstUserVariable && evaluate(rValue, values, value))
+				values.set(addr, value);
+			else
+				values.erase(addr);
+		}
+
+		//! Propagate known values through a statement, values are updated to the ones known after it
+		void ConstantPropagation::statement(Node*& node, KnownValues& values)
+		{
+			if (dynamic_cast<BlockNode*>(node) || dynamic_cast<EmitNode*>(node))
+			{
+				for (auto& child : node->children)
+					statement(child, values);
+			}
+			else if (dynamic_cast<EventDeclNode*>(node) || dynamic_cast<SubDeclNode*>(node))
+			{
+				// nothing is known when a handler starts
+				values.clear();
+			}
+			else if (dynamic_cast<AssignmentNode*>(node))
+			{
+				substitute(node->children[1], values, true);
+				if (const auto* store = dynamic_cast<StoreNode*>(node->children[0]))
+				{
+					assign(store->varAddr, node->children[1], values);
+				}
+				else
+				{
+					auto* arrayWrite = polymorphic_downcast<ArrayWriteNode*>(node->children[0]);
+					substitute(node->children[0], values, true);
+					int index;
+					if (evaluate(arrayWrite->children[0], values, index) && (index >= 0) && (unsigned(index) < arrayWrite->arraySize))
+						assign(arrayWrite->arrayAddr + index, node->children[1], values);
+					else
+						forgetWrittenValues(arrayWrite, values);
+				}
+			}
+			else if (const auto* ifWhen = dynamic_cast<IfWhenNode*>(node))
+			{
+				// the condition of "when" depends on its previous evaluation, do not make it constant
+				substitute(node->children[0], values, !ifWhen->edgeSensitive);
+
+				// run the true branch, note the values it changed, and go back to before it
+				const size_t beforeTrue(values.mark());
+				statement(node->children[1], values);
+				KnownValues::States afterTrue(values.changedSince(beforeTrue));
+				for (auto& changed : afterTrue)
+					changed.second = values.state(changed.first);
+				values.rollback(beforeTrue);
+
+				const size_t beforeFalse(values.mark());
+				if (node->children.size() > 2)
+					statement(node->children[2], values);
+				const KnownValues::States falseChanged(values.changedSince(beforeFalse));
+
+				// only keep values known after both branches, the others are unchanged since before the if
+				for (const auto& changed : afterTrue)
+				{
+					const auto it(values.find(changed.first));
+					if (it != values.end() && (!changed.second.known || changed.second.value != it->second))
+						values.erase(changed.first);
+				}
+				for (const auto& changed : falseChanged)
+				{
+					const auto it(values.find(changed.first));
+					if (it != values.end() && !afterTrue.count(changed.first) && (!changed.second.known || changed.second.value != it->second))
+						values.erase(changed.first);
+				}
+			}
+			else if (dynamic_cast<WhileNode*>(node))
+			{
+				// only values not written in the loop are known at each iteration
+				forgetWrittenValues(node->children[1], values);
+				// a constant condition would be a compile-time error or remove the loop
+				substitute(node->children[0], values, false);
+				const size_t beforeLoop(values.mark());
+				statement(node->children[1], values);
+				values.rollback(beforeLoop);
+			}
+			else if (dynamic_cast<CallNode*>(node) && evaluateCall(node, values))
+			{
+				// the call was replaced by the stores of its results
+			}
+			else
+			{
+				// native and subroutine calls, return
+				values.clear();
+			}
+		}
+
+		//! If node is a call to a pure standard native function with known arguments and if storing its results is cheaper
+		//! than calling it, replace it by these stores and return true
+		bool ConstantPropagation::evaluateCall(Node*& node, KnownValues& values)
+		{
+			auto* call = polymorphic_downcast<CallNode*>(node);
+			const TargetDescription::NativeFunction& function(targetDescription->nativeFunctions[call->funcId]);
+			const PureNative* native(findPureNative(function));
+			if (!native)
+				return false;
+
+			// arguments are addresses, either of variables or of temporaries set just before the call
+			const size_t beforeArguments(values.mark());
+			std::vector<unsigned> args;
+			for (auto& child : call->children)
+			{
+				if (dynamic_cast<BlockNode*>(child) && !child->children.empty() && dynamic_cast<ImmediateNode*>(child->children.back()))
+				{
+					for (size_t i = 0; i + 1 < child->children.size(); ++i)
+						statement(child->children[i], values);
+					args.push_back(polymorphic_downcast<ImmediateNode*>(child->children.back())->value);
+				}
+				else if (const auto* immediate = dynamic_cast<ImmediateNode*>(child))
+					args.push_back(immediate->value);
+				else
+					return false;
+			}
+
+			// sizes of the arguments
+			const unsigned length(call->templateArgs.empty() ? 0 : call->templateArgs[0]);
+			std::vector<unsigned> sizes;
+			for (const auto size : native->sizes)
+				sizes.push_back(size < 0 ? length : unsigned(size));
+
+			// the values read by the function must be known
+			std::vector<int16_t> variables(targetDescription->variablesSize, 0);
+			for (size_t i = 0; i < args.size(); ++i)
+			{
+				if (args[i] + sizes[i] > variables.size())
+					return false;
+				if (!(native->uses[i] & NATIVE_IN))
+					continue;
+				for (unsigned addr = args[i]; addr < args[i] + sizes[i]; ++addr)
+				{
+					const auto it(values.find(addr));
+					if (it == values.end())
+						return false;
+					variables[addr] = int16_t(it->second);
+				}
+			}
+			if (!native->evaluate(&variables[0], &args[0], length))
+				return false;
+
+			// replace the call by the stores of its results, if cheaper
+			std::unique_ptr<BlockNode> stores(new BlockNode(call->sourcePos));
+			for (size_t i = 0; i < args.size(); ++i)
+				if (native->uses[i] & NATIVE_OUT)
+					for (unsigned addr = args[i]; addr < args[i] + sizes[i]; ++addr)
+						stores->children.push_back(new AssignmentNode(call->sourcePos, new StoreNode(call->sourcePos, addr), new ImmediateNode(call->sourcePos, variables[addr])));
+			unsigned storesWords(0), storesInstructions(0);
+			addStraightLineCost(stores.get(), storesWords, storesInstructions);
+			unsigned callWords(0), callInstructions(0);
+			addStraightLineCost(call, callWords, callInstructions);
+			// the work of the native itself counts as one instruction per result
+			callInstructions += unsigned(stores->children.size());
+			const bool cheaper(optimizeForSize ?
+				(storesWords < callWords || (storesWords == callWords && storesInstructions <= callInstructions)) :
+				(storesInstructions < callInstructions || (storesInstructions == callInstructions && storesWords <= callWords)));
+			if (!cheaper)
+				return false;
+
+			if (dump)
+				*dump << call->sourcePos.toWString() << L" call to " << function.name << L" evaluated at compile time\n";
+			delete node;
+			node = stores.release();
+
+			// temporaries holding the arguments are not set anymore
+			values.rollback(beforeArguments);
+			for (auto& child : node->children)
+				statement(child, values);
+			return true;
+		}
+	} // namespace
+
+	//! Replace variables by their values when these are known at compile time, within each event and subroutine.
+	//! This allows the rest of the optimizer to fold constants across statements.
+	void Compiler::propagateConstants(Node* program, std::wostream* dump)
+	{
+		ConstantPropagation propagation(targetDescription, targetVariablesSize, optimizationGoal == OPTIMIZE_FOR_SIZE, dump);
+		KnownValues values;
+		propagation.statement(program, values);
+	}
+
+	namespace
+	{
+		//! A subexpression of a sequence of statements and the places it is computed at
+		struct Subexpression
+		{
+			std::set<unsigned> reads; //!< addresses of the variables it reads
+			unsigned words; //!< size of its bytecode
+			size_t firstStatement; //!< index of the statement where it is first computed
+			std::vector<Node**> occurrences; //!< slots of the nodes computing it, in evaluation order
+			bool held; //!< whether a variable holds its value after the first statement
+			unsigned holder; //!< that variable, if held
+		};
+
+		//! Return whether node or its children call a native function or a subroutine
+		bool containsCall(const Node* node)
+		{
+			if (dynamic_cast<const CallNode*>(node) || dynamic_cast<const CallSubNode*>(node))
+				return true;
+			for (const auto child : node->children)
+				if (child && containsCall(child))
+					return true;
+			return false;
+		}
+
+		//! Compute subexpressions computed several times in straight-line code once, in variables
+		class CommonSubexpressionElimination
+		{
+		public:
+			CommonSubexpressionElimination(unsigned firstUserVariable, unsigned& freeVariableIndex, unsigned variablesLimit, std::wostream* dump) :
+				firstUserVariable(firstUserVariable),
+				freeVariableIndex(freeVariableIndex),
+				variablesLimit(variablesLimit),
+				dump(dump)
+			{}
+
+			void statements(Node::NodesVector& statements, size_t temporary);
+
+		protected:
+			bool walk(Node** slot, size_t statement, std::wstring& key, std::set<unsigned>& reads, unsigned& words);
+			void close(const Node* node);
+			void collect(Node::NodesVector& statements);
+			bool eliminate(Node::NodesVector& statements, size_t& temporary);
+
+		protected:
+			const unsigned firstUserVariable; //!< the target might change what is written into its variables, so only the ones of the program hold values
+			unsigned& freeVariableIndex; //!< where new variables are allocated
+			const unsigned variablesLimit; //!< first address that cannot be allocated
+			std::vector<unsigned> temporaries; //!< variables allocated so far, shared by sequences never live at the same time
+			std::vector<Subexpression> subexpressions; //!< subexpressions of the current sequence
+			std::map<std::wstring, size_t> available; //!< subexpressions whose operands did not change since first computed
+			std::wostream* dump;
+		};
+
+		//! Compute the canonical form of the expression in slot and register it and its subexpressions as occurrences.
+		//! Return false if this expression cannot be factored, for instance because it might fail at run time
+		bool CommonSubexpressionElimination::walk(Node** slot, size_t statement, std::wstring& key, std::set<unsigned>& reads, unsigned& words)
+		{
+			Node* node(*slot);
+			if (const auto* immediate = dynamic_cast<ImmediateNode*>(node))
+			{
+				key = L"#" + std::to_wstring(immediate->value);
+				words = ((abs(immediate->value) >> 11) == 0) ? 1 : 2;
+				return true;
+			}
+			if (const auto* load = dynamic_cast<LoadNode*>(node))
+			{
+				key = L"@" + std::to_wstring(load->varAddr);
+				reads.insert(load->varAddr);
+				words = 1;
+				return true;
+			}
+
+			// walk children in any case, as they might be factored themselves
+			std::vector<std::wstring> childKeys(node->children.size());
+			bool factorable(true);
+			words = 1;
+			for (size_t i = 0; i < node->children.size(); ++i)
+			{
+				std::set<unsigned> childReads;
+				unsigned childWords(0);
+				if (!node->children[i] || !walk(&node->children[i], statement, childKeys[i], childReads, childWords))
+					factorable = false;
+				reads.insert(childReads.begin(), childReads.end());
+				words += childWords;
+			}
+			if (!factorable)
+				return false;
+
+			if (const auto* unary = dynamic_cast<UnaryArithmeticNode*>(node))
+			{
+				// not returns a boolean that only makes sense in conditions
+				if (unary->op == ASEBA_UNARY_OP_NOT)
+					return false;
+				key = L"(u" + std::to_wstring(unary->op) + L" " + childKeys[0] + L")";
+			}
+			else if (const auto* binary = dynamic_cast<BinaryArithmeticNode*>(node))
+			{
+				switch (binary->op)
+				{
+					case ASEBA_OP_DIV:
+					case ASEBA_OP_MOD:
+					{
+						// a division by zero must happen where it was written
+						const auto* divisor = dynamic_cast<ImmediateNode*>(binary->children[1]);
+						if (!divisor || divisor->value == 0)
+							return false;
+						key = L"(" + std::to_wstring(binary->op) + L" " + childKeys[0] + L" " + childKeys[1] + L")";
+					}
+					break;
+					case ASEBA_OP_SHIFT_LEFT:
+					case ASEBA_OP_SHIFT_RIGHT:
+					case ASEBA_OP_SUB:
+						key = L"(" + std::to_wstring(binary->op) + L" " + childKeys[0] + L" " + childKeys[1] + L")";
+					break;
+					case ASEBA_OP_ADD:
+					case ASEBA_OP_MULT:
+					case ASEBA_OP_BIT_OR:
+					case ASEBA_OP_BIT_XOR:
+					case ASEBA_OP_BIT_AND:
+						// commutative operators have a single canonical form
+						if (childKeys[1] < childKeys[0])
+							std::swap(childKeys[0], childKeys[1]);
+						key = L"(" + std::to_wstring(binary->op) + L" " + childKeys[0] + L" " + childKeys[1] + L")";
+					break;
+					default:
+						// comparisons and logic operations only make sense in conditions
+						return false;
+				}
+			}
+			else
+				return false;
+
+			// register this occurrence
+			const auto it(available.find(key));
+			if (it == available.end())
+			{
+				Subexpression subexpression;
+				subexpression.reads = reads;
+				subexpression.words = words;
+				subexpression.firstStatement = statement;
+				subexpression.occurrences.push_back(slot);
+				subexpression.held = false;
+				subexpression.holder = 0;
+				available[key] = subexpressions.size();
+				subexpressions.push_back(subexpression);
+			}
+			else
+				subexpressions[it->second].occurrences.push_back(slot);
+			return true;
+		}
+
+		//! Make the subexpressions whose value node might change unavailable
+		void CommonSubexpressionElimination::close(const Node* node)
+		{
+			const auto* store = dynamic_cast<const StoreNode*>(node);
+			const auto* arrayWrite = dynamic_cast<const ArrayWriteNode*>(node);
+			if (!store && !arrayWrite)
+			{
+				for (const auto child : node->children)
+					if (child)
+						close(child);
+				return;
+			}
+
+			const unsigned begin(store ? store->varAddr : arrayWrite->arrayAddr);
+			const unsigned end(store ? store->varAddr + 1 : arrayWrite->arrayAddr + arrayWrite->arraySize);
+			for (auto it = available.begin(); it != available.end();)
+			{
+				const Subexpression& subexpression(subexpressions[it->second]);
+				if (
+					(subexpression.reads.lower_bound(begin) != subexpression.reads.lower_bound(end)) ||
+					(subexpression.held && subexpression.holder >= begin && subexpression.holder < end)
+				)
+					it = available.erase(it);
+				else
+					++it;
+			}
+		}
+
+		//! Collect the subexpressions of a sequence of statements and their occurrences while their operands do not change
+		void CommonSubexpressionElimination::collect(Node::NodesVector& statements)
+		{
+			subexpressions.clear();
+			available.clear();
+
+			for (size_t i = 0; i < statements.size(); ++i)
+			{
+				Node* node(statements[i]);
+				std::wstring key;
+				std::set<unsigned> reads;
+				unsigned words;
+
+				if (dynamic_cast<AssignmentNode*>(node))
+				{
+					const size_t count(subexpressions.size());
+					const bool factorable(walk(&node->children[1], i, key, reads, words));
+					if (dynamic_cast<ArrayWriteNode*>(node->children[0]))
+						walk(&node->children[0]->children[0], i, key, reads, words);
+					close(node->children[0]);
+
+					// a variable assigned a subexpression holds its value until either changes
+					const auto* store = dynamic_cast<StoreNode*>(node->children[0]);
+					if (factorable && store && store->varAddr >= firstUserVariable && subexpressions.size() > count &&
+						subexpressions.back().occurrences.front() == &node->children[1] &&
+						subexpressions.back().reads.count(store->varAddr) == 0)
+					{
+						subexpressions.back().held = true;
+						subexpressions.back().holder = store->varAddr;
+					}
+				}
+				else if (dynamic_cast<FoldedIfWhenNode*>(node) || dynamic_cast<FoldedWhileNode*>(node))
+				{
+					// the condition of an if is computed once before the blocks, the one of a while at every iteration
+					if (dynamic_cast<FoldedIfWhenNode*>(node))
+					{
+						walk(&node->children[0], i, key, reads, words);
+						walk(&node->children[1], i, key, reads, words);
+					}
+					if (containsCall(node))
+						available.clear();
+					else
+						close(node);
+				}
+				else if (dynamic_cast<EmitNode*>(node))
+				{
+					close(node);
+				}
+				else
+				{
+					// handler boundaries, native and subroutine calls, return
+					available.clear();
+				}
+			}
+		}
+
+		//! Factor the most profitable subexpression of a sequence of statements, return false if none is worth it.
+		//! temporary is the index of the next free temporary, increased if this one gets used
+		bool CommonSubexpressionElimination::eliminate(Node::NodesVector& statements, size_t& temporary)
+		{
+			collect(statements);
+
+			// loading a variable costs one word, storing into a temporary one more
+			const bool temporaryAvailable(temporary < temporaries.size() || freeVariableIndex < variablesLimit);
+			Subexpression* best(nullptr);
+			int bestSaving(0);
+			for (auto& subexpression : subexpressions)
+			{
+				const int count(subexpression.occurrences.size());
+				const int words(subexpression.words);
+				int saving;
+				if (subexpression.held)
+					saving = (count - 1) * (words - 1);
+				else if (temporaryAvailable)
+					saving = (count - 1) * words - count - 1;
+				else
+					continue;
+				if (saving > bestSaving)
+				{
+					best = &subexpression;
+					bestSaving = saving;
+				}
+			}
+			if (!best)
+				return false;
+
+			Node** first(best->occurrences.front());
+			const SourcePos pos((*first)->sourcePos);
+			unsigned addr;
+			if (best->held)
+			{
+				addr = best->holder;
+				if (dump)
+					*dump << pos.toWString() << L" common subexpression reused from assigned variable\n";
+			}
+			else
+			{
+				if (temporary == temporaries.size())
+					temporaries.push_back(freeVariableIndex++);
+				addr = temporaries[temporary++];
+				statements.insert(statements.begin() + best->firstStatement, new AssignmentNode(pos, new StoreNode(pos, addr), *first));
+				*first = new LoadNode(pos, addr);
+				if (dump)
+					*dump << pos.toWString() << L" common subexpression computed once in temporary variable\n";
+			}
+			for (size_t i = 1; i < best->occurrences.size(); ++i)
+			{
+				Node** slot(best->occurrences[i]);
+				const SourcePos slotPos((*slot)->sourcePos);
+				delete *slot;
+				*slot = new LoadNode(slotPos, addr);
+			}
+			return true;
+		}
+
+		//! Eliminate common subexpressions in a sequence of statements and in its nested blocks, using temporaries from index temporary on
+		void CommonSubexpressionElimination::statements(Node::NodesVector& statements, size_t temporary)
+		{
+			// nested blocks are just sequences of statements
+			for (size_t i = 0; i < statements.size();)
+			{
+				Node* node(statements[i]);
+				if (typeid(*node) == typeid(BlockNode))
+				{
+					statements.erase(statements.begin() + i);
+					statements.insert(statements.begin() + i, node->children.begin(), node->children.end());
+					node->children.clear();
+					delete node;
+				}
+				else
+					++i;
+			}
+
+			while (eliminate(statements, temporary));
+
+			// temporaries of this sequence are live in nested blocks, which therefore use the following ones
+			for (auto node : statements)
+			{
+				if (dynamic_cast<FoldedIfWhenNode*>(node) || dynamic_cast<FoldedWhileNode*>(node))
+				{
+					for (size_t i = 2; i < node->children.size(); ++i)
+						if (dynamic_cast<BlockNode*>(node->children[i]))
+							this->statements(node->children[i]->children, temporary);
+				}
+			}
+		}
+	} // namespace
+
+	//! Compute subexpressions repeated in straight-line code once, either in a variable they were assigned to or in a new one.
+	//! New variables are only shared by sequences that cannot be live at the same time, as no sequence spans a call.
+	void Compiler::eliminateCommonSubexpressions(Node* program, std::wostream* dump)
+	{
+		CommonSubexpressionElimination elimination(targetVariablesSize, freeVariableIndex, targetDescription->variablesSize - temporaryMemoryPeak, dump);
+		elimination.statements(program->children, 0);
+	}
+
+	namespace
+	{
+		//! Return whether a handler or subroutine starts at node
+		bool isHandlerStart(const Node* node)
+		{
+			return dynamic_cast<const EventDeclNode*>(node) || dynamic_cast<const SubDeclNode*>(node);
+		}
+
+		//! Remove the statements following a return in sequences, down to the next handler
+		void removeUnreachableStatements(Node::NodesVector& statements, std::wostream* dump)
+		{
+			for (size_t i = 0; i < statements.size(); ++i)
+			{
+				Node* node(statements[i]);
+				if (dynamic_cast<ReturnNode*>(node))
+				{
+					size_t end(i + 1);
+					while (end < statements.size() && !isHandlerStart(statements[end]))
+						++end;
+					for (size_t j = i + 1; j < end; ++j)
+					{
+						if (dump)
+							*dump << statements[j]->sourcePos.toWString() << L" unreachable statement after return removed\n";
+						delete statements[j];
+					}
+					statements.erase(statements.begin() + i + 1, statements.begin() + end);
+				}
+				else
+				{
+					for (auto child : node->children)
+						if (dynamic_cast<BlockNode*>(child))
+							removeUnreachableStatements(child->children, dump);
+				}
+			}
+		}
+
+		//! Collect the subroutines called by node
+		void collectSubroutineCalls(const Node* node, std::set<unsigned>& called)
+		{
+			if (const auto* callSub = dynamic_cast<const CallSubNode*>(node))
+				called.insert(callSub->subroutineId);
+			for (const auto child : node->children)
+				if (child)
+					collectSubroutineCalls(child, called);
+		}
+
+		//! Mark the addresses in [begin, end) as read
+		void markRead(std::vector<bool>& read, unsigned begin, unsigned end)
+		{
+			for (unsigned addr = begin; addr < end && addr < read.size(); ++addr)
+				read[addr] = true;
+		}
+
+		//! Mark the variables node might read
+		void collectReads(const Node* node, std::vector<bool>& read, bool addresses = false)
+		{
+			if (const auto* load = dynamic_cast<const LoadNode*>(node))
+				markRead(read, load->varAddr, load->varAddr + 1);
+			else if (const auto* arrayRead = dynamic_cast<const ArrayReadNode*>(node))
+				markRead(read, arrayRead->arrayAddr, arrayRead->arrayAddr + arrayRead->arraySize);
+			else if (const auto* emit = dynamic_cast<const EmitNode*>(node))
+				markRead(read, emit->arrayAddr, emit->arrayAddr + emit->arraySize);
+			else if (const auto* nativeArg = dynamic_cast<const LoadNativeArgNode*>(node))
+			{
+				markRead(read, nativeArg->arrayAddr, nativeArg->arrayAddr + nativeArg->arraySize);
+				markRead(read, nativeArg->tempAddr, nativeArg->tempAddr + 1);
+			}
+			else if (const auto* immediate = dynamic_cast<const ImmediateNode*>(node))
+			{
+				// native functions get addresses, but not the sizes of their arguments
+				if (addresses && immediate->value >= 0)
+					markRead(read, immediate->value, read.size());
+			}
+			else if (dynamic_cast<const CallNode*>(node))
+				addresses = true;
+
+			for (const auto child : node->children)
+				if (child)
+					collectReads(child, read, addresses);
+		}
+
+		//! Return whether evaluating node might fail at run time
+		bool mightFail(const Node* node)
+		{
+			if (dynamic_cast<const ArrayReadNode*>(node) || dynamic_cast<const CallNode*>(node))
+				return true;
+			if (const auto* binary = dynamic_cast<const BinaryArithmeticNode*>(node))
+			{
+				if (binary->op == ASEBA_OP_DIV || binary->op == ASEBA_OP_MOD)
+				{
+					const auto* divisor = dynamic_cast<const ImmediateNode*>(binary->children[1]);
+					if (!divisor || divisor->value == 0)
+						return true;
+				}
+			}
+			for (const auto child : node->children)
+				if (child && mightFail(child))
+					return true;
+			return false;
+		}
+
+		//! Remove stores to temporaries in [firstTemporary, read.size()) that are never read
+		void removeDeadStores(Node::NodesVector& statements, const std::vector<bool>& read, unsigned firstTemporary, std::wostream* dump)
+		{
+			for (auto it = statements.begin(); it != statements.end();)
+			{
+				Node* node(*it);
+				if (dynamic_cast<AssignmentNode*>(node))
+				{
+					const auto* store = dynamic_cast<StoreNode*>(node->children[0]);
+					if (store && store->varAddr >= firstTemporary && !read[store->varAddr] && !mightFail(node->children[1]))
+					{
+						if (dump)
+							*dump << node->sourcePos.toWString() << L" store to temporary removed because it is never read\n";
+						delete node;
+						it = statements.erase(it);
+						continue;
+					}
+				}
+				else
+				{
+					for (auto child : node->children)
+						if (dynamic_cast<BlockNode*>(child))
+							removeDeadStores(child->children, read, firstTemporary, dump);
+				}
+				++it;
+			}
+		}
+	} // namespace
+
+	//! Remove code that has no effect on the program: statements after return, subroutines never called
+	//! from an event and stores to temporaries that are never read. What is removed is reported in dump.
+	//! Recursive subroutines are kept even if never called, as the stack check must reject them.
+	void Compiler::eliminateDeadCode(Node* program, std::wostream* dump)
+	{
+		Node::NodesVector& statements(program->children);
+
+		removeUnreachableStatements(statements, dump);
+
+		// find the subroutines called from each handler, init being SubroutineTable::size()
+		const unsigned init(subroutineTable.size());
+		std::vector<std::set<unsigned>> calls(subroutineTable.size() + 1);
+		std::set<unsigned> reached;
+		unsigned handler(init);
+		for (auto node : statements)
+		{
+			if (const auto* subDecl = dynamic_cast<SubDeclNode*>(node))
+				handler = subDecl->subroutineId;
+			else if (dynamic_cast<EventDeclNode*>(node))
+				handler = init;
+			else
+				collectSubroutineCalls(node, calls[handler]);
+		}
+
+		// subroutines reachable from init and events
+		std::vector<unsigned> toVisit(calls[init].begin(), calls[init].end());
+		while (!toVisit.empty())
+		{
+			const unsigned id(toVisit.back());
+			toVisit.pop_back();
+			if (!reached.insert(id).second)
+				continue;
+			toVisit.insert(toVisit.end(), calls[id].begin(), calls[id].end());
+		}
+
+		// keep recursive subroutines, so that the recursion is still reported as an error
+		for (unsigned id = 0; id < init; ++id)
+		{
+			if (reached.find(id) != reached.end())
+				continue;
+			std::set<unsigned> visited;
+			toVisit.assign(calls[id].begin(), calls[id].end());
+			while (!toVisit.empty())
+			{
+				const unsigned callee(toVisit.back());
+				toVisit.pop_back();
+				if (callee == id)
+				{
+					reached.insert(id);
+					break;
+				}
+				if (visited.insert(callee).second)
+					toVisit.insert(toVisit.end(), calls[callee].begin(), calls[callee].end());
+			}
+		}
+
+		// remove the others, from their declaration to the next handler
+		for (size_t i = 0; i < statements.size();)
+		{
+			const auto* subDecl = dynamic_cast<SubDeclNode*>(statements[i]);
+			if (subDecl && reached.find(subDecl->subroutineId) == reached.end())
+			{
+				if (dump)
+					*dump << subDecl->sourcePos.toWString() << L" subroutine " << subroutineTable[subDecl->subroutineId].name << L" removed because it is never called\n";
+				size_t end(i + 1);
+				while (end < statements.size() && !isHandlerStart(statements[end]))
+					++end;
+				for (size_t j = i; j < end; ++j)
+					delete statements[j];
+				statements.erase(statements.begin() + i, statements.begin() + end);
+			}
+			else
+				++i;
+		}
+
+		// temporaries at the end of memory are not visible from outside, so their stores are dead if never read
+		std::vector<bool> read(targetDescription->variablesSize, false);
+		collectReads(program, read);
+		removeDeadStores(statements, read, targetDescription->variablesSize - temporaryMemoryPeak, dump);
+	}
+
 	/*@}*/
 
 } // namespace Aseba
@@ -150,8 +150,10 @@ namespace Aseba
 
 		void checkVectorSize() const override;
 		Node* expandVectorialNodes(std::wostream* dump, Compiler* compiler=nullptr, unsigned int index = 0) override;
+		Node* expandVectorialAssignment(std::wostream* dump, Compiler* compiler);
 		ReturnType typeCheck(Compiler* compiler) override;
 		Node* optimize(std::wostream* dump) override;
+		unsigned getStackDepth() const override;
 		void emit(PreLinkBytecode& bytecodes) const override;
 		std::wstring toWString() const override { return L"Assign"; }
 		std::wstring toNodeName() const override { return L"assignment"; }
@@ -206,6 +208,8 @@ namespace Aseba
 	//! children[1] is block
 	struct WhileNode : Node
 	{
+		unsigned iterations{0}; //!< number of iterations when looping over a constant range, 0 if unknown
+
 		//! Constructor
 		WhileNode(const SourcePos& sourcePos) : Node(sourcePos) { }
 		WhileNode* shallowCopy() const override { return new WhileNode(*this); }
@@ -225,6 +229,7 @@ namespace Aseba
 	struct FoldedWhileNode : Node
 	{
 		AsebaBinaryOperator op; //!< operator
+		unsigned iterations{0}; //!< number of iterations when looping over a constant range, 0 if unknown
 
 		//! Constructor
 		FoldedWhileNode(const SourcePos& sourcePos) : Node(sourcePos) { }
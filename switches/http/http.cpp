@@ -348,7 +348,7 @@ namespace Aseba
             // patch message source if target id is remapped
             // but really, node id remapping should be handled closer to the dashel target
             NodeIdSubstitution subs = targetToNodeIdSubstitutions[it->first];
-            const CmdMessage *cmdMsg(dynamic_cast<const CmdMessage *>(&message));
+            const CmdMessage *cmdMsg(messageCast<CmdMessage>(&message));
             if (cmdMsg)
             {
                 for (NodeIdSubstitution::iterator m = subs.begin(); m != subs.end(); ++m)
@@ -372,7 +372,7 @@ namespace Aseba
 
     void HttpInterface::propagateCmdMessage(Message* message)
     {
-        CmdMessage *cmdMsg(dynamic_cast<CmdMessage *>(message));
+        CmdMessage *cmdMsg(messageCast<CmdMessage>(message));
         if (cmdMsg)
         {
             for (auto& stream_nodeid: asebaStreams)
@@ -521,7 +521,7 @@ namespace Aseba
         NodesManager::processMessage(message);
 
         // if description, record the stream -- node id correspondence
-        const Description *description = dynamic_cast<const Description *>(message);
+        const Description *description = messageCast<Description>(message);
         if (description)
         {
             const std::string target = targetFromString(stream);
@@ -531,12 +531,12 @@ namespace Aseba
         }
 
         // if variables, check for pending requests
-        const Variables *variables(dynamic_cast<Variables *>(message));
+        const Variables *variables(messageCast<Variables>(message));
         if (variables)
             incomingVariables(variables);
 
         // if event, retransmit it on an HTTP SSE channel if one exists
-        const UserMessage *userMsg(dynamic_cast<UserMessage *>(message));
+        const UserMessage *userMsg(messageCast<UserMessage>(message));
         if (userMsg)
             incomingUserMsg(userMsg);
 
@@ -1393,10 +1393,14 @@ namespace Aseba
         Compiler compiler;
         compiler.setTargetDescription(getDescription(nodeId));
         compiler.setCommonDefinitions(&(commonDefinitions[nodeId]));
-        bool result = compiler.compile(is, bytecode, allocatedVariablesCount, error);
+        CompilationStatistics statistics;
+        bool result = compiler.compile(is, bytecode, allocatedVariablesCount, error, nullptr, &statistics);
 
         if (result)
         {
+            if (verbose)
+                cout << "Compilation for node " << WStringToUTF8(getNodeName(nodeId)) << " succeeded\n" << WStringToUTF8(statistics.toWString()) << flush;
+
             Dashel::Stream* stream;
             try {
                 stream = getStreamFromNodeId(nodeId); // may fail
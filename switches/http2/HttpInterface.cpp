@@ -400,6 +400,20 @@ void HttpInterface::incomingData(Dashel::Stream *stream)
 		// warning: do this before dynamic casts because otherwise the parsing doesn't work (why?)
 		target->processMessage(message);
 
+		// find out the kind of message with a single dispatch on its class
+		struct MessageKind: public MessageVisitor
+		{
+			const Variables *variables = nullptr;
+			const UserMessage *userMessage = nullptr;
+			bool isCommand = false;
+
+			using MessageVisitor::visit;
+			void visit(const Variables& message) override { variables = &message; }
+			void visit(const UserMessage& message) override { userMessage = &message; }
+			void visit(const CmdMessage& message) override { isCommand = true; }
+		} kind;
+		message->accept(kind);
+
 		// See if we know this node already or if the source is 0 (meaning coming from IDE)
 		const HttpDashelTarget::Node *node = target->getNodeByLocalId(message->source);
 		if(node != nullptr || message->source == 0) { // else if we cannot remap the source, discard the message and do not relay it
@@ -417,19 +431,17 @@ void HttpInterface::incomingData(Dashel::Stream *stream)
 			}
 
 			// if variables, check for pending requests
-			const Variables *variables(dynamic_cast<Variables *>(message));
-			if(variables != nullptr) {
-				incomingVariables(target, variables);
+			if(kind.variables != nullptr) {
+				incomingVariables(target, kind.variables);
 			}
 
 			// if event, retransmit it on an HTTP SSE channel if one exists
-			const UserMessage *userMessage(dynamic_cast<UserMessage *>(message));
-			if(userMessage != nullptr) {
-				incomingUserMessage(target, userMessage);
+			if(kind.userMessage != nullptr) {
+				incomingUserMessage(target, kind.userMessage);
 			}
 
 			// act like asebaswitch: rebroadcast this message to the other streams
-			CmdMessage *cmdMessage(dynamic_cast<CmdMessage *>(message));
+			CmdMessage *cmdMessage(kind.isCommand ? static_cast<CmdMessage *>(message) : nullptr);
 			if(cmdMessage != nullptr) { // targeted message, only rebroadcast to correct target with remapped destination
 				std::map< unsigned, std::pair<HttpDashelTarget *, unsigned> >::iterator query = nodeIds.find(cmdMessage->dest);
 				if(query != nodeIds.end()) { // only relay it to known targets, else if we cannot remap the target, discard the message and do not relay it
@@ -131,14 +131,14 @@ namespace Aseba
 		NodesManager::processMessage(message);
 
 		// if user message, send to D-Bus as well
-		UserMessage *userMessage = dynamic_cast<UserMessage *>(message);
+		UserMessage *userMessage = messageCast<UserMessage>(message);
 		if (userMessage)
 		{
 			sendEventOnDBus(userMessage->type, fromAsebaVector(userMessage->data));
 		}
 
 		// if variables, check for pending answers
-		Variables *variables = dynamic_cast<Variables *>(message);
+		Variables *variables = messageCast<Variables>(message);
 		if (variables)
 		{
 			const unsigned nodeId(variables->source);
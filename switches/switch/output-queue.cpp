@@ -0,0 +1,144 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <dashel/dashel.h>
+#include "output-queue.h"
+
+// checking whether a socket accepts data without blocking
+#ifdef _WIN32
+#include <winsock2.h>
+#else // _WIN32
+#include <poll.h>
+#endif // _WIN32
+
+namespace Aseba
+{
+	using namespace std;
+	using namespace Dashel;
+
+	/** \addtogroup switch */
+	/*@{*/
+
+	//! Create a queue for stream holding at most capacity bytes, always enough for the largest message
+	OutputQueue::OutputQueue(Stream* stream, size_t capacity, OverflowPolicy policy) :
+		stream(stream),
+		capacity(max(capacity, RawMessage::headerSize + ASEBA_MAX_EVENT_ARG_SIZE)),
+		policy(policy)
+	{
+	}
+
+	//! Queue message, return false if it was not because the stream is disconnected
+	bool OutputQueue::push(const RawMessage& message)
+	{
+		if (disconnected)
+			return false;
+
+		const vector<uint8_t>& frame(message.frame.rawData);
+		if (getQueuedBytes() + frame.size() > capacity)
+		{
+			if (policy == OverflowPolicy::DISCONNECT)
+			{
+				disconnected = true;
+				return false;
+			}
+			dropOldest(getQueuedBytes() + frame.size() - capacity);
+		}
+
+		// reclaim the written frames before growing the buffer
+		if (head && queued.size() + frame.size() > queued.capacity())
+		{
+			queued.erase(queued.begin(), queued.begin() + head);
+			head = 0;
+		}
+		queued.insert(queued.end(), frame.begin(), frame.end());
+		return true;
+	}
+
+	/*! Write whole queued messages and flush them as long as the stream accepts data without blocking.
+		Return whether all messages were written; on failure the stream is disconnected and the hub will close it.
+	*/
+	bool OutputQueue::drain()
+	{
+		try
+		{
+			while (!isEmpty() && !disconnected && isWritable())
+			{
+				// a chunk of whole messages, small enough to fit in the buffer of a socket reported writable
+				size_t chunkEnd(head + frameSizeAt(head));
+				while (chunkEnd < queued.size() && chunkEnd + frameSizeAt(chunkEnd) - head <= WRITE_CHUNK_SIZE)
+					chunkEnd += frameSizeAt(chunkEnd);
+				stream->write(&queued[head], chunkEnd - head);
+				stream->flush();
+				head = chunkEnd;
+			}
+		}
+		catch (DashelException e)
+		{
+			disconnected = true;
+		}
+
+		if (isEmpty())
+		{
+			queued.clear();
+			head = 0;
+		}
+		return isEmpty();
+	}
+
+	//! Return whether the stream accepts data without blocking, streams other than sockets are assumed to always do
+	bool OutputQueue::isWritable() const
+	{
+		const ParameterSet target(stream->getTarget());
+		if (!target.isSet("sock") || target.get<int>("sock") < 0)
+			return true;
+		const int sock(target.get<int>("sock"));
+#ifdef _WIN32
+		fd_set writeSet;
+		FD_ZERO(&writeSet);
+		FD_SET(SOCKET(sock), &writeSet);
+		timeval timeout = { 0, 0 };
+		return select(0, nullptr, &writeSet, nullptr, &timeout) > 0;
+#else // _WIN32
+		pollfd pollFd = { sock, POLLOUT, 0 };
+		return poll(&pollFd, 1, 0) > 0 && (pollFd.revents & POLLOUT);
+#endif // _WIN32
+	}
+
+	//! Return the size of the frame starting at pos in the queue
+	size_t OutputQueue::frameSizeAt(size_t pos) const
+	{
+		return RawMessage::headerSize + (queued[pos] | (size_t(queued[pos + 1]) << 8));
+	}
+
+	//! Drop whole messages from the front of the queue until at least size bytes are freed
+	void OutputQueue::dropOldest(size_t size)
+	{
+		const size_t start(head);
+		while (head - start < size && !isEmpty())
+		{
+			head += frameSizeAt(head);
+			++droppedMessages;
+		}
+		droppedBytes += head - start;
+	}
+
+	/*@}*/
+};
@@ -0,0 +1,91 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_SWITCH_OUTPUT_QUEUE
+#define ASEBA_SWITCH_OUTPUT_QUEUE
+
+#include <vector>
+#include "../../common/msg/msg.h"
+
+namespace Dashel
+{
+	class Stream;
+}
+
+namespace Aseba
+{
+	/** \addtogroup switch */
+	/*@{*/
+
+	/*!
+		A bounded queue of messages to a stream, written by the thread of the switch whenever the stream accepts data.
+		A client that does not read its messages fast enough does not stall the switch: its messages stay queued,
+		and once the queue is full it either loses its oldest messages or gets disconnected.
+		Dashel streams are not thread-safe, so all writes happen in the thread of the hub owning the stream.
+	*/
+	class OutputQueue
+	{
+		public:
+			//! What to do with a message that does not fit in the queue
+			enum class OverflowPolicy
+			{
+				DROP_OLDEST, //!< drop the oldest queued messages to make room for it
+				DISCONNECT //!< drop it and consider the stream disconnected
+			};
+
+			OutputQueue(Dashel::Stream* stream, size_t capacity, OverflowPolicy policy);
+
+			bool push(const RawMessage& message);
+			bool drain();
+
+			//! Return whether no message waits to be written
+			bool isEmpty() const { return head == queued.size(); }
+			//! Return whether the stream overflowed with the DISCONNECT policy or failed to be written, no message is queued anymore then
+			bool isDisconnected() const { return disconnected; }
+			//! Return the number of bytes waiting to be written
+			size_t getQueuedBytes() const { return queued.size() - head; }
+			//! Return the number of messages dropped because the queue was full
+			unsigned long long getDroppedMessages() const { return droppedMessages; }
+			//! Return the number of bytes dropped because the queue was full
+			unsigned long long getDroppedBytes() const { return droppedBytes; }
+
+			static const size_t WRITE_CHUNK_SIZE = 1024; //!< maximum number of bytes written at once to a stream accepting data
+
+		protected:
+			bool isWritable() const;
+			size_t frameSizeAt(size_t pos) const;
+			void dropOldest(size_t size);
+
+		private:
+			Dashel::Stream* const stream; //!< stream to write to
+			const size_t capacity; //!< maximum number of bytes waiting to be written
+			const OverflowPolicy policy; //!< what to do when capacity is exceeded
+
+			std::vector<uint8_t> queued; //!< frames of messages, one after the other, the ones before head are written
+			size_t head = 0; //!< position of the first frame not written yet
+			bool disconnected = false; //!< has the stream overflowed or failed
+			unsigned long long droppedMessages = 0; //!< number of messages dropped on overflow
+			unsigned long long droppedBytes = 0; //!< number of bytes dropped on overflow
+	};
+
+	/*@}*/
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+#include "routes.h"
+#include "../../common/consts.h"
+
+namespace Aseba
+{
+	using namespace std;
+	using namespace Dashel;
+
+	/** \addtogroup switch */
+	/*@{*/
+
+	//! Remember on which stream the node sending message is if it announces itself, return whether this route is new
+	bool Routes::learn(Stream* stream, const RawMessage& message)
+	{
+		const uint16_t type(message.getType());
+		const uint16_t source(message.getSource());
+		if ((type != ASEBA_MESSAGE_NODE_PRESENT && type != ASEBA_MESSAGE_DESCRIPTION) || source == ASEBA_DEST_DEBUG)
+			return false;
+		// nodes with the same id on different streams all keep receiving their commands
+		return nodeRoutes[source].insert(stream).second;
+	}
+
+	//! Return the streams hosting the destination of message if it is a command for a known node, streams otherwise
+	const Routes::Streams& Routes::destinations(const RawMessage& message, const Streams& streams) const
+	{
+		if (!message.isCommand())
+			return streams;
+		const NodeRoutes::const_iterator routeIt(nodeRoutes.find(message.getDest()));
+		return routeIt != nodeRoutes.end() ? routeIt->second : streams;
+	}
+
+	//! Only send to stream the messages of some types and from some nodes, all if empty, replacing its previous filter
+	void Routes::filter(Stream* stream, const set<uint16_t>& types, const set<uint16_t>& sources)
+	{
+		if (types.empty() && sources.empty())
+			messageFilters.erase(stream);
+		else
+			messageFilters[stream] = MessageFilter{types, sources};
+	}
+
+	//! Filter the messages sent to stream as asked by a SwitchSubscribe message, return false if it is malformed
+	bool Routes::subscribe(Stream* stream, RawMessage& subscription)
+	{
+		// the payload must at least hold the count of types and be made of words
+		const size_t payloadSize(subscription.getPayloadSize());
+		if (payloadSize < 2 || payloadSize % 2 != 0)
+			return false;
+
+		unique_ptr<Message> message(subscription.toMessage());
+		const auto& subscribe(static_cast<const SwitchSubscribe&>(*message));
+		filter(stream,
+			set<uint16_t>(subscribe.types.begin(), subscribe.types.end()),
+			set<uint16_t>(subscribe.sources.begin(), subscribe.sources.end())
+		);
+		return true;
+	}
+
+	//! Return whether stream accepts message according to its filter
+	bool Routes::accepts(Stream* stream, const RawMessage& message) const
+	{
+		if (messageFilters.empty())
+			return true;
+		const MessageFilters::const_iterator filterIt(messageFilters.find(stream));
+		return filterIt == messageFilters.end() || filterIt->second.accepts(message);
+	}
+
+	//! Forget the routes and filter of stream
+	void Routes::forget(Stream* stream)
+	{
+		messageFilters.erase(stream);
+		for (NodeRoutes::iterator it = nodeRoutes.begin(); it != nodeRoutes.end();)
+		{
+			it->second.erase(stream);
+			if (it->second.empty())
+				it = nodeRoutes.erase(it);
+			else
+				++it;
+		}
+	}
+
+	//! Return whether message is one of those subscribed to
+	bool Routes::MessageFilter::accepts(const RawMessage& message) const
+	{
+		return (types.empty() || types.count(message.getType())) &&
+			(sources.empty() || sources.count(message.getSource()));
+	}
+
+	/*@}*/
+};
@@ -0,0 +1,78 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_SWITCH_ROUTES
+#define ASEBA_SWITCH_ROUTES
+
+#include <map>
+#include <set>
+#include "../../common/msg/msg.h"
+
+namespace Dashel
+{
+	class Stream;
+}
+
+namespace Aseba
+{
+	/** \addtogroup switch */
+	/*@{*/
+
+	/*!
+		The streams a switch sends each message to.
+		Commands only go to the streams on which their destination node announced itself, when it did,
+		and other messages to all streams. A stream might also only accept some types of messages or
+		messages from some nodes. Routes only know streams by their address, not through the hub.
+	*/
+	class Routes
+	{
+		public:
+			//! A set of streams, as in the hub
+			typedef std::set<Dashel::Stream*> Streams;
+
+			bool learn(Dashel::Stream* stream, const RawMessage& message);
+			const Streams& destinations(const RawMessage& message, const Streams& streams) const;
+			void filter(Dashel::Stream* stream, const std::set<uint16_t>& types, const std::set<uint16_t>& sources);
+			bool subscribe(Dashel::Stream* stream, RawMessage& subscription);
+			bool accepts(Dashel::Stream* stream, const RawMessage& message) const;
+			void forget(Dashel::Stream* stream);
+
+		private:
+			//! The messages a stream subscribed to
+			struct MessageFilter
+			{
+				std::set<uint16_t> types; //!< types of messages to send, all if empty
+				std::set<uint16_t> sources; //!< nodes to send messages from, all if empty
+
+				bool accepts(const RawMessage& message) const;
+			};
+			//! A table of filters for streams that do not want all messages
+			typedef std::map<Dashel::Stream*, MessageFilter> MessageFilters;
+			MessageFilters messageFilters; //!< filters for streams, streams without one receive everything
+
+			//! A table of the streams on which nodes have announced themselves, by node id
+			typedef std::map<uint16_t, Streams> NodeRoutes;
+			NodeRoutes nodeRoutes; //!< streams to send the commands for a node to
+	};
+
+	/*@}*/
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include <valarray>
 #include <vector>
 #include <iterator>
+#include <memory>
 #include "switch.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
 #include "../../common/consts.h"
@@ -56,7 +57,7 @@ namespace Aseba
 	/*@{*/
 
 	//! Broadcast messages form any data stream to all others data streams including itself.
-	Switch::Switch(unsigned port, std::string name, bool verbose, bool dump, bool forward, bool rawTime) :
+	Switch::Switch(unsigned port, std::string name, bool verbose, bool dump, bool forward, bool rawTime, size_t flushSize, unsigned flushLatency) :
 		#ifdef DASHEL_VERSION_INT
 		Dashel::Hub(verbose || dump),
 		#endif // DASHEL_VERSION_INT
@@ -67,7 +68,9 @@ namespace Aseba
 		verbose(verbose),
 		dump(dump),
 		forward(forward),
-		rawTime(rawTime)
+		rawTime(rawTime),
+		flushSize(flushSize),
+		flushLatency(flushLatency)
 	{
 		ostringstream oss;
 		oss << "tcpin:port=" << port;
@@ -108,63 +111,100 @@ namespace Aseba
 		}
 #endif // ZEROCONF_SUPPORT
 
-		Message* message(Message::receive(stream));
+		// the switch only routes messages, so it reads them without deserializing their payload
+		frame.receive(stream);
 
 		// remap source
 		{
 			const IdRemapTable::const_iterator remapIt(idRemapTable.find(stream));
 			if (remapIt != idRemapTable.end() &&
-				(message->source == remapIt->second.second)
+				(frame.getSource() == remapIt->second.second)
 			)
-				message->source = remapIt->second.first;
+				frame.setSource(remapIt->second.first);
 		}
 
 		// if requested, dump
 		if (dump)
 		{
+			unique_ptr<Message> message(frame.toMessage());
 			dumpTime(cout, rawTime);
 			std::cout << "  ";
 			message->dump(std::wcout);
 			std::wcout << std::endl;
 		}
 
-		// write on all connected streams
-		CmdMessage* cmdMessage(dynamic_cast<CmdMessage*>(message));
-		for (StreamsSet::iterator it = dataStreams.begin(); it != dataStreams.end();++it)
+		// a client subscribing to some messages talks to the switch only
+		if (frame.getType() == ASEBA_MESSAGE_SWITCH_SUBSCRIBE)
+		{
+			subscribe(stream);
+			return;
+		}
+
+		// remember on which stream the sending node is, if it announces itself
+		if (routes.learn(stream, frame) && verbose)
+		{
+			dumpTime(cout, rawTime);
+			cout << "* Routing commands for node " << frame.getSource() << " to " << stream->getTargetName() << endl;
+		}
+
+		// send commands only to the streams hosting their destination if known, and broadcast other messages
+		const bool isCommand(frame.isCommand());
+		const StreamsSet& destStreams(routes.destinations(frame, dataStreams));
+		for (StreamsSet::const_iterator it = destStreams.begin(); it != destStreams.end();++it)
 		{
 			Stream* destStream = *it;
 
 			if ((forward) && (destStream == stream))
 				continue;
 
-			try
+			if (!routes.accepts(destStream, frame))
+				continue;
+
+			forwardTo(destStream, isCommand);
+		}
+	}
+
+	//! Filter the messages sent to stream as asked by the subscription in the current frame
+	void Switch::subscribe(Stream *stream)
+	{
+		const bool subscribed(routes.subscribe(stream, frame));
+		if (verbose)
+		{
+			dumpTime(cout, rawTime);
+			if (subscribed)
+				cout << "* Filtering messages to " << stream->getTargetName() << " as it subscribed" << endl;
+			else
+				cout << "* Ignoring malformed subscription from " << stream->getTargetName() << endl;
+		}
+	}
+
+	//! Write the current frame to destStream, only patching the destination of remapped commands in place
+	void Switch::forwardTo(Stream *destStream, bool isCommand)
+	{
+		try
+		{
+			const IdRemapTable::const_iterator remapIt(idRemapTable.find(destStream));
+			if (isCommand &&
+				remapIt != idRemapTable.end())
 			{
-				const IdRemapTable::const_iterator remapIt(idRemapTable.find(destStream));
-				if (cmdMessage && 
-					remapIt != idRemapTable.end())
-				{
-					if (cmdMessage->dest == remapIt->second.first)
-					{
-						const uint16_t oldDest(cmdMessage->dest);
-						cmdMessage->dest = remapIt->second.second;
-						message->serialize(destStream);
-						cmdMessage->dest = oldDest;
-					}
-				}
-				else
+				if (frame.getDest() == remapIt->second.first)
 				{
-					message->serialize(destStream);
+					const uint16_t oldDest(frame.getDest());
+					frame.setDest(remapIt->second.second);
+					write(destStream, frame);
+					frame.setDest(oldDest);
 				}
-				destStream->flush();
 			}
-			catch (DashelException e)
+			else
 			{
-				// if this stream has a problem, ignore it for now, and let Hub call connectionClosed later.
-				std::cerr << "error while writing" << std::endl;
+				write(destStream, frame);
 			}
 		}
-
-		delete message;
+		catch (DashelException e)
+		{
+			// if this stream has a problem, ignore it for now, and let Hub call connectionClosed later.
+			std::cerr << "error while writing" << std::endl;
+		}
 	}
 
 	void Switch::connectionClosed(Stream *stream, bool abnormal)
@@ -177,6 +217,8 @@ namespace Aseba
 		}
 #endif // ZEROCONF_SUPPORT
 
+		forgetStream(stream);
+
 		if (verbose)
 		{
 			dumpTime(cout, rawTime);
@@ -191,12 +233,126 @@ namespace Aseba
 	{
 		Aseba::UserMessage uMsg;
 		uMsg.type = 0;
+		frame.encode(uMsg);
 		//for (int i = 0; i < 80; i++)
 		for (StreamsSet::iterator it = dataStreams.begin(); it != dataStreams.end();++it)
 		{
-			uMsg.serialize(*it);
-			(*it)->flush();
+			write(*it, frame);
+			flush(*it);
+		}
+	}
+
+	void Switch::setOutputQueues(size_t size, OutputQueue::OverflowPolicy policy)
+	{
+		outputQueueSize = size;
+		overflowPolicy = policy;
+	}
+
+	//! Write message to stream, and only flush it if enough output is pending or if it has waited long enough
+	void Switch::write(Stream *stream, const RawMessage& message)
+	{
+		if (outputQueueSize)
+		{
+			OutputQueues::iterator queueIt(outputQueues.find(stream));
+			if (queueIt == outputQueues.end())
+				queueIt = outputQueues.emplace(stream, OutputQueue(stream, outputQueueSize, overflowPolicy)).first;
+			// a disconnected stream will be closed at the end of the step
+			if (!queueIt->second.push(message))
+				return;
+		}
+		else
+			message.serialize(stream);
+
+		const auto now(chrono::steady_clock::now());
+		const PendingOutputs::iterator pendingIt(pendingOutputs.emplace(stream, PendingOutput{0, now}).first);
+		pendingIt->second.size += message.frame.rawData.size();
+		if (pendingIt->second.size >= flushSize || now - pendingIt->second.since >= flushLatency)
+		{
+			pendingOutputs.erase(pendingIt);
+			flush(stream);
+		}
+	}
+
+	//! Flush stream, or write as much of its output queue as it accepts without blocking if it has one
+	void Switch::flush(Stream *stream)
+	{
+		const OutputQueues::iterator queueIt(outputQueues.find(stream));
+		if (queueIt != outputQueues.end())
+			queueIt->second.drain();
+		else
+			stream->flush();
+	}
+
+	void Switch::flushPendingOutputs()
+	{
+		// flushing may fail and close streams, so work on a copy of the set of pending ones
+		PendingOutputs toFlush;
+		toFlush.swap(pendingOutputs);
+		for (const auto& pendingOutput: toFlush)
+		{
+			try
+			{
+				flush(pendingOutput.first);
+			}
+			catch (DashelException e)
+			{
+				// if this stream has a problem, ignore it for now, and let Hub call connectionClosed later.
+				std::cerr << "error while flushing" << std::endl;
+			}
+		}
+
+		// clients that did not accept all their messages earlier might have read some since
+		for (auto& queue: outputQueues)
+			if (!queue.second.isEmpty())
+				queue.second.drain();
+
+		closeDisconnectedStreams();
+	}
+
+	int Switch::getStepTimeout() const
+	{
+		for (const auto& queue: outputQueues)
+			if (!queue.second.isEmpty() && !queue.second.isDisconnected())
+				return int(flushLatency.count());
+		return -1;
+	}
+
+	//! Close the streams whose output queue overflowed with the DISCONNECT policy or failed to be written
+	void Switch::closeDisconnectedStreams()
+	{
+		vector<Stream*> toClose;
+		for (const auto& queue: outputQueues)
+			if (queue.second.isDisconnected())
+				toClose.push_back(queue.first);
+
+		for (Stream* stream: toClose)
+		{
+			if (verbose)
+			{
+				dumpTime(cout, rawTime);
+				cout << "* Disconnecting " << stream->getTargetName() << " : output queue overflowed or failed with " << outputQueues.at(stream).getQueuedBytes() << " bytes queued" << endl;
+			}
+			forgetStream(stream);
+			closeStream(stream);
+		}
+	}
+
+	//! Forget everything known about stream, dropping its queued output
+	void Switch::forgetStream(Stream *stream)
+	{
+		const OutputQueues::iterator queueIt(outputQueues.find(stream));
+		if (queueIt != outputQueues.end())
+		{
+			if (verbose && queueIt->second.getDroppedMessages())
+			{
+				dumpTime(cout, rawTime);
+				cout << "* Dropped " << queueIt->second.getDroppedMessages() << " messages (" << queueIt->second.getDroppedBytes() << " bytes) to " << stream->getTargetName() << endl;
+			}
+			outputQueues.erase(queueIt);
 		}
+
+		pendingOutputs.erase(stream);
+		routes.forget(stream);
 	}
 
 	void Switch::remapId(Dashel::Stream* stream, const uint16_t localId, const uint16_t targetId)
@@ -204,6 +360,11 @@ namespace Aseba
 		idRemapTable[stream] = IdPair(localId, targetId);
 	}
 
+	void Switch::filterMessages(Dashel::Stream* stream, const std::set<uint16_t>& types, const std::set<uint16_t>& sources)
+	{
+		routes.filter(stream, types, sources);
+	}
+
 	/*@}*/
 };
 
@@ -219,12 +380,31 @@ void dumpHelp(std::ostream &stream, const char *programName)
 	stream << "-p port         : listens to incoming connection on this port\n";
 	stream << "-n, --name name : use this name if advertising\n";
 	stream << "--rawtime       : shows time in the form of sec:usec since 1970\n";
+	stream << "--flush-size n  : flushes output to a client once n bytes are pending (default: " << Aseba::Switch::DEFAULT_FLUSH_SIZE << ", 0: every message)\n";
+	stream << "--flush-latency ms : flushes output to a client at most ms milliseconds after a message (default: " << Aseba::Switch::DEFAULT_FLUSH_LATENCY << ")\n";
+	stream << "--queue-size n  : queues at most n bytes for a client not accepting data, instead of waiting for it (default: " << Aseba::Switch::DEFAULT_OUTPUT_QUEUE_SIZE << ", 0: no queue)\n";
+	stream << "--overflow drop|disconnect : drops the oldest messages queued for a slow client, or disconnects it (default: drop)\n";
 	stream << "-h, --help      : shows this help\n";
 	stream << "-V, --version   : shows the version number\n";
 	stream << "Additional targets are any valid Dashel targets." << std::endl;
+	stream << "Their filterTypes and filterSources parameters, comma-separated lists of message types and node ids,\n";
+	stream << "restrict the messages sent to them, for instance tcp:host;port=33334;filterTypes=0,1" << std::endl;
+	stream << "Clients connecting to the switch restrict the messages sent to them by sending a switch subscribe message." << std::endl;
 	stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
 }
 
+//! Parse a comma-separated list of message types or node ids, decimal or hexadecimal
+std::set<uint16_t> parseIdList(const std::string& list)
+{
+	std::set<uint16_t> ids;
+	std::istringstream iss(list);
+	std::string id;
+	while (std::getline(iss, id, ','))
+		if (!id.empty())
+			ids.insert(uint16_t(strtol(id.c_str(), nullptr, 0)));
+	return ids;
+}
+
 //! Show version
 void dumpVersion(std::ostream &stream)
 {
@@ -242,6 +422,10 @@ int main(int argc, char *argv[])
 	bool dump = false;
 	bool forward = true;
 	bool rawTime = false;
+	size_t flushSize = Aseba::Switch::DEFAULT_FLUSH_SIZE;
+	unsigned flushLatency = Aseba::Switch::DEFAULT_FLUSH_LATENCY;
+	size_t outputQueueSize = Aseba::Switch::DEFAULT_OUTPUT_QUEUE_SIZE;
+	Aseba::OutputQueue::OverflowPolicy overflowPolicy = Aseba::OutputQueue::OverflowPolicy::DROP_OLDEST;
 	std::vector<std::string> additionalTargets;
 
 	int argCounter = 1;
@@ -287,6 +471,54 @@ int main(int argc, char *argv[])
 		{
 			rawTime = true;
 		}
+		else if (strcmp(arg, "--flush-size") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "flush size needed" << std::endl;
+				return 1;
+			}
+			arg = argv[++argCounter];
+			flushSize = atoi(arg);
+		}
+		else if (strcmp(arg, "--flush-latency") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "flush latency needed" << std::endl;
+				return 1;
+			}
+			arg = argv[++argCounter];
+			flushLatency = atoi(arg);
+		}
+		else if (strcmp(arg, "--queue-size") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "queue size needed" << std::endl;
+				return 1;
+			}
+			arg = argv[++argCounter];
+			outputQueueSize = atoi(arg);
+		}
+		else if (strcmp(arg, "--overflow") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "overflow policy needed" << std::endl;
+				return 1;
+			}
+			arg = argv[++argCounter];
+			if (strcmp(arg, "drop") == 0)
+				overflowPolicy = Aseba::OutputQueue::OverflowPolicy::DROP_OLDEST;
+			else if (strcmp(arg, "disconnect") == 0)
+				overflowPolicy = Aseba::OutputQueue::OverflowPolicy::DISCONNECT;
+			else
+			{
+				std::cerr << "unknown overflow policy " << arg << std::endl;
+				return 1;
+			}
+		}
 		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
 		{
 			dumpHelp(std::cout, argv[0]);
@@ -306,7 +538,8 @@ int main(int argc, char *argv[])
 
 	try
 	{
-		Aseba::Switch aswitch(port, name, verbose, dump, forward, rawTime);
+		Aseba::Switch aswitch(port, name, verbose, dump, forward, rawTime, flushSize, flushLatency);
+		aswitch.setOutputQueues(outputQueueSize, overflowPolicy);
 		for (size_t i = 0; i < additionalTargets.size(); i++)
 		{
 			const std::string& target(additionalTargets[i]);
@@ -324,6 +557,19 @@ int main(int argc, char *argv[])
 				if (verbose)
 					std::cout << "* Remapping local " << remappedLocalId << " with remote " << remappedTargetId << std::endl;
 			}
+
+			// see whether this stream only subscribes to some messages
+			Dashel::ParameterSet filterDecoder;
+			filterDecoder.add("dummy:filterTypes=;filterSources=");
+			filterDecoder.add(target.c_str());
+			const std::set<uint16_t> filteredTypes(parseIdList(filterDecoder.get("filterTypes")));
+			const std::set<uint16_t> filteredSources(parseIdList(filterDecoder.get("filterSources")));
+			if (!filteredTypes.empty() || !filteredSources.empty())
+			{
+				aswitch.filterMessages(stream, filteredTypes, filteredSources);
+				if (verbose)
+					std::cout << "* Filtering messages to " << target << std::endl;
+			}
 		}
 		/*
 		Uncomment this and comment aswitch.run() to flood all peers with dummy user messages
@@ -332,11 +578,13 @@ int main(int argc, char *argv[])
 			aswitch.step(10);
 			aswitch.broadcastDummyUserMessage();
 		}*/
+		// output is flushed after each step, so that messages never wait for a new one to arrive
 #ifdef ZEROCONF_SUPPORT
-		while(aswitch.zeroconf.dashelStep(-1));
+		while(aswitch.zeroconf.dashelStep(aswitch.getStepTimeout()))
 #else // ZEROCONF_SUPPORT
-		while(aswitch.step(-1));
+		while(aswitch.step(aswitch.getStepTimeout()))
 #endif // ZEROCONF_SUPPORT
+			aswitch.flushPendingOutputs();
 	}
 	catch(Dashel::DashelException e)
 	{
@@ -22,8 +22,13 @@
 #define ASEBA_SWITCH
 
 #include <dashel/dashel.h>
+#include <chrono>
 #include <map>
+#include <set>
 #include "../../common/types.h"
+#include "../../common/msg/msg.h"
+#include "output-queue.h"
+#include "routes.h"
 #ifdef ZEROCONF_SUPPORT
 #include "../../common/zeroconf/zeroconf-dashelhub.h"
 #endif // ZEROCONF_SUPPORT
@@ -37,6 +42,10 @@ namespace Aseba
 
 	/*!
 		Route Aseba messages on the TCP part of the network.
+		Commands are only sent to the streams hosting their destination node, when the switch knows them
+		from the node's presence or description; other messages are broadcast.
+		A stream receiving only some messages is set either when connecting it, or by its client sending a
+		SwitchSubscribe message, which the switch handles instead of forwarding it.
 	*/
 	class Switch: public Dashel::Hub
 	{
@@ -45,8 +54,32 @@ namespace Aseba
 				@param verbose should we print a notification on each message
 				@param dump should we dump content of each message
 				@param forward should we only forward messages instead of transmit them back to the sender
+				@param flushSize number of bytes written to a stream above which it is flushed immediately, 0 to flush every message
+				@param flushLatency maximum time in milliseconds a message written to a stream waits for a flush
 			*/
-			Switch(unsigned port, std::string name, bool verbose, bool dump, bool forward, bool rawTime);
+			Switch(unsigned port, std::string name, bool verbose, bool dump, bool forward, bool rawTime, size_t flushSize = DEFAULT_FLUSH_SIZE, unsigned flushLatency = DEFAULT_FLUSH_LATENCY);
+
+			static const size_t DEFAULT_FLUSH_SIZE = 1024; //!< default number of pending bytes triggering a flush
+			static const unsigned DEFAULT_FLUSH_LATENCY = 10; //!< default maximum delay of a flush, in milliseconds
+			static const size_t DEFAULT_OUTPUT_QUEUE_SIZE = 0; //!< default maximum number of bytes queued for a stream, queues are opt-in
+
+			/*! Set how messages are queued for each stream, to be written once the stream accepts data without blocking.
+				@param size maximum number of bytes queued for a stream, 0 to write messages synchronously
+				@param policy what to do with a message that does not fit in the queue of a stream
+			*/
+			void setOutputQueues(size_t size, OutputQueue::OverflowPolicy policy);
+
+			/*! Flush all streams with pending output, to be called after each step of the hub.
+				Messages forwarded during a step are written without flushing, so that they are sent together.
+				Output queues are written as far as their streams accept data, and streams whose output queue
+				overflowed with the DISCONNECT policy or failed are closed.
+			*/
+			void flushPendingOutputs();
+
+			/*! Return the timeout in milliseconds for the next step of the hub, -1 to wait for data.
+				Streams with queued output are retried after the flush latency, as the hub only waits for incoming data.
+			*/
+			int getStepTimeout() const;
 
 			/*! Forwards the data received for a connections to the other ones.
 				If forward is false, transmit it back to the sender too.
@@ -64,6 +97,13 @@ namespace Aseba
 			*/
 			void remapId(Dashel::Stream* stream, const uint16_t localId, const uint16_t targetId);
 
+			/*! Only send to a stream the messages of some types or from some nodes, replacing its previous filter
+				@param stream the stream to filter messages sent to
+				@param types the types of messages to send, including user events, all if empty
+				@param sources the nodes to send messages from, all if empty
+			*/
+			void filterMessages(Dashel::Stream* stream, const std::set<uint16_t>& types, const std::set<uint16_t>& sources);
+
 #ifdef ZEROCONF_SUPPORT
 			/*! The switch provides a Zeroconf service, used to advertise the switch
 			    and potentially the nodes it provides.
@@ -76,6 +116,13 @@ namespace Aseba
 			virtual void incomingData(Dashel::Stream *stream);
 			virtual void connectionClosed(Dashel::Stream *stream, bool abnormal);
 
+			void subscribe(Dashel::Stream *stream);
+			void forwardTo(Dashel::Stream *destStream, bool isCommand);
+			void write(Dashel::Stream *stream, const RawMessage& message);
+			void flush(Dashel::Stream *stream);
+			void closeDisconnectedStreams();
+			void forgetStream(Dashel::Stream *stream);
+
 		private:
 #ifdef ZEROCONF_SUPPORT
 			std::string zeroconfName; //!< name of this switch, if we want to advertise it
@@ -90,6 +137,29 @@ namespace Aseba
 			//! A table allowing to remap the aseba node id of streams
 			typedef std::map<Dashel::Stream*, IdPair> IdRemapTable;
 			IdRemapTable idRemapTable; //!< table for remapping id
+
+			Routes routes; //!< streams to send messages to, learnt from nodes announcing themselves and subscriptions
+
+			size_t flushSize; //!< number of pending bytes above which a stream is flushed immediately
+			std::chrono::milliseconds flushLatency; //!< maximum time a message waits for its stream to be flushed
+
+			//! Output written to a stream but not flushed yet
+			struct PendingOutput
+			{
+				size_t size; //!< number of bytes written since the last flush
+				std::chrono::steady_clock::time_point since; //!< time of the first write since the last flush
+			};
+			//! Streams with pending output
+			typedef std::map<Dashel::Stream*, PendingOutput> PendingOutputs;
+			PendingOutputs pendingOutputs; //!< output waiting for the end of the step to be flushed
+
+			size_t outputQueueSize = DEFAULT_OUTPUT_QUEUE_SIZE; //!< maximum number of bytes queued for a stream, 0 to write synchronously
+			OutputQueue::OverflowPolicy overflowPolicy = OutputQueue::OverflowPolicy::DROP_OLDEST; //!< what to do when an output queue is full
+			//! Queues of messages to streams, written when they accept data
+			typedef std::map<Dashel::Stream*, OutputQueue> OutputQueues;
+			OutputQueues outputQueues; //!< created when a stream is first written to
+
+			RawMessage frame; //!< last message received, its storage is reused as the hub reads streams one at a time
 	};
 
 	/*@}*/
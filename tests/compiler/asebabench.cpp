@@ -0,0 +1,494 @@
+// Aseba
+#include "../../compiler/compiler.h"
+#include "../../compiler/tree.h"
+#include "../../vm/natives.h"
+#include "../../common/consts.h"
+#include "../../common/utils/utils.h"
+#include "../../common/utils/FormatableString.h"
+using namespace Aseba;
+
+// C++
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// C
+#include <getopt.h>		// getopt_long()
+#include <stdlib.h>		// exit()
+
+// defines
+#define DEFAULT_REPETITIONS	20
+#define DEFAULT_THRESHOLD	10
+
+static const AsebaNativeFunctionDescription* nativeFunctionsDescriptions[] =
+{
+	ASEBA_NATIVES_STD_DESCRIPTIONS,
+	0
+};
+
+// number of calls to operator new, counted in asebabenchallocations.cpp
+size_t getAllocationsCount();
+
+static const char short_options [] = "r:s:c:t:l";
+static const struct option long_options[] = {
+	{ "repetitions",	required_argument,	nullptr,	'r'},
+	{ "save",		required_argument,	nullptr,	's'},
+	{ "compare",		required_argument,	nullptr,	'c'},
+	{ "threshold",		required_argument,	nullptr,	't'},
+	{ "list",		no_argument,		nullptr,	'l'},
+	{ 0, 0, 0, 0 }
+};
+
+static void usage (int argc, char** argv)
+{
+	std::cerr 	<< "Usage: " << argv[0] << " [options] [source]*" << std::endl << std::endl
+			<< "Measure each phase of the compiler on the given sources and on generated stress programs." << std::endl << std::endl
+			<< "Options:" << std::endl
+			<< "    -r | --repetitions N  Number of runs per source, the median is reported (default: " << DEFAULT_REPETITIONS << ")" << std::endl
+			<< "    -l | --list           Print the measures of every source, not only the summary per phase" << std::endl
+			<< "    -s | --save FILE      Save the summary per phase in FILE, to be used as a baseline" << std::endl
+			<< "    -c | --compare FILE   Compare the summary per phase to the baseline in FILE, fail on regressions" << std::endl
+			<< "    -t | --threshold P    Allowed increase in percent over the baseline (default: " << DEFAULT_THRESHOLD << ")" << std::endl;
+}
+
+// the phases of Compiler::compile, in execution order
+static const unsigned PHASES_COUNT(CompilationStatistics::PHASES_COUNT);
+
+//! Short names of the phases, to fit in columns
+static const char* phaseNames[PHASES_COUNT] = {
+	"tokenize",
+	"parse",
+	"vecsize",
+	"expand",
+	"typecheck",
+	"optimize",
+	"emit",
+	"verify",
+	"link"
+};
+
+//! Duration and allocations of one phase
+struct PhaseMeasure
+{
+	double time{0}; //!< duration in microseconds
+	size_t allocations{0}; //!< number of calls to operator new
+};
+
+using PhaseMeasures = std::array<PhaseMeasure, PHASES_COUNT>;
+
+//! Run the phases of the compiler one by one, following Compiler::compile
+struct BenchmarkCompiler: public Compiler
+{
+	//! Compile source and measure each phase, return the number of phases that completed
+	unsigned compile(const std::wstring& source, PhaseMeasures& measures)
+	{
+		buildMaps();
+
+		std::unique_ptr<Node> program;
+		PreLinkBytecode preLinkBytecode;
+		BytecodeVector bytecode;
+		const std::function<void()> phases[PHASES_COUNT] = {
+			[&]() {
+				std::wistringstream stream(source);
+				tokenize(stream);
+			},
+			[&]() {
+				program.reset(parseProgram());
+			},
+			[&]() {
+				program->checkVectorSize();
+			},
+			[&]() {
+				Node* expandedProgram(program->expandAbstractNodes(nullptr));
+				program.release();
+				program.reset(expandedProgram);
+				endVariableIndex = temporaryMemoryPeak;
+				expandedProgram = program->expandVectorialNodes(nullptr, this);
+				program.release();
+				program.reset(expandedProgram);
+			},
+			[&]() {
+				program->typeCheck(this);
+			},
+			[&]() {
+				propagateConstants(program.get(), nullptr);
+				Node* optimizedProgram(program->optimize(nullptr));
+				program.release();
+				program.reset(optimizedProgram);
+				eliminateCommonSubexpressions(program.get(), nullptr);
+				eliminateDeadCode(program.get(), nullptr);
+			},
+			[&]() {
+				program->emit(preLinkBytecode);
+				preLinkBytecode.fixup(subroutineTable);
+				preLinkBytecode.peepholeOptimize(nullptr);
+			},
+			[&]() {
+				verifyStackCalls(preLinkBytecode);
+				boundInstructions(preLinkBytecode);
+			},
+			[&]() {
+				if (!link(preLinkBytecode, bytecode))
+					throw TranslatableError(SourcePos(), ERROR_SCRIPT_TOO_BIG);
+			}
+		};
+
+		for (unsigned phase = 0; phase < PHASES_COUNT; ++phase)
+		{
+			const size_t allocationsBefore(getAllocationsCount());
+			const auto start(std::chrono::steady_clock::now());
+			try
+			{
+				phases[phase]();
+			}
+			catch (const TranslatableError&)
+			{
+				// erroneous programs are part of the corpus, the phases until the error are measured
+				return phase;
+			}
+			measures[phase].time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+			measures[phase].allocations = getAllocationsCount() - allocationsBefore;
+		}
+		return PHASES_COUNT;
+	}
+};
+
+//! A program to measure
+struct BenchmarkSource
+{
+	std::string name;
+	std::wstring source;
+};
+
+static std::wstring readSource(const std::string& filename)
+{
+	std::ifstream ifs(filename.c_str(), std::ifstream::binary);
+	if (!ifs.is_open())
+	{
+		std::cerr << "Error opening source file " << filename << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	std::ostringstream utf8Source;
+	utf8Source << ifs.rdbuf();
+	return UTF8ToWString(utf8Source.str());
+}
+
+//! Number of global events declared for the generated programs
+static const unsigned generatedEventsCount(100);
+
+//! A large program using identifiers, literals, operators and comments in typical proportions
+static std::wstring largeProgram(unsigned variablesCount)
+{
+	std::wostringstream oss;
+	oss << L"#* generated program\n   to stress the lexer *#\n";
+	for (unsigned i = 0; i < variablesCount; ++i)
+		oss << L"var variable_" << i << L"[4] = [" << i << L", 0x" << std::hex << i << std::dec << L", 0b101, -" << i << L"]\n";
+	for (unsigned i = 0; i < variablesCount; ++i)
+	{
+		oss << L"# statement " << i << L"\n";
+		oss << L"if variable_" << i << L"[0] >= " << i << L" and variable_" << i << L"[1] != 3 then\n";
+		oss << L"\tvariable_" << i << L"[2] = (variable_" << i << L"[0] + variable_" << (i + 1) % variablesCount << L"[1]) * 3 % 7 << 1\n";
+		oss << L"end\n";
+	}
+	return oss.str();
+}
+
+//! A program with a handler for each global event
+static std::wstring manyEventsProgram()
+{
+	std::wostringstream oss;
+	oss << L"var counters[" << generatedEventsCount << L"]\nvar sum\n";
+	for (unsigned i = 0; i < generatedEventsCount; ++i)
+	{
+		oss << L"onevent stress" << i << L"\n";
+		oss << L"\tcounters[" << i << L"] += " << i % 7 + 1 << L"\n";
+		oss << L"\tsum = sum + counters[" << i << L"] * " << i + 1 << L"\n";
+		oss << L"\tif sum > " << 100 * i << L" then\n\t\temit stress" << (i + 1) % generatedEventsCount << L" [sum, " << i << L"]\n\tend\n";
+	}
+	return oss.str();
+}
+
+//! A program with deeply nested blocks and expressions
+static std::wstring deepNestingProgram(unsigned depth)
+{
+	std::wostringstream oss;
+	oss << L"var a\nvar b\nvar i\n";
+	for (unsigned i = 0; i < depth; ++i)
+	{
+		const std::wstring indent(i, L'\t');
+		if (i % 3 == 0)
+			oss << indent << L"if a < " << i << L" then\n";
+		else if (i % 3 == 1)
+			oss << indent << L"while b > " << i << L" do\n";
+		else
+			oss << indent << L"for i in 0:" << i << L" do\n";
+		oss << indent << L"\tb = b - 1\n";
+	}
+	oss << std::wstring(depth, L'\t') << L"a = ";
+	for (unsigned i = 0; i < depth; ++i)
+		oss << L"(a + " << i << L" * ";
+	oss << L"b";
+	for (unsigned i = 0; i < depth; ++i)
+		oss << L")";
+	oss << L"\n";
+	for (unsigned i = depth; i > 0; --i)
+		oss << std::wstring(i - 1, L'\t') << L"end\n";
+	return oss.str();
+}
+
+//! A program working on large vectors
+static std::wstring largeVectorsProgram(unsigned size)
+{
+	std::wostringstream oss;
+	oss << L"var a[" << size << L"]\nvar b[" << size << L"]\nvar c[" << size << L"]\nvar d[" << size << L"]\nvar s\n";
+	oss << L"a = [";
+	for (unsigned i = 0; i < size; ++i)
+		oss << (i ? L", " : L"") << i;
+	oss << L"]\n";
+	oss << L"b = a * a + a\n";
+	oss << L"c = (a - b) * (b + a)\n";
+	oss << L"d = (a - c) | b ^ c\n";
+	oss << L"call math.dot(s, a, b, 0)\n";
+	oss << L"a[0:" << size / 2 - 1 << L"] = b[" << size / 2 << L":" << size - 1 << L"] - c[0:" << size / 2 - 1 << L"]\n";
+	oss << L"d = [a[0:" << size / 4 - 1 << L"], b[0:" << size / 4 - 1 << L"], c[0:" << size / 4 - 1 << L"], d[0:" << size - 3 * (size / 4) - 1 << L"]]\n";
+	return oss.str();
+}
+
+//! A program with many subroutines calling each other as a tree
+static std::wstring manySubroutinesProgram(unsigned count)
+{
+	std::wostringstream oss;
+	oss << L"var x\nvar y[4]\n";
+	for (unsigned i = 0; i < count; ++i)
+	{
+		oss << L"sub s" << i << L"\n";
+		oss << L"\tx = x * " << i + 1 << L" + y[" << i % 4 << L"]\n";
+		if (i > 0)
+			oss << L"\tcallsub s" << (i - 1) / 2 << L"\n";
+	}
+	oss << L"onevent test\n";
+	for (unsigned i = count; i > count - std::min(count, 16u); --i)
+		oss << L"\tcallsub s" << i - 1 << L"\n";
+	return oss.str();
+}
+
+//! Return the median of durations
+static double median(std::vector<double> durations)
+{
+	std::sort(durations.begin(), durations.end());
+	return durations[durations.size() / 2];
+}
+
+//! Summary of the measures per phase, and overall under the key "total"
+using Summary = std::map<std::string, PhaseMeasure>;
+
+static void saveSummary(const Summary& summary, const std::string& filename)
+{
+	std::ofstream ofs(filename.c_str());
+	if (!ofs.is_open())
+	{
+		std::cerr << "Error opening baseline file " << filename << " for writing" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	for (const auto& entry : summary)
+		ofs << entry.first << " " << entry.second.time << " " << entry.second.allocations << std::endl;
+}
+
+//! Compare summary to the baseline in filename, return whether no measure increased by more than threshold percent
+static bool compareSummary(const Summary& summary, const std::string& filename, double threshold)
+{
+	std::ifstream ifs(filename.c_str());
+	if (!ifs.is_open())
+	{
+		std::cerr << "Error opening baseline file " << filename << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	bool ok(true);
+	const double factor(1 + threshold / 100);
+	const double minimalTimeIncrease(50);
+	std::string name;
+	PhaseMeasure base;
+	while (ifs >> name >> base.time >> base.allocations)
+	{
+		const auto current(summary.find(name));
+		if (current == summary.end())
+			continue;
+		// below a few tens of microseconds, differences are timer noise
+		if (current->second.time > base.time * factor && current->second.time - base.time > minimalTimeIncrease)
+		{
+			std::cout << "Regression in " << name << ": " << std::fixed << std::setprecision(1) << current->second.time << " us, baseline " << base.time << " us" << std::endl;
+			ok = false;
+		}
+		if (current->second.allocations > base.allocations * factor)
+		{
+			std::cout << "Regression in " << name << ": " << current->second.allocations << " allocations, baseline " << base.allocations << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned repetitions(DEFAULT_REPETITIONS);
+	double threshold(DEFAULT_THRESHOLD);
+	std::string saveFileName;
+	std::string compareFileName;
+	bool list(false);
+
+	int c;
+	while ((c = getopt_long(argc, argv, short_options, long_options, nullptr)) != -1)
+	{
+		switch (c)
+		{
+			case 'r':
+				repetitions = std::max(1, atoi(optarg));
+				break;
+			case 's':
+				saveFileName = optarg;
+				break;
+			case 'c':
+				compareFileName = optarg;
+				break;
+			case 't':
+				threshold = atof(optarg);
+				break;
+			case 'l':
+				list = true;
+				break;
+			default:
+				usage(argc, argv);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	// the target of the compiler tests, with more space so that generated programs fit
+	TargetDescription targetDescription;
+	targetDescription.name = L"benchvm";
+	targetDescription.protocolVersion = ASEBA_PROTOCOL_VERSION;
+	targetDescription.bytecodeSize = 32768;
+	targetDescription.variablesSize = 8192;
+	targetDescription.stackSize = 1024;
+	for (const AsebaNativeFunctionDescription* const* nativeDesc = nativeFunctionsDescriptions; *nativeDesc; ++nativeDesc)
+	{
+		TargetDescription::NativeFunction native{ UTF8ToWString((*nativeDesc)->name), UTF8ToWString((*nativeDesc)->doc) };
+		for (const AsebaNativeFunctionArgumentDescription* param = (*nativeDesc)->arguments; param->size; ++param)
+			native.parameters.push_back(TargetDescription::NativeFunctionParameter(UTF8ToWString(param->name), param->size));
+		targetDescription.nativeFunctions.push_back(native);
+	}
+	TargetDescription::LocalEvent testLocalEvent;
+	testLocalEvent.name = L"test";
+	testLocalEvent.description = L"test local event";
+	targetDescription.localEvents.push_back(testLocalEvent);
+
+	CommonDefinitions definitions;
+	definitions.events.push_back(NamedValue(L"event1", 0));
+	definitions.events.push_back(NamedValue(L"event2", 3));
+	definitions.constants.push_back(NamedValue(L"FOO", 2));
+	for (unsigned i = 0; i < generatedEventsCount; ++i)
+		definitions.events.push_back(NamedValue(WFormatableString(L"stress%0").arg(i), 2));
+
+	std::vector<BenchmarkSource> sources;
+	for (int i = optind; i < argc; ++i)
+		sources.push_back({argv[i], readSource(argv[i])});
+	sources.push_back({"generated large program", largeProgram(2000)});
+	sources.push_back({"generated many events", manyEventsProgram()});
+	sources.push_back({"generated deep nesting", deepNestingProgram(60)});
+	sources.push_back({"generated large vectors", largeVectorsProgram(1000)});
+	sources.push_back({"generated many subroutines", manySubroutinesProgram(300)});
+
+	const int nameWidth(40);
+	const int columnWidth(10);
+	if (list)
+	{
+		std::cout << std::left << std::setw(nameWidth) << "source (us)" << std::right << std::setw(columnWidth) << "chars";
+		for (const auto& name : phaseNames)
+			std::cout << std::setw(columnWidth) << name;
+		std::cout << std::setw(columnWidth) << "total" << std::setw(columnWidth) << "allocs" << std::endl;
+	}
+
+	PhaseMeasures totals;
+	size_t failedCount(0);
+	for (const auto& source : sources)
+	{
+		BenchmarkCompiler compiler;
+		compiler.setTargetDescription(&targetDescription);
+		compiler.setCommonDefinitions(&definitions);
+
+		std::array<std::vector<double>, PHASES_COUNT> durations;
+		PhaseMeasures measures;
+		unsigned completedPhases(0);
+		for (unsigned i = 0; i < repetitions; ++i)
+		{
+			completedPhases = compiler.compile(source.source, measures);
+			for (unsigned phase = 0; phase < completedPhases; ++phase)
+				durations[phase].push_back(measures[phase].time);
+		}
+		if (completedPhases < PHASES_COUNT)
+			++failedCount;
+
+		PhaseMeasure sourceTotal;
+		for (unsigned phase = 0; phase < completedPhases; ++phase)
+		{
+			measures[phase].time = median(durations[phase]);
+			totals[phase].time += measures[phase].time;
+			totals[phase].allocations += measures[phase].allocations;
+			sourceTotal.time += measures[phase].time;
+			sourceTotal.allocations += measures[phase].allocations;
+		}
+
+		if (list)
+		{
+			const std::string name(source.name.substr(source.name.find_last_of('/') + 1));
+			std::cout << std::left << std::setw(nameWidth) << name.substr(0, nameWidth - 1) << std::right << std::setw(columnWidth) << source.source.size();
+			for (unsigned phase = 0; phase < PHASES_COUNT; ++phase)
+			{
+				if (phase < completedPhases)
+					std::cout << std::setw(columnWidth) << std::fixed << std::setprecision(1) << measures[phase].time;
+				else
+					std::cout << std::setw(columnWidth) << (phase == completedPhases ? "error" : "-");
+			}
+			std::cout << std::setw(columnWidth) << std::fixed << std::setprecision(1) << sourceTotal.time << std::setw(columnWidth) << sourceTotal.allocations << std::endl;
+		}
+	}
+
+	// summary per phase
+	Summary summary;
+	PhaseMeasure total;
+	for (unsigned phase = 0; phase < PHASES_COUNT; ++phase)
+	{
+		summary[phaseNames[phase]] = totals[phase];
+		total.time += totals[phase].time;
+		total.allocations += totals[phase].allocations;
+	}
+	summary["total"] = total;
+
+	if (list)
+		std::cout << std::endl;
+	std::cout << sources.size() << " sources, " << failedCount << " stopping on a compilation error, median of " << repetitions << " runs" << std::endl;
+	std::cout << std::left << std::setw(nameWidth / 2) << "phase" << std::right << std::setw(columnWidth + 2) << "time us" << std::setw(columnWidth) << "share" << std::setw(columnWidth + 2) << "allocs" << std::endl;
+	for (unsigned phase = 0; phase <= PHASES_COUNT; ++phase)
+	{
+		const std::string name(phase < PHASES_COUNT ? phaseNames[phase] : "total");
+		const PhaseMeasure& measure(summary[name]);
+		std::cout << std::left << std::setw(nameWidth / 2) << name << std::right << std::setw(columnWidth + 2) << std::fixed << std::setprecision(1) << measure.time;
+		std::cout << std::setw(columnWidth - 1) << (total.time > 0 ? 100 * measure.time / total.time : 0) << "%" << std::setw(columnWidth + 2) << measure.allocations << std::endl;
+	}
+
+	if (!saveFileName.empty())
+		saveSummary(summary, saveFileName);
+	if (!compareFileName.empty() && !compareSummary(summary, compareFileName, threshold))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
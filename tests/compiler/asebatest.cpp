@@ -15,6 +15,8 @@ using namespace Aseba;
 #include <fstream>
 #include <sstream>
 #include <valarray>
+#include <thread>
+#include <vector>
 
 // C
 #include <getopt.h>		// getopt_long()
@@ -40,7 +42,7 @@ extern "C" const AsebaNativeFunctionDescription * const * AsebaGetNativeFunction
 std::wstring read_source(const std::string& filename);
 void dump_source(const std::wstring& source);
 
-static const char short_options [] = "fcepnvsdumi:";
+static const char short_options [] = "fcepnvsdumi:ztb:lj:kx";
 static const struct option long_options[] = { 
 	{ "fail",	no_argument,			nullptr,	'f'},
 	{ "comp_fail",	no_argument,		nullptr,	'c'},
@@ -53,6 +55,13 @@ static const struct option long_options[] = {
 	{ "memdump",	no_argument,		nullptr,	'u'},
 	{ "memcmp", 	required_argument,	nullptr,	'm'},
 	{ "steps", 		required_argument,	nullptr,	'i'},
+	{ "size",		no_argument,		nullptr,	'z'},
+	{ "stats",		no_argument,		nullptr,	't'},
+	{ "budget",		required_argument,	nullptr,	'b'},
+	{ "lines",		no_argument,		nullptr,	'l'},
+	{ "threads",	required_argument,	nullptr,	'j'},
+	{ "check",		no_argument,		nullptr,	'k'},
+	{ "no_vector_natives",	no_argument,	nullptr,	'x'},
 	{ 0, 0, 0, 0 } 
 };
 
@@ -70,7 +79,14 @@ static void usage (int argc, char** argv)
 			<< "    -d | --dump         Dump the compilation result (tokens, tree, bytecode)" << std::endl
 			<< "    -u | --memdump      Dump the memory content at the end of the execution" << std::endl
 			<< "    -m | --memcmp file  Compare result of the VM execution with file" << std::endl
-			<< "    -i | --steps        Number of VM execution steps (default: " << DEFAULT_STEPS << ")" << std::endl;
+			<< "    -i | --steps        Number of VM execution steps (default: " << DEFAULT_STEPS << ")" << std::endl
+			<< "    -z | --size         Optimize the bytecode for size instead of speed" << std::endl
+			<< "    -t | --stats        Print the statistics of the compilation" << std::endl
+			<< "    -b | --budget n     Warn about events that might execute more than n instructions" << std::endl
+			<< "    -l | --lines        Print the bytecode generated for each line of source" << std::endl
+			<< "    -j | --threads n    Check that n threads compiling the source concurrently get the same result" << std::endl
+			<< "    -k | --check        Check that the check-only mode agrees with the compilation and can be cancelled" << std::endl
+			<< "    -x | --no_vector_natives  Hide the natives the compiler uses for vector assignments" << std::endl;
 }
 
 
@@ -88,7 +104,8 @@ struct AsebaNode
 		int16_t user[256];
 	} variables;
 
-	AsebaNode()
+	//! If vectorNatives is false, the natives the compiler might call for vector assignments are hidden from it
+	AsebaNode(bool vectorNatives = true)
 	{
 		// create VM
 		vm.nodeId = 1;
@@ -124,6 +141,10 @@ struct AsebaNode
 			std::string name(nativeDesc->name);
 			std::string doc(nativeDesc->doc);
 
+			// hidden natives keep their place, as their index identifies the natives that follow in the VM
+			if (!vectorNatives && (name == "math.copy" || name == "math.fill" || name == "math.add" || name == "math.sub" || name == "math.mul"))
+				name = "hidden." + name;
+
 			TargetDescription::NativeFunction native{
 				std::wstring(name.begin(), name.end()),
 				std::wstring(doc.begin(), doc.end())
@@ -169,19 +190,30 @@ struct AsebaNode
 		return true;
 	}
 
-	void run(int stepCount)
+	//! Run the init event, return the number of executed steps
+	int run(int stepCount)
 	{
 		// bytecode was loaded, send run message to VM
 		processMessage(Run(1));
-		AsebaVMRun(&vm, stepCount);
+		return runSteps(stepCount);
 	}
 
-	void runEvent(int stepCount)
+	//! Run the test event, return the number of executed steps
+	int runEvent(int stepCount)
 	{
 		// reset VM and run it with user event
 		vm.flags = 0;
 		AsebaVMSetupEvent(&vm, ASEBA_EVENT_LOCAL_EVENTS_START-0);
-		AsebaVMRun(&vm, stepCount);
+		return runSteps(stepCount);
+	}
+
+	//! Run step by step to count them, until the event is over or stepCount is reached
+	int runSteps(int stepCount)
+	{
+		int steps(0);
+		while (steps < stepCount && AsebaVMRun(&vm, 1))
+			++steps;
+		return steps;
 	}
 
 	void processMessage(const Message& message)
@@ -201,7 +233,7 @@ void checkForError(const std::string& module, bool shouldFail, bool wasError, co
 		// errors
 		std::cerr << "An error in " << module << " occured";
 		if (!errorMessage.empty())
-			std::wcerr << ':' << std::endl << errorMessage;
+			std::cerr << ':' << std::endl << WStringToUTF8(errorMessage);
 		std::cerr << std::endl;
 		if (shouldFail)
 		{
@@ -222,6 +254,101 @@ void checkForError(const std::string& module, bool shouldFail, bool wasError, co
 	}
 }
 
+//! Check that an event did not execute more steps than the compiler bound
+void checkInstructionsBound(const CompilationStatistics& statistics, const std::wstring& eventName, int steps)
+{
+	for (const auto& event : statistics.events)
+	{
+		if (event.name != eventName)
+			continue;
+		const std::wstring message(WFormatableString(L"Event %0 executed %1 instructions, static bound is %2").arg(eventName).arg(steps).arg(instructionsCountToWString(event.maxInstructions)));
+		checkForError("InstructionsBound", false, InstructionsCount(steps) > event.maxInstructions, message);
+	}
+}
+
+//! Translation of error messages distinct from the default one, to check that each compiler uses its own
+static const std::wstring markedTranslation(ErrorCode error)
+{
+	return L"[marked] " + ErrorMessages::defaultCallback(error);
+}
+
+//! Compile source with a fresh compiler and summarize the result (bytecode, error and warnings) as a string
+std::wstring compilationSignature(const std::wstring& source, const TargetDescription* targetDescription, const CommonDefinitions* definitions, bool optimizeForSize, InstructionsCount budget, ErrorMessages::ErrorCallback translation)
+{
+	Compiler compiler;
+	compiler.setTargetDescription(targetDescription);
+	compiler.setCommonDefinitions(definitions);
+	if (optimizeForSize)
+		compiler.setOptimizationGoal(Compiler::OPTIMIZE_FOR_SIZE);
+	compiler.setInstructionsBudget(budget);
+	compiler.setTranslateCallback(translation);
+
+	std::wistringstream ifs(source);
+	BytecodeVector bytecode;
+	unsigned varCount;
+	Error error;
+	compiler.compile(ifs, bytecode, varCount, error);
+
+	std::wostringstream oss;
+	for (const auto& element : bytecode)
+		oss << element.bytecode << L' ';
+	oss << L'\n' << error.toWString() << L'\n';
+	for (const auto& warning : compiler.getWarnings())
+		oss << warning.toWString(L"Warning") << L'\n';
+	return oss.str();
+}
+
+//! Compile source repeatedly in threadsCount concurrent threads, half of them with a distinct translation,
+//! and check that every compilation gives the same result as a single-threaded one
+void checkConcurrentCompilation(const std::wstring& source, const TargetDescription* targetDescription, const CommonDefinitions* definitions, bool optimizeForSize, InstructionsCount budget, unsigned threadsCount)
+{
+	const unsigned repetitions(20);
+	const ErrorMessages::ErrorCallback translations[2] = { ErrorMessages::defaultCallback, markedTranslation };
+	std::wstring references[2];
+	for (unsigned i = 0; i < 2; ++i)
+		references[i] = compilationSignature(source, targetDescription, definitions, optimizeForSize, budget, translations[i]);
+
+	// each thread writes its own slot, read once all are joined
+	std::vector<char> mismatches(threadsCount, 0);
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t < threadsCount; ++t)
+		threads.emplace_back([&, t]() {
+			for (unsigned i = 0; i < repetitions; ++i)
+				if (compilationSignature(source, targetDescription, definitions, optimizeForSize, budget, translations[t % 2]) != references[t % 2])
+					mismatches[t] = 1;
+		});
+	for (auto& thread : threads)
+		thread.join();
+
+	unsigned failedThreads(0);
+	for (const char mismatch : mismatches)
+		failedThreads += mismatch;
+	checkForError("Threads", false, failedThreads != 0, WFormatableString(L"%0 of %1 threads got a different compilation result").arg(failedThreads).arg(threadsCount));
+}
+
+//! Check the source without generating code and compare with the result of the full compilation,
+//! then check that a cancelled check stops with the corresponding error
+void checkCheckOnly(Compiler& compiler, const std::wstring& source, const Error& compilationError)
+{
+	std::wistringstream ifs(source);
+	Error checkError;
+	if (!compiler.check(ifs, checkError))
+	{
+		// errors found by the check must be the ones of the compilation
+		const bool differs(checkError.toWString() != compilationError.toWString());
+		checkForError("Check", false, differs, L"check reported " + checkError.toWString() + L", compilation " + compilationError.toWString());
+	}
+	else
+		std::cerr << "Check was successful" << std::endl;
+
+	std::wistringstream cancelledIfs(source);
+	const std::atomic<bool> cancelled(true);
+	Error cancelledError;
+	const bool completed(compiler.check(cancelledIfs, cancelledError, &cancelled));
+	const bool wasCancelled(!completed && cancelledError.message == ErrorMessages::defaultCallback(ERROR_COMPILATION_CANCELLED));
+	checkForError("CheckCancellation", false, !wasCancelled, L"cancelled check was not aborted");
+}
+
 int main(int argc, char** argv)
 {
 	bool should_compilation_fail = false;
@@ -234,6 +361,13 @@ int main(int argc, char** argv)
 	bool memDump = false;
 	bool memCmp = false;
 	int stepCount = DEFAULT_STEPS;
+	bool optimizeForSize = false;
+	bool stats = false;
+	InstructionsCount budget = 0;
+	bool lines = false;
+	unsigned threadsCount = 0;
+	bool checkOnly = false;
+	bool vectorNatives = true;
 	std::string memCmpFileName;
 
 	std::locale::global(std::locale(""));
@@ -290,6 +424,27 @@ int main(int argc, char** argv)
 			case 'i':
 				stepCount = atoi(optarg);
 				break;
+			case 'z':
+				optimizeForSize = true;
+				break;
+			case 't':
+				stats = true;
+				break;
+			case 'b':
+				budget = strtoull(optarg, nullptr, 10);
+				break;
+			case 'l':
+				lines = true;
+				break;
+			case 'j':
+				threadsCount = atoi(optarg);
+				break;
+			case 'k':
+				checkOnly = true;
+				break;
+			case 'x':
+				vectorNatives = false;
+				break;
 			default:
 				usage(argc, argv);
 				exit(EXIT_FAILURE);
@@ -324,7 +479,7 @@ int main(int argc, char** argv)
 	Compiler compiler;
 
 	// fake target description
-	AsebaNode node;
+	AsebaNode node(vectorNatives);
 	CommonDefinitions definitions;
 	definitions.events.push_back(NamedValue(L"event1", 0));
 	definitions.events.push_back(NamedValue(L"event2", 3));
@@ -337,35 +492,68 @@ int main(int argc, char** argv)
 	// compile
 	compiler.setTargetDescription(node.getTargetDescription());
 	compiler.setCommonDefinitions(&definitions);
+	if (optimizeForSize)
+		compiler.setOptimizationGoal(Compiler::OPTIMIZE_FOR_SIZE);
+	compiler.setInstructionsBudget(budget);
+	CompilationStatistics statistics;
 	if (dump)
-		compiler.compile(ifs, bytecode, varCount, outError, &(std::wcout));
+		compiler.compile(ifs, bytecode, varCount, outError, &(std::wcout), &statistics);
 	else
-		compiler.compile(ifs, bytecode, varCount, outError, nullptr);
+		compiler.compile(ifs, bytecode, varCount, outError, nullptr, &statistics);
+	if (stats)
+		std::wcout << statistics.toWString();
+	for (const auto& warning : compiler.getWarnings())
+		std::cerr << WStringToUTF8(warning.toWString(L"Warning")) << std::endl;
 
 	//ifs.close();
 
+	if (checkOnly)
+		checkCheckOnly(compiler, wSource, outError);
+
+	if (threadsCount)
+		checkConcurrentCompilation(wSource, node.getTargetDescription(), &definitions, optimizeForSize, budget, threadsCount);
+
 	checkForError("Compilation", should_compilation_fail, (outError.message != L"not defined"), outError.toWString());
 
+	if (lines)
+	{
+		// every word of code must be attributed to a line
+		unsigned words(0);
+		for (const auto& line : statistics.lines)
+		{
+			std::wcout << L"line " << line.first + 1 << L": " << line.second.words << L" words, " << line.second.instructions << L" instructions" << std::endl;
+			words += line.second.words;
+		}
+		const unsigned codeSize(bytecode.size() - bytecode[0].bytecode);
+		checkForError("LinesCosts", false, words != codeSize, WFormatableString(L"%0 words attributed to lines, code has %1").arg(words).arg(codeSize));
+	}
+
 	// run
 	if (!node.loadBytecode(bytecode))
 	{
 		std::cerr << "Load bytecode failure" << std::endl;
 		return EXIT_FAILURE;
 	}
-	node.run(stepCount);
+	const int initSteps(node.run(stepCount));
 
 	// is execution completed?
 	const bool stillExecuting(node.vm.flags & ASEBA_VM_EVENT_ACTIVE_MASK);
 	checkForError("PostInitExecution", should_postexecution_fail, stillExecuting, WFormatableString(L"VM was still running after %0 steps").arg(stepCount));
 
 	// setup extra event
+	int eventSteps(0);
 	if (event)
 	{
-		node.runEvent(stepCount);
+		eventSteps = node.runEvent(stepCount);
 	}
 
 	checkForError("Execution", should_execution_fail, AsebaExecutionErrorOccurred());
 
+	// the compiler must never underestimate the instructions executed by an event
+	checkInstructionsBound(statistics, L"init", initSteps);
+	if (event)
+		checkInstructionsBound(statistics, L"test", eventSteps);
+
 	if (memDump)
 	{
 		std::wcout << L"Memory dump:" << std::endl;
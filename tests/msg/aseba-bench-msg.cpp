@@ -0,0 +1,238 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../common/msg/msg.h"
+#include <dashel/dashel.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <stdlib.h>
+
+using namespace Aseba;
+using namespace std;
+
+// defines
+#define DEFAULT_REPETITIONS	2000
+#define FAN_OUT	8
+
+//! A stream that discards what is written to it, standing for a client of the switch
+struct NullStream: public Dashel::Stream
+{
+	size_t written = 0;
+
+	NullStream(): Stream("null") {}
+	void write(const void *data, const size_t size) override { written += size; }
+	void flush() override {}
+	void read(void *data, size_t size) override { fail(Dashel::DashelException::IOError, 0, "Reading a null stream"); }
+};
+
+//! Counts of messages by kind, as a network client would handle them
+struct Counts
+{
+	unsigned descriptions = 0;
+	unsigned variables = 0;
+	unsigned userMessages = 0;
+	unsigned commands = 0;
+	unsigned disconnections = 0;
+
+	bool operator ==(const Counts& that) const
+	{
+		return descriptions == that.descriptions && variables == that.variables && userMessages == that.userMessages && commands == that.commands && disconnections == that.disconnections;
+	}
+};
+
+//! Classify a message with the chain of dynamic casts that clients used to have
+void classifyWithCasts(const Message* message, Counts& counts)
+{
+	if (dynamic_cast<const Disconnected*>(message))
+		++counts.disconnections;
+	if (dynamic_cast<const Description*>(message))
+		++counts.descriptions;
+	if (dynamic_cast<const NamedVariableDescription*>(message))
+		++counts.descriptions;
+	if (dynamic_cast<const LocalEventDescription*>(message))
+		++counts.descriptions;
+	if (dynamic_cast<const NativeFunctionDescription*>(message))
+		++counts.descriptions;
+	if (dynamic_cast<const Variables*>(message))
+		++counts.variables;
+	if (dynamic_cast<const UserMessage*>(message))
+		++counts.userMessages;
+	if (dynamic_cast<const CmdMessage*>(message))
+		++counts.commands;
+}
+
+//! Classify a message with a single dispatch on its class
+struct Classifier: public MessageVisitor
+{
+	Counts counts;
+
+	using MessageVisitor::visit;
+	void visit(const Disconnected& message) override { ++counts.disconnections; }
+	void visit(const Description& message) override { ++counts.descriptions; }
+	void visit(const NamedVariableDescription& message) override { ++counts.descriptions; }
+	void visit(const LocalEventDescription& message) override { ++counts.descriptions; }
+	void visit(const NativeFunctionDescription& message) override { ++counts.descriptions; }
+	void visit(const Variables& message) override { ++counts.variables; }
+	void visit(const UserMessage& message) override { ++counts.userMessages; }
+	void visit(const CmdMessage& message) override { ++counts.commands; }
+};
+
+//! Return the duration of f in nanoseconds per message
+template<typename F>
+double measure(F f, size_t messagesCount, unsigned repetitions)
+{
+	const auto start(chrono::steady_clock::now());
+	for (unsigned i = 0; i < repetitions; ++i)
+		f();
+	const chrono::duration<double, nano> duration(chrono::steady_clock::now() - start);
+	return duration.count() / (messagesCount * repetitions);
+}
+
+//! Return a message of every known type and a user message
+vector<unique_ptr<Message>> messagesOfAllTypes()
+{
+	vector<unique_ptr<Message>> messages;
+	messages.emplace_back(new UserMessage(0, VariablesDataVector{1, 2, 3}));
+	messages.emplace_back(new BootloaderDescription());
+	messages.emplace_back(new BootloaderDataRead());
+	messages.emplace_back(new BootloaderAck());
+	messages.emplace_back(new ListNodes());
+	messages.emplace_back(new NodePresent());
+	messages.emplace_back(new GetDescription());
+	messages.emplace_back(new GetNodeDescription());
+	messages.emplace_back(new Description());
+	messages.emplace_back(new NamedVariableDescription());
+	messages.emplace_back(new LocalEventDescription());
+	messages.emplace_back(new NativeFunctionDescription());
+	messages.emplace_back(new Disconnected());
+	messages.emplace_back(new Variables());
+	messages.emplace_back(new ArrayAccessOutOfBounds());
+	messages.emplace_back(new DivisionByZero());
+	messages.emplace_back(new EventExecutionKilled());
+	messages.emplace_back(new NodeSpecificError());
+	messages.emplace_back(new ExecutionStateChanged());
+	messages.emplace_back(new BreakpointSetResult());
+	messages.emplace_back(new BootloaderReset());
+	messages.emplace_back(new BootloaderReadPage());
+	messages.emplace_back(new BootloaderWritePage());
+	messages.emplace_back(new BootloaderPageDataWrite());
+	messages.emplace_back(new SetBytecode());
+	messages.emplace_back(new Reset());
+	messages.emplace_back(new Run());
+	messages.emplace_back(new Pause());
+	messages.emplace_back(new Step());
+	messages.emplace_back(new Stop());
+	messages.emplace_back(new GetExecutionState());
+	messages.emplace_back(new BreakpointSet());
+	messages.emplace_back(new BreakpointClear());
+	messages.emplace_back(new BreakpointClearAll());
+	messages.emplace_back(new GetVariables());
+	messages.emplace_back(new SetVariables());
+	messages.emplace_back(new WriteBytecode());
+	messages.emplace_back(new Reboot());
+	messages.emplace_back(new Sleep());
+	return messages;
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned repetitions(argc > 1 ? atoi(argv[1]) : DEFAULT_REPETITIONS);
+
+	// a traffic mix dominated by events and variables, as seen by clients of a running network
+	vector<unique_ptr<Message>> messages;
+	for (unsigned i = 0; i < 100; ++i)
+	{
+		messages.emplace_back(new UserMessage(i % 8, VariablesDataVector{1, 2, 3}));
+		messages.emplace_back(new UserMessage(i % 8, VariablesDataVector{1, 2, 3}));
+		messages.emplace_back(new Variables());
+		messages.emplace_back(new NodePresent());
+		messages.emplace_back(new SetVariables());
+		messages.emplace_back(new GetVariables());
+		if (i % 10 == 0)
+		{
+			messages.emplace_back(new Description());
+			messages.emplace_back(new NamedVariableDescription());
+			messages.emplace_back(new NativeFunctionDescription());
+			messages.emplace_back(new Disconnected());
+		}
+	}
+
+	Counts castCounts;
+	const double castDuration(measure([&]() {
+		for (const auto& message : messages)
+			classifyWithCasts(message.get(), castCounts);
+	}, messages.size(), repetitions));
+
+	Classifier classifier;
+	const double visitorDuration(measure([&]() {
+		for (const auto& message : messages)
+			message->accept(classifier);
+	}, messages.size(), repetitions));
+
+	// creation of messages of all types from their payload, as when receiving them
+	vector<Message::SerializationBuffer> payloads;
+	vector<uint16_t> types;
+	for (const auto& message : messagesOfAllTypes())
+	{
+		payloads.emplace_back();
+		message->serializeSpecific(payloads.back());
+		types.push_back(message->type);
+	}
+	const double createDuration(measure([&]() {
+		for (size_t i = 0; i < payloads.size(); ++i)
+		{
+			payloads[i].readPos = 0;
+			delete Message::create(0, types[i], payloads[i]);
+		}
+	}, payloads.size(), repetitions));
+
+	// broadcast of messages to several clients, serializing for each of them or once for all
+	vector<NullStream> clients(FAN_OUT);
+	const double serializeEachDuration(measure([&]() {
+		for (const auto& message : messages)
+			for (auto& client : clients)
+				message->serialize(&client);
+	}, messages.size(), repetitions));
+	RawMessage frame;
+	const double encodeOnceDuration(measure([&]() {
+		for (const auto& message : messages)
+		{
+			frame.encode(*message);
+			for (auto& client : clients)
+				frame.serialize(&client);
+		}
+	}, messages.size(), repetitions));
+
+	cout << "dynamic_cast chain: " << castDuration << " ns/message" << endl;
+	cout << "visitor:            " << visitorDuration << " ns/message" << endl;
+	cout << "Message::create:    " << createDuration << " ns/message, over " << payloads.size() << " types" << endl;
+	cout << "serialize each:     " << serializeEachDuration << " ns/message, to " << FAN_OUT << " clients" << endl;
+	cout << "encode once:        " << encodeOnceDuration << " ns/message, to " << FAN_OUT << " clients" << endl;
+
+	// both must classify the messages the same way
+	if (!(castCounts == classifier.counts))
+	{
+		cerr << "Visitor and dynamic casts classified messages differently" << endl;
+		return 1;
+	}
+	return 0;
+}
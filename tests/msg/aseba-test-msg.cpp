@@ -19,8 +19,11 @@
 */
 
 #include "../../common/msg/msg.h"
+#include <dashel/dashel.h>
 #include <iostream>
 #include <functional>
+#include <vector>
+#include <cstring>
 
 using namespace Aseba;
 using namespace std;
@@ -48,6 +51,12 @@ void testMessage(function<void(T&)> initFunc, initializer_list<function<void(T&)
 			cerr << "Message type " << typeid(T).name() << " did not serialize-deserialize to itself" << endl;
 			throw logic_error("Serialization failed");
 		}
+		if (messageCast<T>(m2super.get()) != dynamic_cast<T*>(m2super.get()) ||
+			messageCast<CmdMessage>(m2super.get()) != dynamic_cast<CmdMessage*>(m2super.get()))
+		{
+			cerr << "Message type " << typeid(T).name() << " is not dispatched to its class" << endl;
+			throw logic_error("Dispatch failed");
+		}
 		m2.reset(dynamic_cast<T*>(m2super.release()));
 	}
 
@@ -109,6 +118,95 @@ void testMessageNoInitNoFunc(Args&&... args)
 	testMessage<T>([](T& ){}, {}, args...);
 }
 
+//! Stream writing to and reading from memory
+class MemoryStream : public Dashel::Stream
+{
+public:
+	vector<uint8_t> data;
+	size_t readPos = 0;
+
+	MemoryStream() : Stream("memory") {}
+
+	void write(const void *ptr, const size_t size) override
+	{
+		const auto *bytes(reinterpret_cast<const uint8_t*>(ptr));
+		data.insert(data.end(), bytes, bytes + size);
+	}
+
+	void flush() override {}
+
+	void read(void *ptr, size_t size) override
+	{
+		if (readPos + size > data.size())
+			throw logic_error("Read past the end of the memory stream");
+		memcpy(ptr, &data[readPos], size);
+		readPos += size;
+	}
+};
+
+//! Test that raw messages forward the exact bytes they receive, expose the destination
+//! of commands, and deserialize to the messages that were sent
+void testRawMessages()
+{
+	MemoryStream input;
+	UserMessage userMessage(0x12, VariablesDataVector{1, 2, 3});
+	userMessage.source = 7;
+	userMessage.serialize(&input);
+	SetBytecode setBytecode(0x0302, 4);
+	setBytecode.bytecode = {5, 6};
+	setBytecode.serialize(&input);
+	Reset reset(9);
+	reset.serialize(&input);
+
+	// forward all messages through the same raw message, changing the destination of one command
+	MemoryStream output;
+	RawMessage raw;
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		raw.receive(&input);
+		if (raw.isCommand() != (i != 0))
+			throw logic_error("Raw message has wrong command status");
+		if (raw.getType() == ASEBA_MESSAGE_RESET)
+		{
+			if (raw.getDest() != 9)
+				throw logic_error("Raw message has wrong destination");
+			raw.setDest(10);
+		}
+		raw.serialize(&output);
+	}
+
+	// untouched messages must be forwarded byte for byte
+	reset.dest = 10;
+	MemoryStream expected;
+	userMessage.serialize(&expected);
+	setBytecode.serialize(&expected);
+	reset.serialize(&expected);
+	if (output.data != expected.data)
+		throw logic_error("Raw messages changed content when forwarded");
+
+	// read back through the usual path
+	unique_ptr<Message> m1(Message::receive(&output));
+	unique_ptr<Message> m2(Message::receive(&output));
+	unique_ptr<Message> m3(Message::receive(&output));
+	if (!(*dynamic_cast<UserMessage*>(m1.get()) == userMessage) ||
+		!(*dynamic_cast<SetBytecode*>(m2.get()) == setBytecode) ||
+		!(*dynamic_cast<Reset*>(m3.get()) == reset))
+		throw logic_error("Raw messages did not deserialize to the messages sent");
+
+	// a frame encoded once and patched in place must match the serialization of the patched message
+	RawMessage encoded;
+	encoded.encode(reset);
+	encoded.setSource(3);
+	encoded.setDest(11);
+	reset.source = 3;
+	reset.dest = 11;
+	MemoryStream patched, serialized;
+	encoded.serialize(&patched);
+	reset.serialize(&serialized);
+	if (patched.data != serialized.data || encoded.getSource() != 3 || encoded.getType() != ASEBA_MESSAGE_RESET || encoded.getPayloadSize() != 2)
+		throw logic_error("Encoded raw message differs from serialized message");
+}
+
 int main()
 {
 	// Test the serialization and deserialization of all messages
@@ -160,6 +258,15 @@ int main()
 		}
 	);
 
+	testMessage<SwitchSubscribe>(
+		[](SwitchSubscribe& m) { m.types = { ASEBA_MESSAGE_NODE_PRESENT, 0 }; m.sources = { 1 }; },
+		{
+			[](SwitchSubscribe& m) { m.types.clear(); },
+			[](SwitchSubscribe& m) { m.sources.clear(); },
+			[](SwitchSubscribe& m) { m.types.push_back(2); }
+		}
+	);
+
 	testMessageNoInit<NodePresent>(
 		{
 			[](NodePresent& m) { m.version = 1; }
@@ -509,5 +616,7 @@ int main()
 		}
 	);
 
+	testRawMessages();
+
 	return 0;
 }
@@ -0,0 +1,283 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../switches/switch/output-queue.h"
+#include "../../switches/switch/routes.h"
+#include "../../common/msg/msg.h"
+#include <dashel/dashel.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace Aseba;
+using namespace std;
+
+// defines
+#define TEST_EVENT	0x7e57
+#define MESSAGES_COUNT	20000
+#define QUEUE_SIZE	4096
+
+//! Stream writing to a socket with blocking sends, as Dashel socket streams do
+class SocketStream : public Dashel::Stream
+{
+public:
+	const int fd;
+
+	explicit SocketStream(int fd) : Stream("tcp"), fd(fd)
+	{
+		target.add(("tcp:sock=" + to_string(fd)).c_str());
+	}
+
+	void write(const void *ptr, const size_t size) override
+	{
+		const auto *bytes(reinterpret_cast<const char*>(ptr));
+		size_t left(size);
+		while (left)
+		{
+			const ssize_t len(::send(fd, bytes, left, 0));
+			if (len < 0)
+				fail(Dashel::DashelException::IOError, errno, "Socket write I/O error.");
+			bytes += len;
+			left -= size_t(len);
+		}
+	}
+
+	void flush() override {}
+
+	void read(void *, size_t) override
+	{
+		throw logic_error("Socket stream is only written to");
+	}
+};
+
+//! Client reading the test events from its end of a socket as long as data is available
+struct Client
+{
+	const int fd;
+	vector<uint8_t> received;
+	unsigned next = 0;
+
+	explicit Client(int fd) : fd(fd) {}
+
+	void read()
+	{
+		uint8_t buffer[4096];
+		ssize_t len;
+		while ((len = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+			received.insert(received.end(), buffer, buffer + len);
+
+		// check that the events arrive whole and in order
+		size_t pos(0);
+		while (received.size() - pos >= RawMessage::headerSize + 2)
+		{
+			const unsigned type(received[pos + 4] | (received[pos + 5] << 8));
+			const unsigned value(received[pos + 6] | (received[pos + 7] << 8));
+			if (type != TEST_EVENT || value != (next & 0xffff))
+				throw logic_error("Client received a wrong event");
+			++next;
+			pos += RawMessage::headerSize + 2;
+		}
+		received.erase(received.begin(), received.begin() + pos);
+	}
+};
+
+//! Create a pair of connected sockets with small buffers, so that a client not reading soon stalls
+void createSockets(int sockets[2])
+{
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+		throw runtime_error("Cannot create socket pair");
+	const int size(QUEUE_SIZE);
+	setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(sockets[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+//! Test that a client that never reads loses messages or gets disconnected, without blocking a client that reads
+void testStalledClient(OutputQueue::OverflowPolicy policy)
+{
+	int fastSockets[2], stalledSockets[2];
+	createSockets(fastSockets);
+	createSockets(stalledSockets);
+	SocketStream fastStream(fastSockets[0]), stalledStream(stalledSockets[0]);
+	OutputQueue fastQueue(&fastStream, QUEUE_SIZE, policy);
+	OutputQueue stalledQueue(&stalledStream, QUEUE_SIZE, policy);
+	Client fastClient(fastSockets[1]);
+
+	// a write blocking on the stalled client would never return, as nothing reads it
+	RawMessage frame;
+	for (unsigned i = 0; i < MESSAGES_COUNT; ++i)
+	{
+		frame.encode(UserMessage(TEST_EVENT, VariablesDataVector{int16_t(i & 0xffff)}));
+		if (!fastQueue.push(frame))
+			throw logic_error("Fast client was disconnected");
+		stalledQueue.push(frame);
+		fastQueue.drain();
+		stalledQueue.drain();
+		fastClient.read();
+	}
+	while (!fastQueue.drain())
+		fastClient.read();
+	fastClient.read();
+
+	if (fastClient.next != MESSAGES_COUNT || fastQueue.getDroppedMessages() != 0)
+		throw logic_error("Fast client did not receive all events");
+	if (stalledQueue.getQueuedBytes() > QUEUE_SIZE)
+		throw logic_error("Queue of stalled client exceeds its capacity");
+	if (policy == OutputQueue::OverflowPolicy::DROP_OLDEST && stalledQueue.getDroppedMessages() == 0)
+		throw logic_error("Stalled client did not lose its oldest events");
+	if (policy == OutputQueue::OverflowPolicy::DISCONNECT && (!stalledQueue.isDisconnected() || stalledQueue.push(frame)))
+		throw logic_error("Stalled client was not disconnected");
+
+	for (const int fd: { fastSockets[0], fastSockets[1], stalledSockets[0], stalledSockets[1] })
+		close(fd);
+}
+
+//! Stream standing for a connection to the switch, only known by its address by routes
+class RouteStream : public Dashel::Stream
+{
+public:
+	RouteStream() : Stream("dummy") {}
+
+	void write(const void *, size_t) override
+	{
+		throw logic_error("Route stream is never written to");
+	}
+
+	void flush() override {}
+
+	void read(void *, size_t) override
+	{
+		throw logic_error("Route stream is never read from");
+	}
+};
+
+//! Return the frame of message sent by source
+RawMessage frameFrom(uint16_t source, Message&& message)
+{
+	message.source = source;
+	RawMessage frame;
+	frame.encode(message);
+	return frame;
+}
+
+//! Test that commands only go to the streams of their destination once it announced itself, and other messages to all
+void testRouting()
+{
+	RouteStream first, second, other;
+	const Routes::Streams streams{ &first, &second, &other };
+	Routes routes;
+
+	// nodes announce themselves by their presence or description, a route is only new once
+	if (!routes.learn(&first, frameFrom(3, NodePresent())) || routes.learn(&first, frameFrom(3, NodePresent())))
+		throw logic_error("Presence of node 3 was not learnt once");
+	if (!routes.learn(&second, frameFrom(5, Description())))
+		throw logic_error("Description of node 5 was not learnt");
+	if (routes.learn(&other, frameFrom(ASEBA_DEST_DEBUG, NodePresent())) || routes.learn(&other, frameFrom(7, UserMessage(TEST_EVENT))))
+		throw logic_error("Route learnt from a message not announcing a node");
+
+	// commands to a known node only go to its stream, to an unknown one to all streams
+	if (routes.destinations(frameFrom(0, GetVariables(3, 0, 1)), streams) != Routes::Streams{ &first })
+		throw logic_error("Command to node 3 not sent to its stream only");
+	if (routes.destinations(frameFrom(0, Reset(5)), streams) != Routes::Streams{ &second })
+		throw logic_error("Command to node 5 not sent to its stream only");
+	if (routes.destinations(frameFrom(0, Reset(7)), streams) != streams)
+		throw logic_error("Command to unknown node 7 not broadcast");
+	if (routes.destinations(frameFrom(3, UserMessage(TEST_EVENT)), streams) != streams)
+		throw logic_error("Event not broadcast");
+
+	// a node on several streams receives its commands on all of them
+	routes.learn(&other, frameFrom(3, NodePresent()));
+	if (routes.destinations(frameFrom(0, Reset(3)), streams) != (Routes::Streams{ &first, &other }))
+		throw logic_error("Command to node 3 not sent to both its streams");
+
+	// once its streams are gone, commands to a node are broadcast again
+	routes.forget(&first);
+	routes.forget(&other);
+	if (routes.destinations(frameFrom(0, Reset(3)), streams) != streams)
+		throw logic_error("Command to forgotten node 3 not broadcast");
+	if (routes.destinations(frameFrom(0, Reset(5)), streams) != Routes::Streams{ &second })
+		throw logic_error("Route to node 5 lost when forgetting other streams");
+}
+
+//! Return the frame of a subscription to messages of types and from sources
+RawMessage subscriptionFrame(vector<uint16_t> types, vector<uint16_t> sources)
+{
+	SwitchSubscribe subscription;
+	subscription.types = move(types);
+	subscription.sources = move(sources);
+	return frameFrom(0, move(subscription));
+}
+
+//! Test that a stream subscribed to some messages only accepts them, and that other streams accept everything
+void testSubscription()
+{
+	RouteStream subscriber, other;
+	Routes routes;
+
+	RawMessage subscription(subscriptionFrame({ TEST_EVENT, ASEBA_MESSAGE_DESCRIPTION }, {}));
+	if (!routes.subscribe(&subscriber, subscription))
+		throw logic_error("Subscription to types rejected");
+	if (!routes.accepts(&subscriber, frameFrom(3, UserMessage(TEST_EVENT))) || !routes.accepts(&subscriber, frameFrom(5, Description())))
+		throw logic_error("Subscriber does not accept the types it subscribed to");
+	if (routes.accepts(&subscriber, frameFrom(3, UserMessage(TEST_EVENT + 1))) || routes.accepts(&subscriber, frameFrom(3, NodePresent())))
+		throw logic_error("Subscriber accepts types it did not subscribe to");
+	if (!routes.accepts(&other, frameFrom(3, UserMessage(TEST_EVENT + 1))) || !routes.accepts(&other, frameFrom(3, NodePresent())))
+		throw logic_error("Stream without subscription does not accept all messages");
+
+	// a new subscription replaces the previous one
+	subscription = subscriptionFrame({ TEST_EVENT }, { 5 });
+	if (!routes.subscribe(&subscriber, subscription))
+		throw logic_error("Subscription to types and sources rejected");
+	if (!routes.accepts(&subscriber, frameFrom(5, UserMessage(TEST_EVENT))))
+		throw logic_error("Subscriber does not accept the type and source it subscribed to");
+	if (routes.accepts(&subscriber, frameFrom(3, UserMessage(TEST_EVENT))) || routes.accepts(&subscriber, frameFrom(5, Description())))
+		throw logic_error("Subscriber accepts a type or source it did not subscribe to");
+
+	// a malformed subscription is ignored
+	subscription.frame.rawData.pop_back();
+	if (routes.subscribe(&subscriber, subscription) || routes.accepts(&subscriber, frameFrom(3, UserMessage(TEST_EVENT))))
+		throw logic_error("Malformed subscription not ignored");
+
+	// an empty subscription accepts everything again, as does a forgotten stream
+	subscription = subscriptionFrame({}, {});
+	if (!routes.subscribe(&subscriber, subscription) || !routes.accepts(&subscriber, frameFrom(3, NodePresent())))
+		throw logic_error("Empty subscription does not accept all messages");
+	subscription = subscriptionFrame({ TEST_EVENT }, {});
+	routes.subscribe(&subscriber, subscription);
+	routes.forget(&subscriber);
+	if (!routes.accepts(&subscriber, frameFrom(3, NodePresent())))
+		throw logic_error("Forgotten subscriber keeps its subscription");
+}
+
+int main()
+{
+	// a blocked write makes the test fail instead of hanging
+	alarm(30);
+
+	testStalledClient(OutputQueue::OverflowPolicy::DROP_OLDEST);
+	testStalledClient(OutputQueue::OverflowPolicy::DISCONNECT);
+	testRouting();
+	testSubscription();
+
+	return 0;
+}
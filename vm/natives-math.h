@@ -0,0 +1,459 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ASEBA_NATIVES_MATH_H
+#define __ASEBA_NATIVES_MATH_H
+
+#include "natives.h"
+#include <stdlib.h>
+
+/**
+	\file natives-math.h
+	Fixed-point math used by the standard natives functions.
+	It is in a header so that the compiler evaluates calls with constant arguments using the same code as the VM.
+*/
+
+/** \addtogroup vm */
+/*@{*/
+
+// table is 20 bins (one for each bit of value) of 8 values each + one for infinity
+static const int16_t aseba_atan_table[20*8+1] = { 652, 735, 816, 896, 977, 1058, 1139, 1218, 1300, 1459, 1620, 1777, 1935, 2093, 2250, 2403, 2556, 2868, 3164, 3458, 3748, 4029, 4307, 4578, 4839, 5359, 5836, 6290, 6720, 7126, 7507, 7861, 8203, 8825, 9357, 9839, 10260, 10640, 10976, 11281, 11557, 12037, 12425, 12755, 13036, 13277, 13486, 13671, 13837, 14112, 14331, 14514, 14666, 14796, 14907, 15003, 15091, 15235, 15348, 15441, 15519, 15585, 15642, 15691, 15736, 15808, 15865, 15912, 15951, 15984, 16013, 16037, 16060, 16096, 16125, 16148, 16168, 16184, 16199, 16211, 16222, 16240, 16255, 16266, 16276, 16284, 16292, 16298, 16303, 16312, 16320, 16325, 16331, 16334, 16338, 16341, 16344, 16348, 16352, 16355, 16357, 16360, 16361, 16363, 16364, 16366, 16369, 16369, 16371, 16372, 16373, 16373, 16375, 16375, 16377, 16376, 16378, 16378, 16378, 16379, 16379, 16380, 16380, 16380, 16382, 16381, 16381, 16381, 16382, 16382, 16382, 16382, 16382, 16382, 16384, 16383, 16383, 16383, 16383, 16383, 16383, 16383, 16383, 16383, 16383, 16383, 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384 };
+/* Generation code:
+for (int i = 0; i < 20; i++)
+{
+	double d = pow(2, (double)(i - 4));
+	double dd = d / 8;
+	for (int j = 0; j < 8; j++)
+	{
+		double v = atan(d + dd * j);
+		aseba_atan_table[i*8+j] = (int)(((32768.*v) /  (M_PI))+0.5);
+	}
+	aseba_atan_table[20*8] = 16384
+}
++ optimisation
+*/
+
+
+// atan2, do y/x and return an "aseba" angle that spans the whole 16 bits range
+static inline int16_t aseba_atan2(int16_t y, int16_t x)
+{
+	if (y == 0)
+	{
+		if (x >= 0)	// we return 0 on division by zero
+			return 0;
+		else if (x < 0)
+			return -32768;
+	}
+
+	{
+		int16_t res;
+		int16_t ax = abs(x);
+		int16_t ay = abs(y);
+		if (x == 0)
+		{
+			res = 16384;
+		}
+		else
+		{
+#ifdef __C30__
+			unsigned int q2, rem1;
+			unsigned long q1;
+			q1 = __builtin_divmodud(ay, ax, &rem1);
+			q2 = __builtin_divud(((unsigned long) rem1) << 16, ax);
+			int32_t value = (q1 << 16) | q2;
+
+			int16_t fb1;
+
+			// find first bit at one
+			// ASM optimisation for 16bits PIC
+			// Find first bit from left (MSB) on 32 bits word
+			asm ("ff1l %[word], %[b]" : [b] "=r" (fb1) : [word] "r" ((int) (value >> 16)) : "cc");
+			if(fb1) 
+				fb1 = 17 - fb1 + 16 - 1; // Bit 0 is "16", fbl = 0 mean no 1 found for ff1l
+			else {
+				asm ("ff1l %[word], %[b]" : [b] "=r" (fb1) : [word] "r" ((int) value) : "cc");
+				if(fb1)
+					fb1 = 17 - fb1 - 1; // see above
+			}
+			{
+				// we only keep 4 bits of precision below comma as atan(x) is like x near 0
+				int16_t index = fb1 - 12;
+				if (index < 0)
+				{
+					// value is smaller than 2e-4
+					res = (value*aseba_atan_table[0]) >> 12;
+				}
+				else
+				{
+					int32_t subprecision_rest = value - (1L << fb1);
+					int16_t to_shift = fb1 - 8; // fb1 >= 12 otherwise index would have been < 0
+					int16_t subprecision_index = (int16_t)(subprecision_rest >> to_shift);
+					int16_t bin = subprecision_index >> 5;
+					int16_t delta = subprecision_index & 0x1f;
+					res = __builtin_divsd(__builtin_mulss(aseba_atan_table[index*8 + bin], 32 - delta) + __builtin_mulss(aseba_atan_table[index*8 + bin + 1], delta),32);
+				}
+
+#else		
+			int32_t value = (((int32_t)ay << 16)/(int32_t)(ax));
+			int16_t fb1 = 0;
+
+			int16_t fb1_counter;
+			for (fb1_counter = 0; fb1_counter < 32; fb1_counter++)
+				if ((value >> (int32_t)fb1_counter) != 0)
+					fb1 = fb1_counter;
+
+			{
+				// we only keep 4 bits of precision below comma as atan(x) is like x near 0
+				int16_t index = fb1 - 12;
+				if (index < 0)
+				{
+					// value is smaller than 2e-4
+					res = (int16_t)(((int32_t)aseba_atan_table[0] * value) >> 12);
+				}
+				else
+				{
+					int32_t subprecision_rest = value - (((int32_t) 1) << fb1);
+					int16_t to_shift = fb1 - 8; // fb1 >= 12 otherwise index would have been < 0
+					int16_t subprecision_index = (int16_t)(subprecision_rest >> to_shift);
+					int16_t bin = subprecision_index >> 5;
+					int16_t delta = subprecision_index & 0x1f;
+					res = (int16_t)(((int32_t)aseba_atan_table[index*8 + bin] * (int32_t)(32 - delta) + (int32_t)aseba_atan_table[index*8 + bin + 1] * (int32_t)delta) >> 5);
+				}
+#endif
+				// do pi - value if x negative
+				if (x < 0)
+					res = 32768 - res;
+			}
+		}
+
+		if (y > 0)
+			return res;
+		else
+			return -res;
+	}
+}
+
+// 2 << 7 entries + 1, from 0 to 16384, being from 0 to PI/2
+static const int16_t aseba_sin_table[128+1] = {0, 403, 804, 1207, 1608, 2010, 2411, 2812, 3212, 3612, 4011, 4411, 4808, 5206, 5603, 5998, 6393, 6787, 7180, 7572, 7962, 8352, 8740, 9127, 9513, 9896, 10279, 10660, 11040, 11417, 11794, 12167, 12540, 12911, 13279, 13646, 14010, 14373, 14733, 15091, 15447, 15801, 16151, 16500, 16846, 17190, 17531, 17869, 18205, 18538, 18868, 19196, 19520, 19842, 20160, 20476, 20788, 21097, 21403, 21706, 22006, 22302, 22595, 22884, 23171, 23453, 23732, 24008, 24279, 24548, 24812, 25073, 25330, 25583, 25833, 26078, 26320, 26557, 26791, 27020, 27246, 27467, 27684, 27897, 28106, 28311, 28511, 28707, 28899, 29086, 29269, 29448, 29622, 29792, 29957, 30117, 30274, 30425, 30572, 30715, 30852, 30985, 31114, 31238, 31357, 31471, 31581, 31686, 31786, 31881, 31972, 32057, 32138, 32215, 32285, 32352, 32413, 32470, 32521, 32569, 32610, 32647, 32679, 32706, 32728, 32746, 32758, 32766, 32767, };
+/* Generation code:
+int i;
+for (i = 0; i <= 128; i++)
+{
+	sinTable[i] = (int16_t)(32767. * sin( ((M_PI/2.)*(double)i)/128.) + 0.5);
+}
++ optimisation
+*/
+
+
+// do the sinus of an "aseba" angle that spans the whole 16 bits range, and return a 1.15 fixed point value
+static inline int16_t aseba_sin(int16_t angle)
+{
+	int16_t index;
+	int16_t subIndex;
+	int16_t invert;
+	int16_t lookupAngle;
+	if (angle < 0)
+	{
+		if (angle < -16384)
+			lookupAngle = 32768 + angle;
+		else if (angle > -16384)
+			lookupAngle = -angle;
+		else
+			return -32767;
+		invert = 1;
+	}
+	else
+	{
+		if (angle > 16384)
+			lookupAngle = 32767 - angle + 1;
+		else if (angle < 16384)
+			lookupAngle = angle;
+		else
+			return 32767;
+		invert = 0;
+	}
+
+	index = lookupAngle >> 7;
+	subIndex = lookupAngle & 0x7f;
+
+	{
+		int16_t result = (int16_t)(((int32_t)aseba_sin_table[index] * (int32_t)(128-subIndex) + (int32_t)aseba_sin_table[index+1] * (int32_t)(subIndex)) >> 7);
+
+		if (invert)
+			return -result;
+		else
+			return result;
+	}
+}
+
+// do the cos of an "aseba" angle that spans the whole 16 bits range, and return a 1.15 fixed point value
+static inline int16_t aseba_cos(int16_t angle)
+{
+	return aseba_sin(16384 + angle);
+}
+
+// Do integer square root ( from Wikipedia )
+static inline int16_t aseba_sqrt(int16_t num)
+{
+	int16_t op = num;
+	int16_t res = 0;
+	int16_t one = 1 << 14;
+
+	while(one > op)
+		one >>= 2;
+
+	while(one != 0) 
+	{
+		if (op >= res + one) 
+		{
+			op -= res + one;
+			res = (res >> 1) + one;
+		}
+		else
+		{
+			res >>= 1;
+		}
+		one >>= 2;
+	}
+	return res;
+}
+
+// comb sort ( from Wikipedia )
+static inline void aseba_comb_sort(int16_t* input, uint16_t size)
+{
+	uint16_t gap = size;
+	uint16_t swapped = 0;
+	uint16_t i;
+
+	while ((gap > 1) || swapped)
+	{
+		if (gap > 1)
+		{
+#ifdef __C30__
+			gap = __builtin_divud(__builtin_muluu(gap,4),5);
+#else
+			gap = (uint16_t)(((uint32_t)gap * 4) / 5);
+#endif
+		}
+
+		swapped = 0;
+
+		for (i = 0; gap + i < size; i++)
+		{
+			if (input[i] - input[i + gap] > 0)
+			{
+				int16_t swap = input[i];
+				input[i] = input[i + gap];
+				input[i + gap] = swap;
+				swapped = 1;
+			}
+		}
+	}
+}
+
+// element loops of the vector natives, the arrays might overlap and are processed from first to last element
+
+// copy src to dest
+static inline void aseba_vec_copy(int16_t* dest, const int16_t* src, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+		*dest++ = *src++;
+}
+
+// fill dest with the value pointed to by value, which is read at each element
+static inline void aseba_vec_fill(int16_t* dest, const int16_t* value, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+		*dest++ = *value;
+}
+
+// add scalar to each element of src into dest
+static inline void aseba_vec_add_scalar(int16_t* dest, const int16_t* src, int16_t scalar, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+		*dest++ = (int16_t)(*src++ + scalar);
+}
+
+// add src1 and src2 into dest
+static inline void aseba_vec_add(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+		*dest++ = (int16_t)(*src1++ + *src2++);
+}
+
+// subtract src2 from src1 into dest
+static inline void aseba_vec_sub(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+		*dest++ = (int16_t)(*src1++ - *src2++);
+}
+
+// multiply src1 and src2 into dest
+static inline void aseba_vec_mul(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+		*dest++ = (int16_t)(*src1++ * *src2++);
+}
+
+// divide src1 by src2 into dest, return 0 and stop at the first division by zero, 1 otherwise
+static inline uint16_t aseba_vec_div(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+		int32_t dividend = (int32_t)*src1++;
+		int32_t divisor = (int32_t)*src2++;
+		if (divisor == 0)
+			return 0;
+		*dest++ = (int16_t)(dividend / divisor);
+	}
+	return 1;
+}
+
+// write the minimum of src1 and src2 into dest
+static inline void aseba_vec_min(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+		int16_t v1 = *src1++;
+		int16_t v2 = *src2++;
+		*dest++ = v1 < v2 ? v1 : v2;
+	}
+}
+
+// write the maximum of src1 and src2 into dest
+static inline void aseba_vec_max(int16_t* dest, const int16_t* src1, const int16_t* src2, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+		int16_t v1 = *src1++;
+		int16_t v2 = *src2++;
+		*dest++ = v1 > v2 ? v1 : v2;
+	}
+}
+
+// clamp src to low/high bounds into dest
+static inline void aseba_vec_clamp(int16_t* dest, const int16_t* src, const int16_t* low, const int16_t* high, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+		int16_t v = *src++;
+		int16_t l = *low++;
+		int16_t h = *high++;
+		*dest++ = v > h ? h : (v < l ? l : v);
+	}
+}
+
+// dot product of src1 and src2 in a 32 bits accumulator, DSP targets use their 40 bits saturating accumulator instead
+static inline int32_t aseba_vec_dot(const int16_t* src1, const int16_t* src2, uint16_t length)
+{
+	int32_t res = 0;
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+#ifdef __C30__
+		res += __builtin_mulss(*src1++, *src2++);
+#else
+		res += (int32_t)*src1++ * (int32_t)*src2++;
+#endif
+	}
+	return res;
+}
+
+// write the minimum, maximum and mean of src, nothing if it is empty
+static inline void aseba_vec_stat(const int16_t* src, int16_t* min, int16_t* max, int16_t* mean, uint16_t length)
+{
+	int16_t val;
+	int32_t acc;
+	uint16_t i;
+
+	if (length)
+	{
+		val = *src++;
+		acc = val;
+		*min = val;
+		*max = val;
+
+		for (i = 1; i < length; i++)
+		{
+			val = *src++;
+			if (val < *min)
+				*min = val;
+			if (val > *max)
+				*max = val;
+			acc += (int32_t)val;
+		}
+
+		*mean = (int16_t)(acc / (int32_t)length);
+	}
+}
+
+// write the indices of the first minimum and maximum of src, nothing if it is empty
+static inline void aseba_vec_argbounds(const int16_t* src, int16_t* argmin, int16_t* argmax, uint16_t length)
+{
+	int16_t min = 32767;
+	int16_t max = -32768;
+	int16_t val;
+	uint16_t i;
+
+	for (i = 0; i < length; i++)
+	{
+		val = *src++;
+		if (val < min)
+		{
+			min = val;
+			*argmin = (int16_t)i;
+		}
+		if (val > max)
+		{
+			max = val;
+			*argmax = (int16_t)i;
+		}
+	}
+}
+
+// compute (a*b)/c in 32 bits into dest, return 0 and stop at the first division by zero, 1 otherwise
+static inline uint16_t aseba_vec_muldiv(int16_t* dest, const int16_t* a, const int16_t* b, const int16_t* c, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+		int32_t va = (int32_t)*a++;
+		int32_t vb = (int32_t)*b++;
+		int32_t vc = (int32_t)*c++;
+		if (vc == 0)
+			return 0;
+		*dest++ = (int16_t)((va * vb) / vc);
+	}
+	return 1;
+}
+
+/*@}*/
+
+#endif